@@ -23,8 +23,15 @@ CODECOVFLAGS := $(DEBUGFLAG) $(TESTFLAGS) $(CODECOV)
 MAINFLAGS := $(DEBUGFLAG) $(DIAGNO)
 RELFLAGS := -O3 -DRELEASE_LOGGING -DCOLLECT_DIAGNOSTICS -DNDEBUG
 
-CFLAGS := -std=c17 -Wall -Wextra -Werror
-LFLAGS := -std=c17 -Wall -Wextra -Werror
+CFLAGS := -std=c17 -Wall -Wextra -Werror -pthread
+LFLAGS := -std=c17 -Wall -Wextra -Werror -pthread
+
+# label hash of the DomainTree; see include/labelhash.h. e.g.,
+# make LABEL_HASH=LABEL_HASH_FNV. a change needs a clean build.
+LABEL_HASH ?=
+ifneq ($(LABEL_HASH),)
+CFLAGS += -DLABEL_HASH=$(LABEL_HASH)
+endif
 
 VERSIONDOTH := include/version.h
 SRC ?=
@@ -41,6 +48,17 @@ VERSIONNOGIT := $(patsubst %.h,generated/%.nogit.h,$(VERSIONDOTH))
 generated/%.nogit.h: $(VERSIONDOTH) createversion.sh
 	/bin/sh ./createversion.sh
 
+# perfect hash table of the TLDs in etc/tlds.txt; included by tldtable.c only.
+TLDTABLE := generated/include/tldtable.nogit.h
+
+$(TLDTABLE): etc/tlds.txt $(SRCDIR)/tools/gentldtable.c include/tldtable.h
+	@mkdir -p $(dir $@) ${BINDIR}
+	@echo Generating $@ from $<
+	@$(CC) $(LFLAGS) $(INCLUDE) -O2 $(SRCDIR)/tools/gentldtable.c -o ./${BINDIR}/gentldtable.real
+	@./${BINDIR}/gentldtable.real $< $@
+
+$(foreach d,$(DIRMAIN) $(DIRREL) $(DIRTEST) $(DIRCODECOV),$(d)/$(SRCDIR)/tldtable.o): $(TLDTABLE)
+
 $(DIRMAIN)/%.o: %.c
 	@mkdir -p $(dir $@)
 	@echo Using $(CC) to compile $< for main debug..
@@ -73,7 +91,35 @@ main: $(VERSIONNOGIT) $(OBJMAIN)
 release: $(VERSIONNOGIT) $(OBJREL)
 	@echo Linking $@
 	@mkdir -p ${BINDIR}
-	@$(CC) $(FLAGS) $(OBJREL) -o ./${BINDIR}/$@.real
+	@$(CC) $(LFLAGS) $(OBJREL) -o ./${BINDIR}/$@.real
+
+gencorpus: $(SRCDIR)/tools/gencorpus.c
+	@echo Linking $@
+	@mkdir -p ${BINDIR}
+	@$(CC) $(LFLAGS) -O2 $< -o ./${BINDIR}/$@.real -lm
+
+# lookups per second of each label hash on real inputs.
+BENCH_INPUTS ?= tests/001_inputs/*.fat
+
+benchhash: $(SRCDIR)/tools/benchhash.c $(SRCDIR)/labelhash.c
+	@echo Linking $@
+	@mkdir -p ${BINDIR}
+	@$(CC) $(LFLAGS) $(INCLUDE) -O2 $^ -o ./${BINDIR}/$@.real
+	@./${BINDIR}/$@.real $(BENCH_INPUTS)
+
+# synthetic input for scale testing; same seed and options, same files.
+CORPUS_DIR ?= corpus
+CORPUS_FILES ?= 3
+CORPUS_LINES ?= 1000000
+CORPUS_SEED ?= 1
+CORPUS_ARGS ?=
+
+.PHONY: corpus
+corpus: gencorpus
+	@mkdir -p $(CORPUS_DIR)
+	@echo Generating $(CORPUS_FILES) files of $(CORPUS_LINES) lines in $(CORPUS_DIR)
+	@./${BINDIR}/gencorpus.real -d $(CORPUS_DIR) -f $(CORPUS_FILES) \
+		-n $(CORPUS_LINES) -s $(CORPUS_SEED) $(CORPUS_ARGS)
 
 fpos: obj/testfpos.o
 	@mkdir -p ${BINDIR}
@@ -0,0 +1,48 @@
+/**
+ * arena.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+#include "dedupdomains.h"
+
+struct ArenaSlab;
+
+/**
+ * Bump allocator. Memory handed out is only released all at once by
+ * free_Arena(). Not thread safe; one arena per inserting thread.
+ */
+typedef struct Arena
+{
+	// slab currently allocated from is the head; older slabs follow.
+	struct ArenaSlab *slabs;
+	size_t len_slabs;
+	// bytes handed out by alloc_Arena(), bytes_Arena() and copy_Arena().
+	size_t used;
+} Arena_t;
+
+extern void init_Arena(Arena_t *arena);
+extern void free_Arena(Arena_t *arena);
+extern void *alloc_Arena(Arena_t *arena, size_t size);
+extern void *calloc_Arena(Arena_t *arena, size_t size);
+extern char *bytes_Arena(Arena_t *arena, size_t len);
+extern char *copy_Arena(Arena_t *arena, char const *src, size_t len);
+extern void merge_Arena(Arena_t *dest, Arena_t *src);
+
+#endif
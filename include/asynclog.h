@@ -0,0 +1,42 @@
+/**
+ * asynclog.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+#include <stdbool.h>
+
+/**
+ * Which global log a message is bound for: the error log (-E or stderr) or the
+ * standard log (-L or stdout).
+ */
+typedef enum LogTarget
+{
+	LOG_TARGET_ERR,
+	LOG_TARGET_STD
+} LogTarget_t;
+
+extern void start_AsyncLog();
+extern void stop_AsyncLog();
+extern void set_silent_AsyncLog(bool v);
+extern bool silent_AsyncLog();
+extern void write_AsyncLog(LogTarget_t target, char const *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+#endif
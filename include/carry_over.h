@@ -11,6 +11,8 @@ extern void insert_carry_over(carry_over_t *co, linenumber_t ln);
 extern linenumber_t len_carry_over(carry_over_t *co);
 extern void init_carry_over(carry_over_t *co);
 extern void free_carry_over(carry_over_t *co);
-extern void transfer_linenumbers(linenumber_t *dest_linenumbers, carry_over_t *co);
+struct LineBitmap;
+
+extern void transfer_carry_over(struct LineBitmap *kept, carry_over_t *co);
 
 #endif
@@ -21,21 +21,13 @@
 #ifndef CONTEXTDOMAIN_H
 #define CONTEXTDOMAIN_H
 #include "dedupdomains.h"
+#include "linebitmap.h"
 
 typedef struct ContextDomain
 {
-	// regex trimming will be done after consolidation and during the final
-	// write.  the full domain is necessary to check against regex. regexes may
-	// be found after reading some or all of the files.
-
-	// only need the line numbers when writing to final output.
-	linenumber_t *linenumbers;
-	size_len_t next_idx; // length and the next spot to insert.
-	size_len_t alloc_linenumbers; // total space allocated/available
-
-#ifdef COLLECT_DIAGNOSTICS
-	size_len_t count_realloc_linenumbers;
-#endif
+	// only need the line numbers when writing to final output. the lines of
+	// the surviving domains and the carried over lines of one input file.
+	LineBitmap_t kept;
 } ContextDomain_t;
 
 #endif
@@ -45,11 +45,14 @@ typedef struct CsvColView
 	size_len_t idx;
 } CsvColView_t;
 
-extern bool update_CsvLineView(CsvLineView_t *lv, char const *input_line);
+extern bool update_CsvLineView(CsvLineView_t *lv, char const *input_line,
+		size_t len);
 extern bool null_CsvLineView(CsvLineView_t const *lv);
 extern void init_CsvLineView(CsvLineView_t *lv);
 extern void free_CsvLineView(CsvLineView_t *lv);
 
+extern size_len_t extract_CsvCols(char const *input_line, size_t len,
+		size_len_t const *idxs, size_len_t count, CsvColView_t *cols);
 extern CsvColView_t get_CsvColView(CsvLineView_t const *lv, size_len_t idx);
 extern void print_CsvLineView(CsvLineView_t const *const lv);
 
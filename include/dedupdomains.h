@@ -27,6 +27,7 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <assert.h>
+#include "asynclog.h"
 #include "logdiagnostics.h"
 
 #define UNUSED(x) (void)(x)
@@ -71,6 +72,10 @@ typedef unsigned int linenumber_t;
 #define LINENUMBER_MAX UINT_MAX
 #endif
 
+// index of the input file; the order files are given on the command line.
+typedef unsigned short fileindex_t;
+#define FILEINDEX_MAX USHRT_MAX
+
 #ifdef USE_SIZE_T
 typedef size_t size_len_t;
 #else
@@ -85,15 +90,14 @@ typedef uint size_len_t;
 #define DEBUG_PRINTF(fmt, ...)
 #endif
 
+extern void lock_globalLogs();
+extern void unlock_globalLogs();
 extern void open_globalErrLog();
 FILE *get_globalErrLog();
 extern void close_globalErrLog();
 extern void free_globalErrLog();
 
-#define ELOG_STDERR(fmt, ...) do { \
-	open_globalErrLog(); \
-	fprintf(get_globalErrLog(), fmt, ##__VA_ARGS__); \
-	close_globalErrLog(); \
-} while(0)
+#define ELOG_STDERR(fmt, ...) \
+	write_AsyncLog(LOG_TARGET_ERR, fmt, ##__VA_ARGS__)
 
 #endif
@@ -22,6 +22,7 @@
 #define DOMAIN_H
 #include "dedupdomains.h"
 #include "matchstrength.h"
+#include <stdint.h>
 
 /**
  * This is to reference a domain as it is being inserted into the DomainTree.
@@ -38,7 +39,7 @@
 typedef struct DomainView
 {
 	// indicates which file this line was read from.
-	void *context;
+	fileindex_t file_index;
 	// line number in the input file the original line was read from
 	linenumber_t linenumber;
 
@@ -69,6 +70,9 @@ typedef struct DomainView
 	// decrement the entries remaining.
 	size_len_t* label_indexes;
 	uchar* lengths;
+	// hash_Label() of each label computed while splitting the domain; same
+	// order as the lengths.
+	uint32_t* hashes;
 	size_len_t segs_used;
 	size_len_t segs_alloc;
 
@@ -98,6 +102,8 @@ typedef struct SubdomainView
 	char const *data;
 	// number of bytes in 'data' to read
 	uchar len;
+	// hash_Label() of the label
+	uint32_t hash;
 } SubdomainView_t;
 
 extern void init_DomainView(DomainView_t *dv);
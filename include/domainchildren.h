@@ -0,0 +1,68 @@
+/**
+ * domainchildren.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DOMAIN_CHILDREN_H
+#define DOMAIN_CHILDREN_H
+#include "dedupdomains.h"
+#include <stdint.h>
+
+struct DomainTree;
+
+// children held in place before the first allocation.
+#define DOMAIN_CHILDREN_INLINE 2
+// largest sorted array before promoting to a hash table.
+#define DOMAIN_CHILDREN_SORTED_MAX 16
+
+/**
+ * Children of a DomainTree node keyed by their first label. Most nodes have
+ * none or one child so the first few are held in place and compared by hash.
+ * Past that the children move to the heap as an array of nodes followed by an
+ * array of their hashes: first sorted by hash and, once more than
+ * DOMAIN_CHILDREN_SORTED_MAX, as an open addressing hash table probed on the
+ * hashes alone. The kind is told by 'alloc':
+ *   - zero: 'nodes' and 'hashes' hold 'len' children in place.
+ *   - up to DOMAIN_CHILDREN_SORTED_MAX: 'heap' sorted by hash.
+ *   - above: 'heap' is a table of 'alloc' slots, a power of two. A hash of
+ *     zero marks an empty slot.
+ * A zero'ed instance is empty.
+ */
+typedef struct DomainChildren
+{
+	union
+	{
+		struct DomainTree *nodes[DOMAIN_CHILDREN_INLINE];
+		struct DomainTree **heap;
+	};
+	uint32_t hashes[DOMAIN_CHILDREN_INLINE];
+	uint32_t len;
+	uint32_t alloc;
+} DomainChildren_t;
+
+extern struct DomainTree *find_DomainChildren(DomainChildren_t const *dc,
+		uint32_t hash, char const *label, size_t len);
+extern void add_DomainChildren(DomainChildren_t *dc, uint32_t hash,
+		struct DomainTree *node);
+extern struct DomainTree *next_DomainChildren(DomainChildren_t const *dc,
+		size_t *pos);
+extern void free_DomainChildren(DomainChildren_t *dc);
+extern size_t len_DomainChildren(DomainChildren_t const *dc);
+extern size_t bytes_DomainChildren(DomainChildren_t const *dc);
+
+#endif
@@ -23,16 +23,19 @@
 #include "dedupdomains.h"
 #include "matchstrength.h"
 
-struct DomainView;
-
+/**
+ * Payload of a DomainTree node held inline in the node. A node without a
+ * domain of its own has MATCH_NOTSET.
+ */
 typedef struct DomainInfo
 {
-	// Pointer to pfb_context_t for FILE read from and FILE to write to. Carried
-	// here to remember during consolidate and write which file to retrieve the
-	// line number from and file to write to.
-	void *context;
 	linenumber_t linenumber;
-	MatchStrength_t match_strength;
+	// Index of the pfb_context_t for FILE read from and FILE to write to.
+	// Carried here to remember during consolidate and write which file to
+	// retrieve the line number from and file to write to.
+	fileindex_t file_index;
+	// MatchStrength_t stored in a single byte.
+	signed char match_strength;
 
 #if defined(BUILD_TESTS)
 	// useful/necessary for tests and debug.
@@ -42,7 +45,4 @@ typedef struct DomainInfo
 #endif
 } DomainInfo_t;
 
-extern DomainInfo_t* convert_DomainInfo(struct DomainView *dv);
-extern void free_DomainInfo(DomainInfo_t **di);
-
 #endif
@@ -21,31 +21,101 @@
 #ifndef DOMAIN_TREE_H
 #define DOMAIN_TREE_H
 #include "dedupdomains.h"
-#include "uthash.h"
+#include "domaininfo.h"
+#include "domainchildren.h"
+#include <stdint.h>
 
+/**
+ * One or more labels of a domain. A run of labels where each has a single
+ * subdomain and no domain of its own is held by one node: the first label is
+ * the key of the node in the children of its parent and the labels after it
+ * follow the key, each preceded by its length. The run is split when a domain
+ * ends or branches off within it. Only the last label of the run may be a
+ * domain and only it has children.
+ *
+ * The root of a tree is a node without labels whose children are the TLDs. It
+ * is created by the first insert; an empty tree is NULL.
+ */
 typedef struct DomainTree
 {
-	// malloc'ed string for tld. not null terminated.
+	// string for tld allocated from the arena of the tree. not null
+	// terminated. followed by the 'len_tail' bytes of the rest of the run.
 	char *tld;
+	DomainChildren_t children;
+
+	// inline to avoid an allocation and a pointer per unique domain. packs
+	// with 'len' into the tail of the node.
+	DomainInfo_t di;
 	// domain segments are at most 63 bytes
 	uchar len;
-
-	struct DomainInfo *di;
-	struct DomainTree *child;
-	UT_hash_handle hh;
+	// bytes of the labels following 'tld' in the run; zero for one label.
+	uint16_t len_tail;
 } DomainTree_t;
 
+/**
+ * What became of a domain given to insert_DomainTree().
+ */
+typedef enum InsertOutcome
+{
+	// the domain was added to the tree.
+	INSERT_NEW,
+	// the domain replaced the same domain of a weaker match.
+	INSERT_REPLACED,
+	// a parent domain is a FULL match; the domain is redundant.
+	INSERT_UNDER_FULL,
+	// the same domain with an equal or stronger match is already held.
+	INSERT_IDENTICAL,
+	// the match strength is not set or bogus.
+	INSERT_SKIPPED
+} InsertOutcome_t;
+
 struct DomainView;
-extern DomainTree_t* insert_DomainTree(DomainTree_t **dt, struct DomainView *dv);
+struct Arena;
+extern DomainTree_t* insert_DomainTree(DomainTree_t **dt, struct Arena *arena,
+		struct DomainView *dv, InsertOutcome_t *outcome);
 
-extern void free_DomainTree(DomainTree_t **root);
+extern void free_DomainTree(DomainTree_t **root, struct Arena *arena);
 
 extern void transfer_DomainInfo(DomainTree_t **root,
-		void(*collector)(struct DomainInfo **di, void *context), void *context);
+		void(*collector)(struct DomainInfo const *di, void *context),
+		void *context);
 
 extern void visit_DomainTree(DomainTree_t *root,
 		void(*visitor_func)(struct DomainInfo const *di, void *context),
 		void *context);
+extern size_t prune_DomainTree(DomainTree_t *root,
+		bool(*drop)(char const *fqd, size_t len, void *context),
+		void *context);
+extern size_t visit_names_DomainTree(DomainTree_t *root,
+		void(*visit)(char const *fqd, size_t len, struct DomainInfo const *di,
+			void *context),
+		void *context);
 extern void print_DomainTree(DomainTree_t *root);
+#ifdef COLLECT_DIAGNOSTICS
+extern void log_DomainTree(DomainTree_t const *root);
+#endif
+
+/**
+ * Root level of a DomainTree partitioned by the hash of the top level label.
+ * Domains under different TLDs never interact during insertion so each shard
+ * may be owned by its own thread without locking.
+ */
+typedef struct DomainTreeShards
+{
+	DomainTree_t **roots;
+	// one arena per shard; same size and order as the roots.
+	struct Arena *arenas;
+	size_t len_shards;
+} DomainTreeShards_t;
+
+extern void init_DomainTreeShards(DomainTreeShards_t *shards,
+		size_t len_shards);
+extern void free_DomainTreeShards(DomainTreeShards_t *shards);
+extern size_t shard_DomainTree(DomainTreeShards_t const *shards,
+		struct DomainView *dv);
+extern DomainTree_t* insert_DomainTreeShards(DomainTreeShards_t *shards,
+		size_t shard, struct DomainView *dv, InsertOutcome_t *outcome);
+extern void merge_DomainTreeShards(DomainTreeShards_t *shards,
+		DomainTree_t **root, struct Arena *arena);
 
 #endif
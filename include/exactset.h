@@ -0,0 +1,63 @@
+/**
+ * exactset.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef EXACTSET_H
+#define EXACTSET_H
+#include "dedupdomains.h"
+#include "matchstrength.h"
+#include "arena.h"
+#include <stdint.h>
+
+typedef struct ExactSlot
+{
+	// zero marks an empty slot; hashes are never zero.
+	uint64_t hash;
+	char const *key;
+	uint32_t len;
+	signed char match_strength;
+} ExactSlot_t;
+
+/**
+ * Open addressing set of the full names of the domains inserted into a
+ * DomainTree along with their strongest match. Probed before a line is split
+ * into labels so an exact duplicate that is no stronger than the one held is
+ * dropped without descending the tree. Keys are copied into the arena.
+ */
+typedef struct ExactSet
+{
+	ExactSlot_t *slots;
+	// number of slots; a power of two.
+	size_t alloc;
+	size_t len;
+	Arena_t arena;
+
+	// lookups and the duplicates they dropped for diagnostics.
+	size_t probes;
+	size_t hits;
+} ExactSet_t;
+
+extern void init_ExactSet(ExactSet_t *es);
+extern void free_ExactSet(ExactSet_t *es);
+extern bool held_ExactSet(ExactSet_t *es, char const *key, size_t len,
+		MatchStrength_t ms);
+extern void insert_ExactSet(ExactSet_t *es, char const *key, size_t len,
+		MatchStrength_t ms);
+
+#endif
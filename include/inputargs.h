@@ -30,6 +30,24 @@ typedef struct input_args
 	 */
 	bool use_shared_buffer;
 
+	/**
+	 * 'm' set to true to memory map the input files instead of reading them
+	 * in chunks.
+	 */
+	bool use_mmap;
+
+	/**
+	 * 'p' set to true to record the position of every line while reading and
+	 * write the kept lines by copying those byte ranges.
+	 */
+	bool use_spans;
+
+	/**
+	 * 'R' set to true to remove the domains matched by the regex lines of the
+	 * input files. The regex lines are kept.
+	 */
+	bool prune_regex;
+
 	/**
 	 * 's' set to false to print or log file (if provided) diagnostics and
 	 * progress.
@@ -37,26 +55,50 @@ typedef struct input_args
 	bool silent_flag;
 
 	/**
-	 * 'i' set to true and specify an initial internal buffer size to use for
-	 * domain consolidation.
+	 * 'j' specify the number of threads to read and parse the input files and
+	 * to write the output files.
+	 * default is 1, i.e., no additional threads.
 	 */
-	bool override_buffersize;
+	int num_threads;
+
+	/**
+	 * '--stats=json' set to true to print the timings of each phase and the
+	 * counts of each file as JSON to stdout once done. Implies 's' so that
+	 * stdout holds only the JSON; messages still go to the 'L' log file.
+	 */
+	bool stats_json;
+	/**
+	 * '--stats-file' specify a file to write the JSON to instead of stdout;
+	 * implies '--stats=json' without 's'.
+	 */
+	char const *stats_fname;
+
+	/**
+	 * '--engine=sort' set to true to deduplicate by sorting a flat array of the
+	 * domains instead of inserting them into the DomainTree. '--engine=tree'
+	 * is the default.
+	 */
+	bool sort_engine;
+
 	/**
-	 * when override_buffersize is true, set this value to the initial buffer
-	 * size.
+	 * '--snapshot' set to true and specify a file to keep the state of the run
+	 * in. Inputs unchanged since the last run are replayed from it and their
+	 * outputs are rewritten only when changed.
 	 */
-	int initial_buffer_size;
+	bool snapshot_flag;
+	char const *snapshot_fname;
 
 	/**
-	 * 'r' set to true and specify the number of elements to increase buffer
-	 * size.
+	 * '--unbound' set to true and specify a file to write the kept domains to
+	 * as Unbound 'local-zone' and 'local-data' entries.
 	 */
-	bool override_reallocsize;
+	bool unbound_flag;
+	char const *unbound_fname;
 	/**
-	 * when override_reallocsize is true, set this value to the number of
-	 * elements to increase the internal buffer size.
+	 * '--sinkhole' optional address the names blocked by the Unbound file
+	 * resolve to. FULL matches are answered with NXDOMAIN when not given.
 	 */
-	int realloc_buffer_size;
+	char const *sinkhole;
 
 #ifdef BUILD_TESTS
 	/**
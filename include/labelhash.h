@@ -0,0 +1,42 @@
+/**
+ * labelhash.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef LABEL_HASH_H
+#define LABEL_HASH_H
+#include <stddef.h>
+#include <stdint.h>
+
+// hash functions of the labels of the DomainTree.
+#define LABEL_HASH_WY 1
+#define LABEL_HASH_FNV 2
+#define LABEL_HASH_JEN 3
+
+// pick one at compile time, e.g., -DLABEL_HASH=LABEL_HASH_JEN
+#ifndef LABEL_HASH
+#define LABEL_HASH LABEL_HASH_WY
+#endif
+
+extern uint32_t hash_label_wy(char const *label, size_t len);
+extern uint32_t hash_label_fnv(char const *label, size_t len);
+extern uint32_t hash_label_jen(char const *label, size_t len);
+extern uint32_t hash_Label(char const *label, size_t len);
+extern char const *name_LabelHash();
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * linebitmap.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef LINEBITMAP_H
+#define LINEBITMAP_H
+#include "dedupdomains.h"
+#include <stdint.h>
+
+/**
+ * One bit per line of an input file; the bit of the line numbered N is set
+ * when the line is written to the output file. Line numbers are dense so the
+ * kept lines are found in ascending order by scanning the words.
+ */
+typedef struct LineBitmap
+{
+	uint64_t *words;
+	size_t len_words;
+	// number of bits set
+	linenumber_t count;
+} LineBitmap_t;
+
+extern void init_LineBitmap(LineBitmap_t *lb);
+extern void free_LineBitmap(LineBitmap_t *lb);
+extern void set_LineBitmap(LineBitmap_t *lb, linenumber_t ln);
+extern bool has_LineBitmap(LineBitmap_t const *lb, linenumber_t ln);
+extern linenumber_t next_LineBitmap(LineBitmap_t const *lb, linenumber_t ln);
+extern linenumber_t last_LineBitmap(LineBitmap_t const *lb);
+extern bool equal_LineBitmap(LineBitmap_t const *a, LineBitmap_t const *b);
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * linespans.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef LINESPANS_H
+#define LINESPANS_H
+#include "dedupdomains.h"
+
+/**
+ * Where a line of an input file begins and how many characters it holds.
+ * Terminating \r and \n are not included.
+ */
+typedef struct LineSpan
+{
+	size_t offset;
+	size_len_t len;
+} LineSpan_t;
+
+/**
+ * The span of every line of one input file recorded during the initial read;
+ * the line numbered N is at index N - 1. Lets the write phase copy the kept
+ * lines without reading the input file line by line a second time.
+ */
+typedef struct LineSpans
+{
+	LineSpan_t *spans;
+	linenumber_t len;
+	linenumber_t alloc;
+} LineSpans_t;
+
+extern void init_LineSpans(LineSpans_t *ls);
+extern void free_LineSpans(LineSpans_t *ls);
+extern void insert_LineSpans(LineSpans_t *ls, linenumber_t ln, size_t offset,
+		size_len_t len);
+extern LineSpan_t const *get_LineSpans(LineSpans_t const *ls, linenumber_t ln);
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * outbuffer.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OUTBUFFER_H
+#define OUTBUFFER_H
+#include "dedupdomains.h"
+
+/**
+ * Lines bound for one output file collected in a large buffer and handed to
+ * write(2) in big batches instead of a pair of fwrite() calls per line.
+ */
+typedef struct OutBuffer
+{
+	int fd;
+	// page aligned; allocated on the first line appended.
+	char *data;
+	size_t len;
+	size_t alloc;
+
+	// totals since init_OutBuffer() for diagnostics.
+	size_t bytes;
+	size_t syscalls;
+} OutBuffer_t;
+
+extern void init_OutBuffer(OutBuffer_t *ob, int fd);
+extern void free_OutBuffer(OutBuffer_t *ob);
+extern int append_OutBuffer(OutBuffer_t *ob, char const *line, size_t len);
+extern int flush_OutBuffer(OutBuffer_t *ob);
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * parsedbatch.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PARSEDBATCH_H
+#define PARSEDBATCH_H
+#include "dedupdomains.h"
+#include "matchstrength.h"
+#include <stdint.h>
+
+struct DomainView;
+
+/**
+ * One line of input that was tokenized and split into labels by a reader
+ * thread. The domain bytes and label arrays live in the owning ParsedBatch.
+ */
+typedef struct ParsedDomain
+{
+	// offset into ParsedBatch::bytes where the domain begins
+	size_t offset;
+	// offset into ParsedBatch::label_indexes and ParsedBatch::lengths
+	size_t first_label;
+	size_len_t len;
+	size_len_t segs_used;
+	linenumber_t linenumber;
+	MatchStrength_t match_strength;
+	// shard of the DomainTree the domain is inserted into
+	size_t shard;
+} ParsedDomain_t;
+
+/**
+ * A block of domains read from a single file. Filled by one reader thread and
+ * handed off for insertion into the DomainTree once full. The domain bytes are
+ * copied since the line buffer of read_pfb_line() is reused for every line.
+ */
+typedef struct ParsedBatch
+{
+	char *bytes;
+	size_t len_bytes;
+	size_t alloc_bytes;
+
+	// same layout as DomainView::label_indexes, DomainView::lengths and
+	// DomainView::hashes; each ParsedDomain references a run of these.
+	size_len_t *label_indexes;
+	uchar *lengths;
+	uint32_t *hashes;
+	size_t len_labels;
+	size_t alloc_labels;
+
+	ParsedDomain_t *domains;
+	size_t len_domains;
+	size_t alloc_domains;
+
+	// batches of the same file are queued in the order they were read.
+	struct ParsedBatch *next;
+	// number of inserting threads yet to consume the batch.
+	size_t pending;
+} ParsedBatch_t;
+
+extern void init_ParsedBatch(ParsedBatch_t *pb);
+extern void free_ParsedBatch(ParsedBatch_t *pb);
+extern void reset_ParsedBatch(ParsedBatch_t *pb);
+extern bool full_ParsedBatch(ParsedBatch_t const *pb);
+extern void append_ParsedBatch(ParsedBatch_t *pb, struct DomainView const *dv,
+		size_t shard);
+extern void view_ParsedBatch(ParsedBatch_t const *pb, size_t idx,
+		struct DomainView *dv);
+
+#endif
@@ -21,19 +21,46 @@
 #ifndef PFB_CONTEXT_H
 #define PFB_CONTEXT_H
 #include "carry_over.h"
+#include "linespans.h"
+#include "outbuffer.h"
+#include "regexset.h"
+#include "runstats.h"
 
 /**
  * Holds file name context information for a single file to be processed. A
- * shared pointer to the single DomainTree_t lives here in an array of size 1.
+ * shared pointer to the single DomainTree_t lives here in an array of size 1
+ * along with the arena it is allocated from.
  * This struct is initialized as an array of size # of files to be processed.
  */
 typedef struct pfb_context
 {
 	FILE *in_file;
 	FILE *out_file;
+	/**
+	 * Lines written to 'out_file' are batched here; flushed when the context is
+	 * flushed or closed.
+	 */
+	OutBuffer_t out;
 	char *in_fname;
 	char *out_fname;
 	struct DomainTree **dt;
+	// position of this context among all contexts.
+	fileindex_t file_index;
+	/**
+	 * Holds the memory of the DomainTree. Shared across all contexts the same
+	 * as 'dt'.
+	 */
+	struct Arena *arena;
+	/**
+	 * Domains read when deduplicating by sorting instead of by the DomainTree.
+	 * Shared across all contexts the same as 'dt'.
+	 */
+	struct SortedDomains *sorted;
+	/**
+	 * Full names of the domains in 'dt' probed before a line is split into
+	 * labels. Set only while pfb_read_csv() reads the context.
+	 */
+	struct ExactSet *exact;
 	/**
 	 * Line numbers in 'in_fname' to carry over without modification. These are
 	 * not inserted into the DomainTree. They are not omitted by any rules.
@@ -42,6 +69,25 @@ typedef struct pfb_context
 	 * until pfb_consolidate().
 	 */
 	carry_over_t co;
+	/**
+	 * Offset and length of every line in 'in_fname' when the write phase copies
+	 * the kept lines by their recorded byte ranges. Empty otherwise.
+	 */
+	LineSpans_t spans;
+	/**
+	 * Regexes of the lines carried over when pruning by regex. Used once
+	 * reading is done to remove the domains they match.
+	 */
+	RegexSet_t regexes;
+	/**
+	 * What became of the lines of 'in_fname' while reading.
+	 */
+	FileStats_t stats;
+	/**
+	 * What the snapshot of an incremental run holds of 'in_fname'. NULL unless
+	 * a snapshot is used. Owned by the Snapshot_t.
+	 */
+	struct SnapshotFile *snap;
 } pfb_context_t;
 
 typedef struct pfb_contexts
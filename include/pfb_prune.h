@@ -23,12 +23,26 @@
 #include "dedupdomains.h"
 
 struct ArrayDomainInfo;
+struct Arena;
 struct pfb_contexts;
+struct UnboundConf;
 
 extern char* pfb_strdup(const char *in, size_len_t in_size);
-extern void pfb_consolidate(struct DomainTree **root, struct ArrayDomainInfo *array_di);
+extern void pfb_consolidate(struct DomainTree **root, struct Arena *arena,
+		struct ArrayDomainInfo *array_di);
+extern void pfb_consolidate_sorted(struct pfb_contexts *cs,
+		struct ArrayDomainInfo *array_di, size_t num_threads,
+		struct UnboundConf *uc);
 extern void pfb_read_csv(struct pfb_contexts *cs);
+extern void pfb_read_csv_parallel(struct pfb_contexts *cs, size_t num_threads);
+extern void set_write_spans(bool v);
+extern void set_prune_regex(bool v);
+extern void set_sort_engine(bool v);
+extern size_t pfb_prune_regex(struct pfb_contexts *cs);
 extern void pfb_write_csv(struct pfb_contexts *cs, struct ArrayDomainInfo *array_di, bool);
+extern void pfb_write_csv_parallel(struct pfb_contexts *cs,
+		struct ArrayDomainInfo *array_di, bool, size_t num_threads);
+extern void pfb_write_unbound(struct pfb_contexts *cs, struct UnboundConf *uc);
 
 #ifdef COLLECT_DIAGNOSTICS
 extern size_t collected_domains_counter;
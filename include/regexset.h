@@ -0,0 +1,51 @@
+/**
+ * regexset.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef REGEXSET_H
+#define REGEXSET_H
+#include "dedupdomains.h"
+
+struct RegexEntry;
+struct RegexAutomaton;
+
+/**
+ * Regexes of MATCH_REGEX lines compiled once to prune the domains they match.
+ * The patterns are written for Python's re module, which pfBlockerNG uses,
+ * and are translated to POSIX extended regular expressions. A literal required
+ * by each pattern feeds one combined automaton so a domain is only run against
+ * the regexes that can match it.
+ */
+typedef struct RegexSet
+{
+	struct RegexEntry *entries;
+	size_t len;
+	size_t alloc;
+	// built on the first match after the set changes.
+	struct RegexAutomaton *ac;
+	uint stamp;
+} RegexSet_t;
+
+extern void init_RegexSet(RegexSet_t *rs);
+extern void free_RegexSet(RegexSet_t *rs);
+extern bool insert_RegexSet(RegexSet_t *rs, char const *pattern, size_t len);
+extern void merge_RegexSet(RegexSet_t *dest, RegexSet_t *src);
+extern bool match_RegexSet(RegexSet_t *rs, char const *fqd);
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * runstats.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef RUNSTATS_H
+#define RUNSTATS_H
+#include "dedupdomains.h"
+#include "domaintree.h"
+#include <time.h>
+
+/**
+ * Counts of what became of the lines of one input file.
+ *
+ * The tree engine counts each domain as it is inserted, in the order of the
+ * input files. A domain inserted before its FULL parent is 'inserted' and
+ * removed later. The sort engine counts the domains once they are sorted:
+ * parents come first, so such a domain is 'under_full' instead. 'inserted'
+ * is the first line of each name and 'replaced' a later, stronger line.
+ */
+typedef struct FileStats
+{
+	size_t lines;
+	size_t bytes;
+	// domains added to the tree or replacing a weaker match.
+	size_t inserted;
+	size_t replaced;
+	// redundant since a parent domain is a FULL match.
+	size_t under_full;
+	// the same domain is already held. includes repeats of a domain since
+	// covered by a FULL parent when dropped by the ExactSet of the tree.
+	size_t identical;
+	// regex lines carried over to the output as is.
+	size_t regex;
+	// lines with a bogus match strength or no usable domain.
+	size_t bogus;
+} FileStats_t;
+
+typedef enum RunPhase
+{
+	PHASE_READ,
+	PHASE_CONSOLIDATE,
+	PHASE_WRITE,
+	PHASE_COUNT
+} RunPhase_t;
+
+/**
+ * Wall and CPU time of each phase of a run. CPU time is of the whole process,
+ * i.e., summed over all threads.
+ */
+typedef struct RunStats
+{
+	double wall[PHASE_COUNT];
+	double cpu[PHASE_COUNT];
+	// "tree" or "sort"; what the counts of the files mean depends on it.
+	char const *engine;
+
+	struct timespec wall_begin;
+	double cpu_begin;
+} RunStats_t;
+
+struct pfb_contexts;
+
+extern void count_FileStats(FileStats_t *fs, InsertOutcome_t outcome);
+extern void add_FileStats(FileStats_t *dest, FileStats_t const *src);
+
+extern void init_RunStats(RunStats_t *rs);
+extern void begin_RunStats(RunStats_t *rs);
+extern void end_RunStats(RunStats_t *rs, RunPhase_t phase);
+extern void write_json_RunStats(FILE *out, RunStats_t const *rs,
+		struct pfb_contexts *cs);
+
+#endif
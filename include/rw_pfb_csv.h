@@ -24,27 +24,32 @@
 
 typedef struct PortLineData
 {
-	// null terminated string
+	// null terminated string unless the file is memory mapped; always use
+	// 'len'.
 	char const *data;
-	// length of the null terminated string to avoid strlen(x) calculations
+	// length of the string to avoid strlen(x) calculations
 	size_t len;
 	// line number in the input file
 	linenumber_t linenumber;
+	// byte offset of the first character of the line in the input file
+	size_t offset;
 } PortLineData_t;
 
+struct LineBitmap;
+
 typedef struct NextLineContext
 {
-	linenumber_t *linenumbers;
-	linenumber_t *begin_array;
+	struct LineBitmap const *kept;
 	linenumber_t next_linenumber;
-	size_len_t len;
 } NextLineContext_t;
 
+extern void set_read_mmap(bool v);
 extern size_t default_buffer_len();
 extern size_t get_max_line_len();
 
 struct pfb_context;
 struct ContextDomain;
+struct LineSpans;
 
 extern void init_NextLineContext(NextLineContext_t *nlc, struct ContextDomain *cd);
 
@@ -55,6 +60,7 @@ extern int read_pfb_line(struct pfb_context *, linenumber_t *nextline,
 		void *shared_buffer, size_t buffer_size,
 		void(*do_stuff)(PortLineData_t const *const plv, struct pfb_context *,
 			void *), void *context);
+extern int write_pfb_spans(struct pfb_context *, struct LineBitmap const *kept);
 extern void write_pfb_csv(PortLineData_t const *const pld, struct pfb_context *);
 extern void write_pfb_csv_callback(PortLineData_t const *const pld,
 		struct pfb_context *, void *);
@@ -0,0 +1,43 @@
+/**
+ * scan.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCAN_H
+#define SCAN_H
+#include "dedupdomains.h"
+
+/**
+ * Implementations of the byte scanning used to split input into lines and
+ * lines into columns. All produce identical results.
+ */
+typedef enum ScanKernel
+{
+	SCAN_SCALAR = 0,
+	SCAN_SSE2,
+	SCAN_AVX2,
+} ScanKernel_t;
+
+extern void init_scan();
+extern bool set_scan_kernel(ScanKernel_t k);
+extern ScanKernel_t get_scan_kernel();
+
+extern char const *scan_newline(char const *begin, char const *end);
+extern char const *scan_delimiter(char const *begin, char const *end);
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * snapshot.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include "dedupdomains.h"
+#include "linebitmap.h"
+#include "matchstrength.h"
+#include <stdint.h>
+
+/**
+ * What a previous run learned from one input file: the content hash to tell
+ * whether it changed, every line that took part in deduplication and the lines
+ * that were kept. An unchanged file is replayed from the parsed lines instead
+ * of read; its output is rewritten only when the kept lines differ.
+ */
+typedef struct SnapshotFile
+{
+	char *in_fname;
+	char *out_fname;
+	uint64_t size;
+	uint64_t hash;
+	linenumber_t lines;
+
+	// packed records of the domain and regex lines: line number, match
+	// strength, length and the text of the domain column.
+	char *records;
+	size_t len_records;
+	size_t alloc_records;
+
+	// lines written to 'out_fname' by the run that saved the snapshot.
+	LineBitmap_t kept;
+
+	// true when the input file is the same as when the snapshot was saved.
+	bool unchanged;
+} SnapshotFile_t;
+
+/**
+ * One SnapshotFile per input file. Once attached to the contexts the files are
+ * in the same order as the contexts.
+ */
+typedef struct Snapshot
+{
+	SnapshotFile_t *files;
+	size_t len_files;
+} Snapshot_t;
+
+struct pfb_contexts;
+struct pfb_context;
+struct PortLineData;
+struct ArrayDomainInfo;
+
+extern void init_Snapshot(Snapshot_t *snap);
+extern void free_Snapshot(Snapshot_t *snap);
+extern bool load_Snapshot(Snapshot_t *snap, char const *fname);
+extern bool save_Snapshot(Snapshot_t const *snap, char const *fname,
+		struct pfb_contexts *cs, struct ArrayDomainInfo const *array_di);
+extern void attach_Snapshot(Snapshot_t *snap, struct pfb_contexts *cs);
+
+extern void record_SnapshotFile(SnapshotFile_t *sf, linenumber_t linenumber,
+		MatchStrength_t ms, char const *data, size_t len);
+extern bool replay_SnapshotFile(struct pfb_context *pfbc,
+		void(*do_stuff)(struct PortLineData const *const pld,
+			struct pfb_context *, void *), void *context);
+extern bool skip_write_SnapshotFile(SnapshotFile_t const *sf,
+		LineBitmap_t const *kept);
+
+#endif
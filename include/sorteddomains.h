@@ -0,0 +1,79 @@
+/**
+ * sorteddomains.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SORTEDDOMAINS_H
+#define SORTEDDOMAINS_H
+#include "dedupdomains.h"
+#include "arena.h"
+#include "domaintree.h"
+#include <stdint.h>
+
+// longest name rebuilt from a key; same limit as prune_DomainTree().
+#define SORTED_FQD_MAX 4096
+
+/**
+ * One domain line of an input file. The key holds the labels of the domain
+ * from the top level down, each preceded by its length, so the key of a parent
+ * domain is a prefix of the keys of its subdomains and sorting the keys places
+ * every subdomain right after its parent.
+ */
+typedef struct SortedDomain
+{
+	char const *key;
+	// first bytes of the key, big endian; most comparisons end here.
+	uint64_t prefix;
+	uint32_t len_key;
+	linenumber_t linenumber;
+	fileindex_t file_index;
+	signed char match_strength;
+} SortedDomain_t;
+
+/**
+ * Flat array of domain lines deduplicated by sorting instead of inserting
+ * into a DomainTree. The keys are allocated from the arena.
+ */
+typedef struct SortedDomains
+{
+	SortedDomain_t *domains;
+	size_t len;
+	size_t alloc;
+	// longest key of the domains; sizes the buffer of fqd_SortedDomain().
+	size_t max_len_key;
+	Arena_t arena;
+} SortedDomains_t;
+
+struct DomainView;
+
+extern void init_SortedDomains(SortedDomains_t *sd);
+extern void free_SortedDomains(SortedDomains_t *sd);
+extern bool append_SortedDomains(SortedDomains_t *sd,
+		struct DomainView const *dv);
+extern void merge_SortedDomains(SortedDomains_t *dest, SortedDomains_t *src);
+extern void sort_SortedDomains(SortedDomains_t *sd, size_t num_threads);
+extern char *fqd_SortedDomain(SortedDomain_t const *d, char *buf,
+		size_t len_buf, size_t *len);
+extern size_t sweep_SortedDomains(SortedDomains_t const *sd,
+		bool(*drop)(char const *fqd, size_t len, void *context),
+		void *drop_context,
+		void(*visit)(SortedDomain_t const *d, InsertOutcome_t outcome,
+			bool kept, void *context),
+		void *context);
+
+#endif
@@ -34,6 +34,22 @@ extern void test_pfb_prune();
 extern void test_rw_pfb_csv();
 extern void test_input_args();
 extern void test_carry_over();
+extern void test_ParsedBatch();
+extern void test_Arena();
+extern void test_LineSpans();
+extern void test_LineBitmap();
+extern void test_OutBuffer();
+extern void test_AsyncLog();
+extern void test_RunStats();
+extern void test_Snapshot();
+extern void test_SortedDomains();
+extern void test_UnboundConf();
+extern void test_ExactSet();
+extern void test_DomainChildren();
+extern void test_TldTable();
+extern void test_LabelHash();
+extern void test_scan();
+extern void test_RegexSet();
 #endif
 
 #endif
@@ -0,0 +1,58 @@
+/**
+ * tldtable.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TLD_TABLE_H
+#define TLD_TABLE_H
+#include <stddef.h>
+#include <stdint.h>
+
+// returned by find_TldTable() for a label that is not a known TLD.
+#define TLD_TABLE_NONE SIZE_MAX
+
+/**
+ * Hash of a label for the perfect hash table of known TLDs. Shared with
+ * gentldtable which searches for the seed and displacements that map every
+ * TLD of etc/tlds.txt to a slot of its own.
+ */
+#define TLD_HASH(label, len, seed, hashv)                                   \
+do {                                                                          \
+	uint32_t _th_h = (seed);                                                  \
+	for(size_t _th_i = 0; _th_i < (size_t)(len); _th_i++)                     \
+	{                                                                         \
+		_th_h = (_th_h ^ (unsigned char)(label)[_th_i]) * 0x01000193u;        \
+	}                                                                         \
+	_th_h ^= _th_h >> 15;                                                     \
+	_th_h *= 0x2c1b3c6du;                                                     \
+	_th_h ^= _th_h >> 12;                                                     \
+	(hashv) = _th_h;                                                          \
+} while(0)
+
+/**
+ * Slot of the hash within a table of 2^slot_bits slots; the top 'bucket_bits'
+ * of the hash pick the displacement.
+ */
+#define TLD_SLOT(hashv, displacements, bucket_bits, slot_bits)              \
+	(((hashv) ^ (displacements)[(hashv) >> (32 - (bucket_bits))]) &          \
+	 ((1u << (slot_bits)) - 1))
+
+extern size_t find_TldTable(char const *label, size_t len);
+extern size_t slots_TldTable();
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * unbound.h
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UNBOUND_H
+#define UNBOUND_H
+#include "dedupdomains.h"
+#include "matchstrength.h"
+#include "outbuffer.h"
+
+/**
+ * Unbound configuration written straight from the consolidated domains so it
+ * need not be generated from the pruned CSV files. FULL matches become
+ * 'local-zone' entries blocking the domain and all of its subdomains; other
+ * matches become 'local-data' entries for the exact name only.
+ */
+typedef struct UnboundConf
+{
+	FILE *file;
+	OutBuffer_t out;
+	// file renamed to the requested name once complete; NULL when the
+	// caller owns 'file'.
+	char *tmp_fname;
+	char const *fname;
+
+	// address the blocked names resolve to. FULL matches are answered with
+	// NXDOMAIN unless one was given.
+	char const *sinkhole;
+	bool redirect;
+	// "A" or "AAAA" depending on the sinkhole.
+	char const *rr_type;
+
+	// counts of entries written for diagnostics.
+	size_t zones;
+	size_t records;
+	int err;
+} UnboundConf_t;
+
+extern void init_UnboundConf(UnboundConf_t *uc, FILE *file,
+		char const *sinkhole);
+extern bool open_UnboundConf(UnboundConf_t *uc, char const *fname,
+		char const *sinkhole);
+extern void append_UnboundConf(UnboundConf_t *uc, char const *fqd, size_t len,
+		MatchStrength_t ms);
+extern bool close_UnboundConf(UnboundConf_t *uc);
+extern bool valid_sinkhole(char const *sinkhole);
+
+#endif
@@ -0,0 +1,281 @@
+/**
+ * arena.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "arena.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// large enough that millions of nodes come from a few hundred slabs.
+static const size_t ARENA_SLAB_SIZE = 1024 * 1024;
+static const size_t ARENA_ALIGN = _Alignof(max_align_t);
+
+typedef struct ArenaSlab
+{
+	struct ArenaSlab *next;
+	size_t used;
+	size_t size;
+	max_align_t data[];
+} ArenaSlab_t;
+
+void init_Arena(Arena_t *arena)
+{
+	ASSERT(arena);
+
+	arena->slabs = NULL;
+	arena->len_slabs = 0;
+	arena->used = 0;
+}
+
+void free_Arena(Arena_t *arena)
+{
+	ASSERT(arena);
+
+	ArenaSlab_t *slab = arena->slabs;
+	while(slab)
+	{
+		ArenaSlab_t *next = slab->next;
+		free(slab);
+		slab = next;
+	}
+
+	init_Arena(arena);
+}
+
+/**
+ * Add a slab with room for at least 'size' bytes. Requests larger than a slab
+ * get a slab of their own placed behind the current one so the remainder of the
+ * current slab is not wasted.
+ */
+static ArenaSlab_t *add_slab(Arena_t *arena, size_t size)
+{
+	const bool oversized = size > ARENA_SLAB_SIZE;
+	const size_t slab_size = oversized ? size : ARENA_SLAB_SIZE;
+
+	ArenaSlab_t *slab = malloc(sizeof(ArenaSlab_t) + slab_size);
+	if(!slab)
+	{
+		ELOG_STDERR("ERROR: failed to allocate %lu bytes for arena\n",
+				(unsigned long)slab_size);
+		exit(EXIT_FAILURE);
+	}
+
+	slab->used = 0;
+	slab->size = slab_size;
+
+	if(oversized && arena->slabs)
+	{
+		slab->next = arena->slabs->next;
+		arena->slabs->next = slab;
+	}
+	else
+	{
+		slab->next = arena->slabs;
+		arena->slabs = slab;
+	}
+	arena->len_slabs++;
+
+	return slab;
+}
+
+static void *bump(Arena_t *arena, size_t size, size_t align)
+{
+	ASSERT(arena);
+
+	ArenaSlab_t *slab = arena->slabs;
+	size_t offset = 0;
+
+	if(slab)
+	{
+		offset = (slab->used + align - 1) & ~(align - 1);
+	}
+
+	if(!slab || offset + size > slab->size)
+	{
+		slab = add_slab(arena, size);
+		offset = 0;
+	}
+
+	slab->used = offset + size;
+	arena->used += size;
+
+	return (char*)slab->data + offset;
+}
+
+/**
+ * Returns memory suitably aligned for any type. Never returns NULL.
+ */
+void *alloc_Arena(Arena_t *arena, size_t size)
+{
+	return bump(arena, size, ARENA_ALIGN);
+}
+
+void *calloc_Arena(Arena_t *arena, size_t size)
+{
+	void *p = alloc_Arena(arena, size);
+	memset(p, 0, size);
+	return p;
+}
+
+/**
+ * Returns unaligned memory for bytes filled in by the caller. Never returns
+ * NULL.
+ */
+char *bytes_Arena(Arena_t *arena, size_t len)
+{
+	return bump(arena, len, 1);
+}
+
+/**
+ * Returns an unaligned copy of the given bytes. Not null terminated.
+ */
+char *copy_Arena(Arena_t *arena, char const *src, size_t len)
+{
+	char *dest = bytes_Arena(arena, len);
+	memcpy(dest, src, len);
+	return dest;
+}
+
+/**
+ * Move all memory held by 'src' into 'dest'. Allocations made from 'src'
+ * remain valid and are released by free_Arena() on 'dest'. 'src' is empty
+ * afterwards.
+ */
+void merge_Arena(Arena_t *dest, Arena_t *src)
+{
+	ASSERT(dest);
+	ASSERT(src);
+
+	if(!src->slabs)
+	{
+		return;
+	}
+
+	if(!dest->slabs)
+	{
+		*dest = *src;
+		init_Arena(src);
+		return;
+	}
+
+	// keep the current slab of 'dest' at the head to continue allocating from.
+	ArenaSlab_t *last = src->slabs;
+	while(last->next)
+	{
+		last = last->next;
+	}
+	last->next = dest->slabs->next;
+	dest->slabs->next = src->slabs;
+
+	dest->len_slabs += src->len_slabs;
+	dest->used += src->used;
+
+	init_Arena(src);
+}
+
+#ifdef BUILD_TESTS
+static void test_alloc_Arena()
+{
+	Arena_t arena;
+	init_Arena(&arena);
+	assert(!arena.slabs);
+
+	char *c = copy_Arena(&arena, "abc", 3);
+	assert(!memcmp(c, "abc", 3));
+
+	// unaligned bytes follow without padding
+	char *b = bytes_Arena(&arena, 2);
+	assert(b == c + 3);
+
+	size_t *p = alloc_Arena(&arena, sizeof(size_t) * 4);
+	assert(((uintptr_t)p % ARENA_ALIGN) == 0);
+	p[3] = 42;
+
+	char *z = calloc_Arena(&arena, 100);
+	for(size_t i = 0; i < 100; i++)
+	{
+		assert(z[i] == 0);
+	}
+
+	assert(arena.len_slabs == 1);
+	assert(arena.used == 3 + 2 + sizeof(size_t) * 4 + 100);
+
+	// an oversized request does not replace the current slab
+	ArenaSlab_t *current = arena.slabs;
+	char *big = alloc_Arena(&arena, ARENA_SLAB_SIZE * 2);
+	memset(big, 1, ARENA_SLAB_SIZE * 2);
+	assert(arena.len_slabs == 2);
+	assert(arena.slabs == current);
+
+	// fill the current slab to force a new one
+	for(size_t i = 0; i < ARENA_SLAB_SIZE / 64 + 1; i++)
+	{
+		alloc_Arena(&arena, 64);
+	}
+	assert(arena.len_slabs == 3);
+	assert(arena.slabs != current);
+
+	// prior allocations are untouched
+	assert(!memcmp(c, "abc", 3));
+	assert(p[3] == 42);
+
+	free_Arena(&arena);
+	assert(!arena.slabs);
+	assert(arena.len_slabs == 0);
+	assert(arena.used == 0);
+}
+
+static void test_merge_Arena()
+{
+	Arena_t a, b, empty;
+	init_Arena(&a);
+	init_Arena(&b);
+	init_Arena(&empty);
+
+	char *ca = copy_Arena(&a, "first", 5);
+	char *cb = copy_Arena(&b, "second", 6);
+	alloc_Arena(&b, ARENA_SLAB_SIZE);
+	ArenaSlab_t *current = a.slabs;
+
+	merge_Arena(&a, &b);
+	assert(!b.slabs);
+	assert(b.len_slabs == 0);
+	assert(a.len_slabs == 3);
+	assert(a.slabs == current);
+	assert(!memcmp(ca, "first", 5));
+	assert(!memcmp(cb, "second", 6));
+
+	merge_Arena(&a, &empty);
+	assert(a.len_slabs == 3);
+
+	merge_Arena(&empty, &a);
+	assert(!a.slabs);
+	assert(empty.len_slabs == 3);
+
+	free_Arena(&empty);
+	free_Arena(&a);
+	free_Arena(&b);
+}
+
+void test_Arena()
+{
+	test_alloc_Arena();
+	test_merge_Arena();
+}
+#endif
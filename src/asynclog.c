@@ -0,0 +1,493 @@
+/**
+ * asynclog.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "asynclog.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+// bytes of messages one thread may have queued before it waits on the writer.
+#define LOG_RING_SIZE ((size_t)1 << 16)
+// longer messages are written directly once the thread's queue is empty.
+#define LOG_MESSAGE_MAX 4096
+// how long the writer sleeps when every queue is empty.
+static const long LOG_WRITER_SLEEP_NS = 10 * 1000 * 1000;
+
+/**
+ * Header of each message queued in a LogRing; the message follows.
+ */
+typedef struct LogRecord
+{
+	uint32_t len;
+	uint32_t target;
+} LogRecord_t;
+
+/**
+ * Messages of one thread waiting for the writer. Only the owning thread moves
+ * 'head' and only the writer moves 'tail' so neither takes a lock.
+ */
+typedef struct LogRing
+{
+	char data[LOG_RING_SIZE];
+	_Atomic size_t head;
+	_Atomic size_t tail;
+	struct LogRing *next;
+} LogRing_t;
+
+// every ring handed out since start_AsyncLog(); guarded by 'rings_lock'.
+static LogRing_t *_Atomic rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+// serializes draining by the writer thread and by stop_AsyncLog().
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+
+static atomic_bool running = false;
+static atomic_bool stopping = false;
+static atomic_bool silent = false;
+// bumped by every start_AsyncLog() so threads drop rings of a previous run.
+static atomic_uint generation = 0;
+
+static _Thread_local LogRing_t *local_ring = NULL;
+static _Thread_local uint local_generation = 0;
+
+#ifdef BUILD_TESTS
+// when set, every message is written here instead of the global logs.
+static FILE *test_target = NULL;
+#endif
+
+static FILE *open_target(LogTarget_t target)
+{
+#ifdef BUILD_TESTS
+	if(test_target)
+	{
+		return test_target;
+	}
+#endif
+	if(target == LOG_TARGET_ERR)
+	{
+		open_globalErrLog();
+		return get_globalErrLog();
+	}
+	open_globalStdLog();
+	return get_globalStdLog();
+}
+
+/**
+ * Write the message to its log file right away. The file is kept open.
+ */
+static void write_target(LogTarget_t target, char const *msg, size_t len)
+{
+	lock_globalLogs();
+	FILE *f = open_target(target);
+	fwrite(msg, sizeof(char), len, f);
+	unlock_globalLogs();
+}
+
+static void copy_from_ring(LogRing_t const *ring, size_t pos, void *dest,
+		size_t len)
+{
+	const size_t at = pos % LOG_RING_SIZE;
+	const size_t first = len < LOG_RING_SIZE - at ? len : LOG_RING_SIZE - at;
+	memcpy(dest, ring->data + at, first);
+	memcpy((char*)dest + first, ring->data, len - first);
+}
+
+static void copy_to_ring(LogRing_t *ring, size_t pos, void const *src,
+		size_t len)
+{
+	const size_t at = pos % LOG_RING_SIZE;
+	const size_t first = len < LOG_RING_SIZE - at ? len : LOG_RING_SIZE - at;
+	memcpy(ring->data + at, src, first);
+	memcpy(ring->data, (char const*)src + first, len - first);
+}
+
+/**
+ * Write out every queued message. Returns the number of messages written.
+ */
+static size_t drain_rings()
+{
+	char msg[LOG_MESSAGE_MAX];
+	size_t count = 0;
+	bool wrote[2] = {false, false};
+
+	pthread_mutex_lock(&drain_lock);
+	lock_globalLogs();
+
+	for(LogRing_t *ring = atomic_load(&rings); ring; ring = ring->next)
+	{
+		const size_t head = atomic_load_explicit(&ring->head,
+				memory_order_acquire);
+		size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+		while(tail != head)
+		{
+			LogRecord_t rec;
+			copy_from_ring(ring, tail, &rec, sizeof(LogRecord_t));
+			copy_from_ring(ring, tail + sizeof(LogRecord_t), msg, rec.len);
+			fwrite(msg, sizeof(char), rec.len, open_target(rec.target));
+			wrote[rec.target] = true;
+			tail += sizeof(LogRecord_t) + rec.len;
+			count++;
+		}
+
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	}
+
+	// the files stay open; make the messages visible to readers of the logs.
+	for(size_t t = 0; t < 2; t++)
+	{
+		if(wrote[t])
+		{
+			fflush(open_target(t));
+		}
+	}
+
+	unlock_globalLogs();
+	pthread_mutex_unlock(&drain_lock);
+
+	return count;
+}
+
+static void *writer_thread(void *arg)
+{
+	UNUSED(arg);
+
+	while(!atomic_load(&stopping))
+	{
+		if(drain_rings())
+		{
+			continue;
+		}
+
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_WRITER_SLEEP_NS;
+		if(ts.tv_nsec >= 1000000000L)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+
+		pthread_mutex_lock(&writer_lock);
+		if(!atomic_load(&stopping))
+		{
+			pthread_cond_timedwait(&writer_cond, &writer_lock, &ts);
+		}
+		pthread_mutex_unlock(&writer_lock);
+	}
+
+	drain_rings();
+
+	return NULL;
+}
+
+static void wake_writer()
+{
+	pthread_mutex_lock(&writer_lock);
+	pthread_cond_signal(&writer_cond);
+	pthread_mutex_unlock(&writer_lock);
+}
+
+/**
+ * The ring of the calling thread; created on the first message of the thread.
+ */
+static LogRing_t *get_ring()
+{
+	const uint gen = atomic_load(&generation);
+	if(local_ring && local_generation == gen)
+	{
+		return local_ring;
+	}
+
+	LogRing_t *ring = malloc(sizeof(LogRing_t));
+	if(!ring)
+	{
+		return NULL;
+	}
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+
+	pthread_mutex_lock(&rings_lock);
+	ring->next = atomic_load(&rings);
+	atomic_store(&rings, ring);
+	pthread_mutex_unlock(&rings_lock);
+
+	local_ring = ring;
+	local_generation = gen;
+	return ring;
+}
+
+/**
+ * Wait until the ring has room for 'need' more bytes.
+ */
+static void wait_for_room(LogRing_t *ring, size_t need)
+{
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	while(head - atomic_load_explicit(&ring->tail, memory_order_acquire) +
+			need > LOG_RING_SIZE)
+	{
+		wake_writer();
+		sched_yield();
+	}
+}
+
+static void atexit_AsyncLog()
+{
+	stop_AsyncLog();
+}
+
+/**
+ * Start the background writer. Until stop_AsyncLog() messages are queued by
+ * the calling thread and written by the writer; otherwise they are written
+ * right away.
+ */
+void start_AsyncLog()
+{
+	static bool registered = false;
+
+	if(atomic_load(&running))
+	{
+		return;
+	}
+
+	if(!registered)
+	{
+		// messages logged right before exit() are not lost.
+		atexit(atexit_AsyncLog);
+		registered = true;
+	}
+
+	atomic_fetch_add(&generation, 1);
+	atomic_store(&stopping, false);
+	if(pthread_create(&writer, NULL, writer_thread, NULL))
+	{
+		fprintf(stderr, "ERROR: failed to create log writer thread.\n");
+		return;
+	}
+	atomic_store(&running, true);
+}
+
+/**
+ * Write every queued message and stop the background writer. Call once the
+ * threads that log are done. Safe to call when it is not running.
+ */
+void stop_AsyncLog()
+{
+	if(!atomic_exchange(&running, false))
+	{
+		return;
+	}
+
+	atomic_store(&stopping, true);
+	wake_writer();
+	pthread_join(writer, NULL);
+
+	pthread_mutex_lock(&rings_lock);
+	LogRing_t *ring = atomic_exchange(&rings, NULL);
+	pthread_mutex_unlock(&rings_lock);
+
+	while(ring)
+	{
+		LogRing_t *next = ring->next;
+		free(ring);
+		ring = next;
+	}
+}
+
+/**
+ * When silent, messages bound for the standard log are dropped before they are
+ * formatted. Errors are always logged.
+ */
+void set_silent_AsyncLog(bool v)
+{
+	atomic_store(&silent, v);
+}
+
+bool silent_AsyncLog()
+{
+	return atomic_load_explicit(&silent, memory_order_relaxed);
+}
+
+/**
+ * Format and log a message. Safe to call from any thread.
+ */
+void write_AsyncLog(LogTarget_t target, char const *fmt, ...)
+{
+	if(target == LOG_TARGET_STD && silent_AsyncLog())
+	{
+		return;
+	}
+
+	char msg[LOG_MESSAGE_MAX];
+	va_list args;
+	va_start(args, fmt);
+	const int n = vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+
+	if(n <= 0)
+	{
+		return;
+	}
+
+	LogRing_t *ring = atomic_load(&running) ? get_ring() : NULL;
+
+	if(!ring || (size_t)n >= sizeof(msg))
+	{
+		char *long_msg = msg;
+		if((size_t)n >= sizeof(msg))
+		{
+			long_msg = malloc(n + 1);
+			if(!long_msg)
+			{
+				return;
+			}
+			va_start(args, fmt);
+			vsnprintf(long_msg, n + 1, fmt, args);
+			va_end(args);
+		}
+
+		// keep the order of the messages of this thread.
+		if(ring)
+		{
+			wait_for_room(ring, LOG_RING_SIZE);
+		}
+		write_target(target, long_msg, n);
+
+		if(long_msg != msg)
+		{
+			free(long_msg);
+		}
+		return;
+	}
+
+	const size_t need = sizeof(LogRecord_t) + n;
+	wait_for_room(ring, need);
+
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	LogRecord_t rec = { .len = n, .target = target };
+	copy_to_ring(ring, head, &rec, sizeof(LogRecord_t));
+	copy_to_ring(ring, head + sizeof(LogRecord_t), msg, n);
+	atomic_store_explicit(&ring->head, head + need, memory_order_release);
+}
+
+#ifdef BUILD_TESTS
+#define TEST_LOG_THREADS 4
+// enough messages per thread to fill its ring several times.
+#define TEST_LOG_MESSAGES 5000
+
+static void *test_log_thread(void *arg)
+{
+	const size_t t = (size_t)(uintptr_t)arg;
+	for(size_t i = 0; i < TEST_LOG_MESSAGES; i++)
+	{
+		ELOG_STDERR("thread %lu message %lu %s\n", t, i,
+				"padding to fill the ring sooner");
+	}
+	return NULL;
+}
+
+void test_AsyncLog()
+{
+	// main() may have started the writer already.
+	const bool was_running = atomic_load(&running);
+	stop_AsyncLog();
+
+	FILE *f = tmpfile();
+	assert(f);
+	test_target = f;
+
+	// written right away while not running
+	ELOG_STDERR("thread %d message %d\n", TEST_LOG_THREADS, 0);
+
+	start_AsyncLog();
+	start_AsyncLog();
+
+	pthread_t threads[TEST_LOG_THREADS];
+	for(size_t t = 0; t < TEST_LOG_THREADS; t++)
+	{
+		assert(!pthread_create(&threads[t], NULL, test_log_thread,
+					(void*)(uintptr_t)t));
+	}
+	for(size_t t = 0; t < TEST_LOG_THREADS; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+
+	// one longer than a queued message is written in order as well.
+	char *long_msg = malloc(LOG_MESSAGE_MAX * 2);
+	memset(long_msg, 'x', LOG_MESSAGE_MAX * 2 - 1);
+	long_msg[LOG_MESSAGE_MAX * 2 - 1] = '\0';
+	ELOG_STDERR("thread %d message %d\n", TEST_LOG_THREADS, 1);
+	ELOG_STDERR("%s\n", long_msg);
+	ELOG_STDERR("thread %d message %d\n", TEST_LOG_THREADS, 2);
+
+	// dropped before formatting when silent; errors are not.
+	set_silent_AsyncLog(true);
+	LOG_STR("%s\n", "dropped");
+	set_silent_AsyncLog(false);
+
+	stop_AsyncLog();
+	stop_AsyncLog();
+	test_target = NULL;
+
+	// every message of a thread is found in the order it was logged.
+	size_t next[TEST_LOG_THREADS + 1] = {0};
+	size_t longs = 0;
+	char *line = malloc(LOG_MESSAGE_MAX * 2 + 1);
+	rewind(f);
+	while(fgets(line, LOG_MESSAGE_MAX * 2 + 1, f))
+	{
+		size_t t, i;
+		if(line[0] == 'x')
+		{
+			assert(strlen(line) == LOG_MESSAGE_MAX * 2);
+			assert(next[TEST_LOG_THREADS] == 2);
+			longs++;
+			continue;
+		}
+		assert(sscanf(line, "thread %lu message %lu", &t, &i) == 2);
+		assert(t <= TEST_LOG_THREADS);
+		assert(i == next[t]);
+		next[t]++;
+	}
+
+	assert(longs == 1);
+	for(size_t t = 0; t < TEST_LOG_THREADS; t++)
+	{
+		assert(next[t] == TEST_LOG_MESSAGES);
+	}
+	assert(next[TEST_LOG_THREADS] == 3);
+
+	free(line);
+	free(long_msg);
+	fclose(f);
+
+	if(was_running)
+	{
+		start_AsyncLog();
+	}
+}
+#endif
@@ -1,4 +1,5 @@
 #include "carry_over.h"
+#include "linebitmap.h"
 
 /**
  * Increase the array of linenumber_t by one.
@@ -49,24 +50,21 @@ void free_carry_over(carry_over_t *co)
 }
 
 /**
- * Move the contents of the internal array of linenumber_t to the given array of
- * linenumber_t. This will free the internal array of the given carry_over_t.
+ * Mark every line number of the internal array as kept in the given
+ * LineBitmap_t. This will free the internal array of the given carry_over_t.
  */
-void transfer_linenumbers(linenumber_t *dest_linenumbers, carry_over_t *co)
+void transfer_carry_over(LineBitmap_t *kept, carry_over_t *co)
 {
-	ASSERT(dest_linenumbers);
+	ASSERT(kept);
 	ASSERT(co);
-	linenumber_t count = len_carry_over(co);
+	const linenumber_t count = len_carry_over(co);
 
-	if(count == 0)
+	// first element value is at [1]. the length/size of array is at [0].
+	for(linenumber_t i = 1; i <= count; i++)
 	{
-		// gracefully handle a bogus request
-		return;
+		set_LineBitmap(kept, co->linenumbers[i]);
 	}
 
-	memmove(dest_linenumbers, co->linenumbers + 1,
-			sizeof(linenumber_t) * len_carry_over(co));
-
 	free_carry_over(co);
 }
 
@@ -177,19 +175,22 @@ void test_transfer()
 
 	const linenumber_t count = len_carry_over(&co);
 	assert(count == 5);
-	linenumber_t *xfered = calloc(count, sizeof(linenumber_t));
-	transfer_linenumbers(xfered, &co);
-
-	free_carry_over(&co);
+	LineBitmap_t xfered;
+	init_LineBitmap(&xfered);
+	set_LineBitmap(&xfered, 202);
+	transfer_carry_over(&xfered, &co);
 
 	assert(len_carry_over(&co) == 0);
+	assert(xfered.count == count);
 
+	linenumber_t ln = 0;
 	for(size_t i = 0; i < count; i++)
 	{
-		assert(xfered[i] == ((i + 1) * 101));
+		ln = next_LineBitmap(&xfered, ln);
+		assert(ln == ((i + 1) * 101));
 	}
 
-	free(xfered);
+	free_LineBitmap(&xfered);
 }
 
 void test_carry_over()
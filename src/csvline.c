@@ -21,6 +21,7 @@
 #include "dedupdomains.h"
 #include <stdio.h>
 #include "csvline.h"
+#include "scan.h"
 
 static const char CSV_DELIMITER = ',';
 static const char CSV_INIT_ALLOC_COLS = 7;
@@ -191,20 +192,21 @@ static void set_CsvLineView(CsvLineView_t *const lv, char const *begin, char con
 }
 
 /**
- * Parses a given null-terminated string and modifies a given initialized
- * CsvLineView accordingly. The input string must remain valid and unmodified
- * for the lifetime of the given CsvLineView or until this is called again with
- * a different null-terminated string.
+ * Parses a given string of 'len' characters and modifies a given initialized
+ * CsvLineView accordingly. The string need not be null-terminated; parsing
+ * stops at 'len' characters or a null terminator, whichever is first. The
+ * input string must remain valid and unmodified for the lifetime of the given
+ * CsvLineView or until this is called again with a different string.
  *
  * After this call, all existing CsvColView's are invalid and must not be used
  * other than to discard, e.g., memset(cv, 0, sizeof(CsvLineView)); is safe.
  */
-bool update_CsvLineView(CsvLineView_t *lv, char const *input_line)
+bool update_CsvLineView(CsvLineView_t *lv, char const *input_line, size_t len)
 {
-	char const *c, *prev;
+	char const *c, *prev, *end;
 	ASSERT(lv);
 
-	if(input_line == NULL || *input_line == '\0')
+	if(input_line == NULL || len == 0 || *input_line == '\0')
 	{
 		return false;
 	}
@@ -212,20 +214,20 @@ bool update_CsvLineView(CsvLineView_t *lv, char const *input_line)
 	lv->cols_used = 0;
 
 	prev = c = input_line;
+	end = input_line + len;
 
-	while(*c)
+	for(;;)
 	{
-		if( *c == CSV_DELIMITER )
+		c = scan_delimiter(c, end);
+		if(c == end || *c != CSV_DELIMITER)
 		{
-			set_CsvLineView(lv, prev, c);
-
-			c++;
-			prev = c;
-		}
-		else
-		{
-			c++;
+			break;
 		}
+
+		set_CsvLineView(lv, prev, c);
+
+		c++;
+		prev = c;
 	}
 
 	set_CsvLineView(lv, prev, c);
@@ -233,6 +235,69 @@ bool update_CsvLineView(CsvLineView_t *lv, char const *input_line)
 	return true;
 }
 
+/**
+ * Locates only the requested columns of a line of 'len' characters in a single
+ * forward scan. 'idxs' holds 'count' column indexes in ascending order and the
+ * view of each is stored at the same position in 'cols'. Scanning stops after
+ * the last requested column; the rest of the line is not looked at. A column
+ * beyond the end of the line is given a view with NULL data and zero length,
+ * the same as an empty column from get_CsvColView().
+ *
+ * Like update_CsvLineView(), parsing stops at a null terminator. Returns the
+ * number of columns scanned which is at most the last requested index + 1.
+ */
+size_len_t extract_CsvCols(char const *input_line, size_t len,
+		size_len_t const *idxs, size_len_t count, CsvColView_t *cols)
+{
+	ASSERT(idxs);
+	ASSERT(cols);
+
+	for(size_len_t i = 0; i < count; i++)
+	{
+		ASSERT(i == 0 || idxs[i - 1] < idxs[i]);
+		cols[i].idx = idxs[i];
+		cols[i].data = NULL;
+		cols[i].len = 0;
+	}
+
+	if(input_line == NULL || len == 0 || *input_line == '\0' || count == 0)
+	{
+		return 0;
+	}
+
+	char const *c = input_line;
+	char const *prev = c;
+	char const *const end = input_line + len;
+	size_len_t col = 0;
+	size_len_t want = 0;
+
+	for(;;)
+	{
+		c = scan_delimiter(c, end);
+
+		if(col == idxs[want])
+		{
+			if(c != prev)
+			{
+				cols[want].data = prev;
+				cols[want].len = c - prev;
+			}
+			want++;
+		}
+		col++;
+
+		if(want == count || c == end || *c != CSV_DELIMITER)
+		{
+			break;
+		}
+
+		c++;
+		prev = c;
+	}
+
+	return col;
+}
+
 #ifdef BUILD_TESTS
 /**
  * For unit tests only.
@@ -243,7 +308,7 @@ static CsvLineView_t parse_CsvLine(char const *input_line)
 
 	init_CsvLineView(&lv);
 
-	update_CsvLineView(&lv, input_line);
+	update_CsvLineView(&lv, input_line, strlen(input_line));
 
 	return lv;
 }
@@ -378,17 +443,17 @@ static void test_update_CsvLine()
 	const char *input_empty = "";
 	const char *expected;
 
-	assert(!update_CsvLineView(&lv, input_empty));
-	assert(!update_CsvLineView(&lv, input_nil));
+	assert(!update_CsvLineView(&lv, input_empty, 0));
+	assert(!update_CsvLineView(&lv, input_nil, 0));
 
-	assert(update_CsvLineView(&lv, input_1));
+	assert(update_CsvLineView(&lv, input_1, strlen(input_1)));
 
 	assert(lv.cols_used == 6);
 	assert(lv.cols_alloc >= 6);
 	assert(lv.data);
 	assert(lv.lengths);
 
-	assert(update_CsvLineView(&lv, input_2));
+	assert(update_CsvLineView(&lv, input_2, strlen(input_2)));
 
 	assert(lv.cols_used == 3);
 	// fewer used columns does not realloc to a smaller number
@@ -401,7 +466,7 @@ static void test_update_CsvLine()
 	ASSERT_COL_VALUE(2, "Col C");
 
 
-	assert(update_CsvLineView(&lv, input_3));
+	assert(update_CsvLineView(&lv, input_3, strlen(input_3)));
 
 	assert(lv.cols_used == 10);
 	// fewer used columns does not realloc to a smaller number
@@ -420,6 +485,14 @@ static void test_update_CsvLine()
 	ASSERT_COL_VALUE(8, "Col 8");
 	ASSERT_COL_VALUE(9, "Col 9");
 
+	// not null terminated: only the given length is parsed
+	assert(update_CsvLineView(&lv, input_3, strlen("Col 0,Col 1,Col")));
+
+	assert(lv.cols_used == 3);
+	ASSERT_COL_VALUE(0, "Col 0");
+	ASSERT_COL_VALUE(1, "Col 1");
+	ASSERT_COL_VALUE(2, "Col");
+
 	free_CsvLineView(&lv);
 }
 
@@ -463,6 +536,53 @@ void info_csvline()
 	printf("Sizeof CsvColView: %lu\n", sizeof(CsvColView_t));
 }
 
+/**
+ * The requested columns match the columns of a full split.
+ */
+static void test_extract_CsvCols()
+{
+	const size_len_t idxs[] = {1, 6};
+	CsvColView_t cols[2];
+
+	char const *line = "DNSBL_Test,www.example.com,,,,,1,extra,columns";
+	CsvLineView_t lv = parse_CsvLine(line);
+
+	assert(extract_CsvCols(line, strlen(line), idxs, 2, cols) == 7);
+	for(size_t i = 0; i < 2; i++)
+	{
+		const CsvColView_t cv = get_CsvColView(&lv, idxs[i]);
+		assert(cols[i].idx == idxs[i]);
+		assert(cols[i].len == cv.len);
+		assert(cols[i].data == cv.data);
+	}
+	free_CsvLineView(&lv);
+
+	// fewer columns than requested
+	line = "first,second,third";
+	assert(extract_CsvCols(line, strlen(line), idxs, 2, cols) == 3);
+	assert(cols[0].len == 6);
+	assert(!memcmp(cols[0].data, "second", 6));
+	assert(!cols[1].data);
+	assert(cols[1].len == 0);
+
+	// empty requested column
+	line = "a,,b";
+	assert(extract_CsvCols(line, strlen(line), idxs, 1, cols) == 2);
+	assert(!cols[0].data);
+	assert(cols[0].len == 0);
+
+	// stops at the given length and at a null terminator
+	line = "a,bcd,e";
+	assert(extract_CsvCols(line, 4, idxs, 1, cols) == 2);
+	assert(cols[0].len == 2);
+	assert(extract_CsvCols("a,b\0,c,d,e,f,g", 15, idxs, 2, cols) == 2);
+	assert(cols[0].len == 1);
+	assert(!cols[1].data);
+
+	assert(extract_CsvCols(NULL, 0, idxs, 2, cols) == 0);
+	assert(extract_CsvCols("", 0, idxs, 2, cols) == 0);
+}
+
 void test_csvline()
 {
 	test_null_CsvLine();
@@ -471,5 +591,6 @@ void test_csvline()
 	test_parse_CsvLine();
 	test_update_CsvLine();
 	test_get_CsvColView();
+	test_extract_CsvCols();
 }
 #endif
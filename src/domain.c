@@ -20,6 +20,7 @@
  */
 #include "dedupdomains.h"
 #include "domain.h"
+#include "labelhash.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +43,7 @@ void init_DomainView(DomainView_t *dv)
 	dv->len = 0;
 	dv->segs_used = 0;
 	dv->linenumber = 0;
+	dv->file_index = 0;
 #ifdef COLLECT_DIAGNOSTICS
 	dv->max_used = 0;
 	dv->count_realloc = 0;
@@ -67,6 +69,12 @@ void init_DomainView(DomainView_t *dv)
 	{
 		exit(EXIT_FAILURE);
 	}
+
+	dv->hashes = malloc(sizeof(uint32_t) * DOMAIN_INIT_ALLOC);
+	if(!dv->hashes)
+	{
+		exit(EXIT_FAILURE);
+	}
 }
 
 void free_DomainView(DomainView_t *dv)
@@ -74,6 +82,7 @@ void free_DomainView(DomainView_t *dv)
 	ASSERT(dv);
 	free(dv->lengths);
 	free(dv->label_indexes);
+	free(dv->hashes);
 
 #ifdef COLLECT_DIAGNOSTICS
 	if(dv->count_realloc > 0)
@@ -102,6 +111,7 @@ void free_DomainView(DomainView_t *dv)
 	dv->len = 0;
 	dv->label_indexes = NULL;
 	dv->lengths = NULL;
+	dv->hashes = NULL;
 	dv->segs_alloc = 0;
 	dv->segs_used = 0;
 #ifdef COLLECT_DIAGNOSTICS
@@ -140,6 +150,7 @@ static bool get_SubdomainView(DomainView_t *dv, size_len_t idx,
 
 	sdv->data = dv->fqd + dv->label_indexes[idx];
 	sdv->len = dv->lengths[idx];
+	sdv->hash = dv->hashes[idx];
 
 	return true;
 }
@@ -208,6 +219,17 @@ static void realloc_labels(DomainView_t *dv, size_len_t count)
 		free(dv->lengths);
 		exit(EXIT_FAILURE);
 	}
+	uint32_t *tmpH = realloc(dv->hashes, sizeof(uint32_t) * dv->segs_alloc);
+	if(tmpH)
+	{
+		dv->hashes = tmpH;
+		tmpH = NULL;
+	}
+	else
+	{
+		free(dv->hashes);
+		exit(EXIT_FAILURE);
+	}
 #ifdef COLLECT_DIAGNOSTICS
 	dv->count_realloc++;
 #endif
@@ -286,6 +308,8 @@ bool update_DomainView(DomainView_t *dv, char const *fqd, size_len_t len)
 				}
 			}
 			dv->lengths[dv->segs_used] = prev - c;
+			// hashed as soon as it ends while its bytes are still in cache.
+			dv->hashes[dv->segs_used] = hash_Label(c + 1, prev - c);
 			dv->segs_used++;
 
 			// move behind the '.'
@@ -308,6 +332,7 @@ bool update_DomainView(DomainView_t *dv, char const *fqd, size_len_t len)
 
 	dv->label_indexes[dv->segs_used] = 0;
 	dv->lengths[dv->segs_used] = prev - c + 1; // off by one
+	dv->hashes[dv->segs_used] = hash_Label(begin, prev - c + 1);
 	dv->segs_used++;
 #ifdef COLLECT_DIAGNOSTICS
 	if(dv->segs_used > dv->max_used)
@@ -477,7 +502,8 @@ static void test_DomainIter(DomainView_t *dv, size_len_t segments,
 	assert(!null_SubdomainView(&sdv)); \
 	assert(it.cur_seg == (idx + 1)); \
 	assert(sdv.len == strlen(values[idx])); \
-	assert(!memcmp(sdv.data, values[idx], strlen(values[idx])))
+	assert(!memcmp(sdv.data, values[idx], strlen(values[idx]))); \
+	assert(sdv.hash == hash_Label(values[idx], strlen(values[idx])))
 	for(size_len_t i = 0; i < segments; i++)
 	{
 		ASSERT_NEXT(i);
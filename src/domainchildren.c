@@ -0,0 +1,430 @@
+/**
+ * domainchildren.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "domainchildren.h"
+#include "domaintree.h"
+#include "labelhash.h"
+
+// first sorted array when the children no longer fit in place.
+static const uint32_t INITIAL_SORTED_ENTRIES = 2 * DOMAIN_CHILDREN_INLINE;
+// slots of the table promoted from a full sorted array.
+static const uint32_t INITIAL_TABLE_SLOTS = 2 * DOMAIN_CHILDREN_SORTED_MAX;
+
+static bool is_table(DomainChildren_t const *dc)
+{
+	return dc->alloc > DOMAIN_CHILDREN_SORTED_MAX;
+}
+
+/**
+ * The hashes on the heap follow the 'alloc' nodes.
+ */
+static uint32_t *heap_hashes(struct DomainTree *const *heap, uint32_t alloc)
+{
+	return (uint32_t*)(heap + alloc);
+}
+
+static bool same_label(struct DomainTree const *node, char const *label,
+		size_t len)
+{
+	return node->len == len && !memcmp(node->tld, label, len);
+}
+
+static struct DomainTree **alloc_heap(uint32_t alloc)
+{
+	struct DomainTree **heap = calloc(alloc,
+			sizeof(struct DomainTree*) + sizeof(uint32_t));
+	if(!heap)
+	{
+		ELOG_STDERR("ERROR: failed to allocate DomainChildren\n");
+		exit(EXIT_FAILURE);
+	}
+	return heap;
+}
+
+/**
+ * Returns the index of the first child of the sorted array with a hash not
+ * less than the given one.
+ */
+static uint32_t lower_bound(uint32_t const *hashes, uint32_t len,
+		uint32_t hash)
+{
+	uint32_t lo = 0, hi = len;
+	while(lo < hi)
+	{
+		const uint32_t mid = lo + (hi - lo) / 2;
+		if(hashes[mid] < hash)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * Returns the slot of the label in the table or the empty slot it belongs in.
+ */
+static uint32_t find_slot(struct DomainTree *const *heap, uint32_t alloc,
+		uint32_t hash, char const *label, size_t len)
+{
+	uint32_t const *hashes = heap_hashes(heap, alloc);
+	const uint32_t mask = alloc - 1;
+	for(uint32_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		if(!hashes[i] || (hashes[i] == hash && same_label(heap[i], label, len)))
+		{
+			return i;
+		}
+	}
+}
+
+/**
+ * Returns the child with the given first label or NULL. 'hash' is
+ * hash_Label() of the label.
+ */
+struct DomainTree *find_DomainChildren(DomainChildren_t const *dc,
+		uint32_t hash, char const *label, size_t len)
+{
+	ASSERT(dc);
+	ASSERT(hash);
+
+	if(dc->alloc == 0)
+	{
+		for(uint32_t i = 0; i < dc->len; i++)
+		{
+			if(dc->hashes[i] == hash && same_label(dc->nodes[i], label, len))
+			{
+				return dc->nodes[i];
+			}
+		}
+		return NULL;
+	}
+
+	uint32_t const *hashes = heap_hashes(dc->heap, dc->alloc);
+	if(!is_table(dc))
+	{
+		for(uint32_t i = lower_bound(hashes, dc->len, hash);
+				i < dc->len && hashes[i] == hash; i++)
+		{
+			if(same_label(dc->heap[i], label, len))
+			{
+				return dc->heap[i];
+			}
+		}
+		return NULL;
+	}
+
+	const uint32_t i = find_slot(dc->heap, dc->alloc, hash, label, len);
+	return hashes[i] ? dc->heap[i] : NULL;
+}
+
+/**
+ * Move the children to a sorted array of the given size.
+ */
+static void resize_sorted(DomainChildren_t *dc, uint32_t alloc)
+{
+	ASSERT(dc->len <= alloc);
+
+	struct DomainTree **heap = alloc_heap(alloc);
+	uint32_t *hashes = heap_hashes(heap, alloc);
+
+	if(dc->alloc == 0)
+	{
+		// insertion sort of the few held in place.
+		for(uint32_t i = 0; i < dc->len; i++)
+		{
+			uint32_t j = i;
+			for(; j > 0 && hashes[j - 1] > dc->hashes[i]; j--)
+			{
+				heap[j] = heap[j - 1];
+				hashes[j] = hashes[j - 1];
+			}
+			heap[j] = dc->nodes[i];
+			hashes[j] = dc->hashes[i];
+		}
+	}
+	else
+	{
+		memcpy(heap, dc->heap, sizeof(struct DomainTree*) * dc->len);
+		memcpy(hashes, heap_hashes(dc->heap, dc->alloc),
+				sizeof(uint32_t) * dc->len);
+		free(dc->heap);
+	}
+
+	dc->heap = heap;
+	dc->alloc = alloc;
+}
+
+/**
+ * Rehash the sorted array or the table into a table of the given number of
+ * slots.
+ */
+static void rehash_table(DomainChildren_t *dc, uint32_t alloc)
+{
+	struct DomainTree **heap = alloc_heap(alloc);
+	uint32_t *hashes = heap_hashes(heap, alloc);
+
+	uint32_t const *old_hashes = heap_hashes(dc->heap, dc->alloc);
+	const uint32_t len_old = is_table(dc) ? dc->alloc : dc->len;
+	for(uint32_t i = 0; i < len_old; i++)
+	{
+		if(old_hashes[i])
+		{
+			struct DomainTree *node = dc->heap[i];
+			const uint32_t slot = find_slot(heap, alloc, old_hashes[i],
+					node->tld, node->len);
+			heap[slot] = node;
+			hashes[slot] = old_hashes[i];
+		}
+	}
+
+	free(dc->heap);
+	dc->heap = heap;
+	dc->alloc = alloc;
+}
+
+/**
+ * Add the given node under its first label. The label must not be held yet.
+ */
+void add_DomainChildren(DomainChildren_t *dc, uint32_t hash,
+		struct DomainTree *node)
+{
+	ASSERT(dc);
+	ASSERT(node);
+	ASSERT(hash);
+#ifndef NDEBUG
+	ASSERT(!find_DomainChildren(dc, hash, node->tld, node->len));
+#endif
+
+	if(dc->alloc == 0)
+	{
+		if(dc->len < DOMAIN_CHILDREN_INLINE)
+		{
+			dc->nodes[dc->len] = node;
+			dc->hashes[dc->len] = hash;
+			dc->len++;
+			return;
+		}
+		resize_sorted(dc, INITIAL_SORTED_ENTRIES);
+	}
+
+	if(!is_table(dc) && dc->len == dc->alloc)
+	{
+		if(dc->alloc < DOMAIN_CHILDREN_SORTED_MAX)
+		{
+			resize_sorted(dc, dc->alloc * 2);
+		}
+		else
+		{
+			rehash_table(dc, INITIAL_TABLE_SLOTS);
+		}
+	}
+
+	if(!is_table(dc))
+	{
+		uint32_t *hashes = heap_hashes(dc->heap, dc->alloc);
+		const uint32_t at = lower_bound(hashes, dc->len, hash);
+		memmove(&dc->heap[at + 1], &dc->heap[at],
+				sizeof(struct DomainTree*) * (dc->len - at));
+		memmove(&hashes[at + 1], &hashes[at], sizeof(uint32_t) * (dc->len - at));
+		dc->heap[at] = node;
+		hashes[at] = hash;
+		dc->len++;
+		return;
+	}
+
+	// keep the load of the table at most three quarters.
+	if(4 * (dc->len + 1) > 3 * dc->alloc)
+	{
+		rehash_table(dc, dc->alloc * 2);
+	}
+
+	uint32_t *hashes = heap_hashes(dc->heap, dc->alloc);
+	const uint32_t slot = find_slot(dc->heap, dc->alloc, hash, node->tld,
+			node->len);
+	ASSERT(!hashes[slot]);
+	dc->heap[slot] = node;
+	hashes[slot] = hash;
+	dc->len++;
+}
+
+/**
+ * Returns the child after the one at 'pos' and advances 'pos'; NULL once all
+ * were returned. Start with 'pos' of zero. The container must not change while
+ * iterating.
+ */
+struct DomainTree *next_DomainChildren(DomainChildren_t const *dc, size_t *pos)
+{
+	ASSERT(dc);
+	ASSERT(pos);
+
+	if(dc->alloc == 0)
+	{
+		return *pos < dc->len ? dc->nodes[(*pos)++] : NULL;
+	}
+
+	if(!is_table(dc))
+	{
+		return *pos < dc->len ? dc->heap[(*pos)++] : NULL;
+	}
+
+	uint32_t const *hashes = heap_hashes(dc->heap, dc->alloc);
+	while(*pos < dc->alloc)
+	{
+		const size_t i = (*pos)++;
+		if(hashes[i])
+		{
+			return dc->heap[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Release the memory of the container, not of the children, and leave it
+ * empty.
+ */
+void free_DomainChildren(DomainChildren_t *dc)
+{
+	ASSERT(dc);
+
+	if(dc->alloc)
+	{
+		free(dc->heap);
+	}
+	memset(dc, 0, sizeof(DomainChildren_t));
+}
+
+size_t len_DomainChildren(DomainChildren_t const *dc)
+{
+	ASSERT(dc);
+	return dc->len;
+}
+
+/**
+ * Returns the bytes allocated by the container beyond its own size.
+ */
+size_t bytes_DomainChildren(DomainChildren_t const *dc)
+{
+	ASSERT(dc);
+	return (sizeof(struct DomainTree*) + sizeof(uint32_t)) * dc->alloc;
+}
+
+#ifdef BUILD_TESTS
+#define TEST_CHILDREN 200
+
+static void test_add_DomainChildren()
+{
+	DomainChildren_t dc;
+	memset(&dc, 0, sizeof(DomainChildren_t));
+
+	DomainTree_t nodes[TEST_CHILDREN];
+	char labels[TEST_CHILDREN][8];
+	memset(nodes, 0, sizeof(nodes));
+
+	for(size_t i = 0; i < TEST_CHILDREN; i++)
+	{
+		nodes[i].len = snprintf(labels[i], sizeof(labels[i]), "l%lu", i);
+		nodes[i].tld = labels[i];
+
+		add_DomainChildren(&dc, hash_Label(labels[i], nodes[i].len),
+				&nodes[i]);
+		assert(len_DomainChildren(&dc) == i + 1);
+
+		if(i < DOMAIN_CHILDREN_INLINE)
+		{
+			assert(dc.alloc == 0);
+		}
+		else if(i < DOMAIN_CHILDREN_SORTED_MAX)
+		{
+			assert(dc.alloc > 0 && dc.alloc <= DOMAIN_CHILDREN_SORTED_MAX);
+		}
+		else
+		{
+			assert(dc.alloc > DOMAIN_CHILDREN_SORTED_MAX);
+			assert(4 * dc.len <= 3 * dc.alloc);
+		}
+
+		for(size_t j = 0; j <= i; j++)
+		{
+			assert(find_DomainChildren(&dc, hash_Label(labels[j],
+							nodes[j].len), labels[j], nodes[j].len) == &nodes[j]);
+		}
+		assert(!find_DomainChildren(&dc, hash_Label("nope", 4),
+					"nope", 4));
+	}
+
+	// every child is returned once.
+	size_t pos = 0, seen = 0;
+	DomainTree_t *node;
+	while((node = next_DomainChildren(&dc, &pos)))
+	{
+		assert(node >= nodes && node < nodes + TEST_CHILDREN);
+		assert(!node->len_tail);
+		node->len_tail = 1;
+		seen++;
+	}
+	assert(seen == TEST_CHILDREN);
+	assert(bytes_DomainChildren(&dc) ==
+			(sizeof(DomainTree_t*) + sizeof(uint32_t)) * dc.alloc);
+
+	free_DomainChildren(&dc);
+	assert(len_DomainChildren(&dc) == 0);
+	assert(dc.alloc == 0);
+	assert(bytes_DomainChildren(&dc) == 0);
+}
+
+static void test_collide_DomainChildren()
+{
+	DomainChildren_t dc;
+	memset(&dc, 0, sizeof(DomainChildren_t));
+
+	DomainTree_t nodes[TEST_CHILDREN];
+	char labels[TEST_CHILDREN][8];
+	memset(nodes, 0, sizeof(nodes));
+
+	// labels of the same hash are told apart by their bytes in every kind.
+	for(size_t i = 0; i < TEST_CHILDREN; i++)
+	{
+		nodes[i].len = snprintf(labels[i], sizeof(labels[i]), "c%lu", i);
+		nodes[i].tld = labels[i];
+		add_DomainChildren(&dc, 7, &nodes[i]);
+
+		for(size_t j = 0; j <= i; j++)
+		{
+			assert(find_DomainChildren(&dc, 7, labels[j], nodes[j].len) ==
+					&nodes[j]);
+		}
+		assert(!find_DomainChildren(&dc, 7, "c", 1));
+	}
+
+	free_DomainChildren(&dc);
+}
+
+void test_DomainChildren()
+{
+	test_add_DomainChildren();
+	test_collide_DomainChildren();
+}
+#endif
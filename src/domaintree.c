@@ -21,97 +21,117 @@
 #include "domaintree.h"
 #include "domaininfo.h"
 #include "domain.h"
+#include "arena.h"
+#include "tldtable.h"
+#include "labelhash.h"
+#include "uthash.h"
+#include "logdiagnostics.h"
 
 /**
- * Create and initialize a DomainInfo_t. Returned pointer must be freed with
- * free_DomainInfo().
+ * Copy the data from the given DomainView_t into the given DomainInfo_t.
  */
-static DomainInfo_t* init_DomainInfo()
+static void fill_DomainInfo(DomainInfo_t *di, Arena_t *arena, DomainView_t *dv)
 {
-	DomainInfo_t *di = malloc(sizeof(DomainInfo_t));
-
-#ifdef USE_MEMSET
-	memset(di, 0, sizeof(DomainInfo_t));
+#if defined(BUILD_TESTS)
+	// fqd is necessary for tests where it is used to verify behaviors
+	// fqd is necessary for regex prune
+	di->fqd = copy_Arena(arena, dv->fqd, dv->len);
+	di->len = dv->len;
 #else
-	di->context = NULL;
-	di->match_strength = MATCH_NOTSET;
-#ifdef BUILD_TESTS
-	di->fqd = NULL;
-	di->len = 0;
-#endif
+	UNUSED(arena);
 #endif
-	return di;
+	di->match_strength = dv->match_strength;
+	di->file_index = dv->file_index;
+	di->linenumber = dv->linenumber;
+}
+
+/**
+ * Returns true if the node holds a domain of its own, i.e., it is not only a
+ * label on the path to other domains.
+ */
+static bool has_DomainInfo(DomainTree_t const *dt)
+{
+	return dt->di.match_strength != MATCH_NOTSET;
 }
 
-void free_DomainInfo(DomainInfo_t **di)
+/**
+ * The root node along with the known TLDs among its children indexed by their
+ * slot in the table of find_TldTable(). A known TLD is found without hashing
+ * it or probing the children of the root.
+ */
+typedef struct DomainTreeRoot
 {
-	if(*di)
+	// first so the root is passed around as any other node.
+	DomainTree_t node;
+	DomainTree_t **tlds;
+} DomainTreeRoot_t;
+
+/**
+ * Returns the root of the tree, creating it from the arena for the first
+ * insert.
+ */
+static DomainTreeRoot_t *root_DomainTree(DomainTree_t **root, Arena_t *arena)
+{
+	if(!*root)
 	{
-#if defined(BUILD_TESTS)
-		free((*di)->fqd);
-#endif
+		DomainTreeRoot_t *r = calloc_Arena(arena, sizeof(DomainTreeRoot_t));
+		r->node.di.match_strength = MATCH_NOTSET;
+		r->tlds = calloc_Arena(arena, sizeof(DomainTree_t*) * slots_TldTable());
+		*root = &r->node;
 	}
-	free(*di);
-
-	*di = NULL;
+	return (DomainTreeRoot_t*)*root;
 }
 
 /**
- * Return a malloc'ed DomainInfo_t that contains a copy of the data from the
- * given DomainView_t. The returned pointer must be freed with
- * free_DomainInfo().
+ * Free the child containers below the given ones. The nodes themselves belong
+ * to the arena they were allocated from.
  */
-DomainInfo_t *convert_DomainInfo(DomainView_t *dv)
+static void clear_DomainTree(DomainChildren_t *children)
 {
-	DomainInfo_t *di = init_DomainInfo();
+	ASSERT(children);
 
-#if defined(BUILD_TESTS)
-	// fqd is necessary for tests where it is used to verify behaviors
-	// fqd is necessary for regex prune
-	di->fqd = malloc(sizeof(char) * dv->len);
-	di->len = dv->len;
-	memcpy(di->fqd, dv->fqd, dv->len);
-#endif
-	di->match_strength = dv->match_strength;
-	di->context = dv->context;
-	di->linenumber = dv->linenumber;
+	size_t pos = 0;
+	DomainTree_t *current;
+	while((current = next_DomainChildren(children, &pos)))
+	{
+		clear_DomainTree(&current->children);
+	}
 
-	return di;
+	free_DomainChildren(children);
 }
 
-static void free_DomainTreePtr(DomainTree_t **dt)
+static void do_transfer_DomainInfo(DomainChildren_t *children,
+		void(*collector)(DomainInfo_t const *di, void *context), void *context)
 {
-	free((*dt)->tld);
-	free(*dt);
-	*dt = NULL;
-}
+	size_t pos = 0;
+	DomainTree_t *current;
+	while((current = next_DomainChildren(children, &pos)))
+	{
+		// must visit each child
+		do_transfer_DomainInfo(&current->children, collector, context);
+		ASSERT(!len_DomainChildren(&current->children));
 
-/**
- * This being extern allows outside sources use it in a callback to visit every
- * item in their own tree/list/struct to delete the DomainInfo held. And keeps
- * the free_DomainInfo hidden to within here.
- *
- * This being static .. keeps it local to this as it is a callback and the void*
- * is bogus to outsiders for the sake of free() calls. it's also ignored by this
- * particular callback.
- */
-static void DomainInfo_deleter(DomainInfo_t **di, void *ignored)
-{
-	UNUSED(ignored);
-	free_DomainInfo(di);
-	ASSERT(!*di);
+		if(has_DomainInfo(current))
+		{
+			ASSERT(current->di.match_strength > MATCH_NOTSET);
+			ASSERT(current->di.linenumber != 0);
+			collector(&current->di, context);
+		}
+	}
+
+	free_DomainChildren(children);
 }
 
 /**
  * Visits every leaf of the tree depth first and calls the given collector
- * passing the DomainInfo of that leaf along with the given context. Then frees
- * the internal structures. The collector owns all DomainInfo instances once
- * held by the tree.
+ * passing the DomainInfo of that leaf along with the given context. The
+ * DomainInfo is valid only for the duration of the call.
  *
- * The DomainTree is free'd after this operation and the given root is NIL.
+ * The child containers of the DomainTree are free'd after this operation and
+ * the given root is NIL. The nodes are released with the arena of the tree.
  */
 void transfer_DomainInfo(DomainTree_t **root,
-		void(*collector)(DomainInfo_t **di, void *context), void *context)
+		void(*collector)(DomainInfo_t const *di, void *context), void *context)
 {
 	ASSERT(root);
 	if(*root == NULL)
@@ -119,30 +139,14 @@ void transfer_DomainInfo(DomainTree_t **root,
 		return;
 	}
 
-	DomainTree_t *current = NULL, *tmp = NULL;
-	HASH_ITER(hh, *root, current, tmp)
-	{
-		// must visit each child
-		transfer_DomainInfo(&(*root)->child, collector, context);
-
-		HASH_DEL(*root, current);
-
-		if(current->di)
-		{
-			ASSERT(current->di->match_strength > MATCH_NOTSET);
-			ASSERT(current->di->linenumber != 0);
-			collector(&(current->di), context);
-			ASSERT(!current->di);
-		}
-		ASSERT(!current->di);
-		free_DomainTreePtr(&current);
-	}
-
+	do_transfer_DomainInfo(&(*root)->children, collector, context);
 	*root = NULL;
 }
 
 /**
- * Delete the tree starting at the given root.
+ * Delete the tree starting at the given root along with the arena holding it.
+ * Only the child containers are released one by one; the nodes, labels and
+ * DomainInfo go with the slabs of the arena.
  *
  *			.google.com : nil-di
  *			^ free all items below this
@@ -156,107 +160,140 @@ void transfer_DomainInfo(DomainTree_t **root,
  * blarg.www.google.com : di
  * ^
  */
-void free_DomainTree(DomainTree_t **root)
+void free_DomainTree(DomainTree_t **root, Arena_t *arena)
 {
-	transfer_DomainInfo(root, DomainInfo_deleter, NULL);
-	ASSERT(!*root);
+	ASSERT(root);
+	ASSERT(arena);
+
+	if(*root)
+	{
+		clear_DomainTree(&(*root)->children);
+		*root = NULL;
+	}
+	free_Arena(arena);
 }
 
 /**
  * Replace the given DomainTree's DomainInfo with one described by the given
- * DomainView. Creates a new DomainInfo from the given DomainView and assigns to
- * the given entry. The old DomainInfo is freed before overwriting. No
- * modifications are done to the DomainTree's structure.
+ * DomainView. The DomainInfo is overwritten in place. No modifications are done
+ * to the DomainTree's structure.
  */
-static void replace_DomainInfo(DomainTree_t *entry, DomainView_t *dv)
+static void replace_DomainInfo(DomainTree_t *entry, Arena_t *arena,
+		DomainView_t *dv)
 {
-	free_DomainInfo(&entry->di);
-	entry->di = convert_DomainInfo(dv);
+	fill_DomainInfo(&entry->di, arena, dv);
 }
 
-static DomainTree_t *init_DomainTree(SubdomainView_t const *sdv)
+/**
+ * Create a node for the given label and as many of the labels following it as
+ * fit in its run, and add it to the given children. The iterator is left at
+ * the last label of the run.
+ */
+static DomainTree_t *init_DomainTree(DomainChildren_t *children, Arena_t *arena,
+		DomainViewIter_t *it, SubdomainView_t const *sdv)
 {
-	// the DomainTree_t instance must be memset since it is inserted into a
-	// UT_hash. alternate options available such as defining a hash function and
-	// comparison. default requires all padding be zero'ed.
-	DomainTree_t *ndt = calloc(1, sizeof(DomainTree_t));
+	// size the run on a copy of the iterator first.
+	DomainViewIter_t peek = *it;
+	SubdomainView_t next;
+	size_t len_tail = 0, labels = 0;
+	while(next_DomainView(&peek, &next) &&
+			len_tail + 1 + next.len <= UINT16_MAX)
+	{
+		len_tail += 1 + next.len;
+		labels++;
+	}
+
+	// zero'ed for an empty container of children.
+	DomainTree_t *ndt = calloc_Arena(arena, sizeof(DomainTree_t));
+
+	// labels need no alignment.
+	char *key = bytes_Arena(arena, sdv->len + len_tail);
+	memcpy(key, sdv->data, sdv->len);
+	char *pos = key + sdv->len;
+	for(size_t i = 0; i < labels; i++)
+	{
+		next_DomainView(it, &next);
+		*pos++ = (char)next.len;
+		memcpy(pos, next.data, next.len);
+		pos += next.len;
+	}
 
 	ndt->len = sdv->len;
+	ndt->tld = key;
+	ndt->len_tail = len_tail;
+	ndt->di.match_strength = MATCH_NOTSET;
 
-	ndt->tld = malloc(sizeof(char) * sdv->len);
-	memcpy(ndt->tld, sdv->data, sdv->len);
+	add_DomainChildren(children, sdv->hash, ndt);
 
 	return ndt;
 }
 
 /**
  * Internal to the construction of the tree. though it could be used outside to
- * initialize the tree.
+ * initialize the tree. The remaining labels of the domain usually fit in the
+ * run of a single node.
  */
-static DomainTree_t* ctor_DomainTree(DomainTree_t **dt, DomainViewIter_t *it,
-		SubdomainView_t *sdv)
+static DomainTree_t* ctor_DomainTree(DomainChildren_t *children,
+		Arena_t *arena, DomainViewIter_t *it, SubdomainView_t *sdv)
 {
-	ASSERT(dt);
+	ASSERT(children);
+	ASSERT(arena);
 	ASSERT(it);
 	ASSERT(sdv);
 
 	DomainTree_t *ndt = NULL;
 
-	// (0) enters with 'com' or 'net' or 'org' a TLD
+	// enters with the first label not in the tree, e.g., 'google' of
+	// 'www.google.com' when only 'com' is. 'google' and 'www' become one
+	// node.
 	do
 	{
-		// (0) enters with 'com' or 'net' or 'org' a TLD
-		// (1) create entry for 'google'
-		// (2) create entry for 'www'
-		ndt = init_DomainTree(sdv);
+		ndt = init_DomainTree(children, arena, it, sdv);
 		ASSERT(ndt);
 
-		// (0) NULL dt is OK it means the HASH table is empty
-		// (0) add 'com' to the HASH table next to 'org', 'net', etc.
-		// (1) add 'google' to NEW HASH table [(0) 'dt->child']
-		// (2) add 'www' to NEW HASH table [(1) 'dt->child']
-#ifndef RELEASE
-		//for debug/testing phase
-		DomainTree_t *unexpected_existing = NULL;
-		HASH_FIND(hh, *dt, ndt->tld, ndt->len, unexpected_existing);
-		ASSERT(!unexpected_existing);
-#endif
-
-		HASH_ADD_KEYPTR(hh, *dt, ndt->tld, ndt->len, ndt);
-
-#if 0
-		DEBUG_PRINTF("\tafter hash add, dt has %lu %.*s\n", (size_t)HASH_COUNT(*dt), (int)(*dt)->len, (*dt)->tld);
-		DomainTree_t *rt = *dt, *t = NULL, *tmp;
-		HASH_ITER(hh, rt, t, tmp) {
-			DEBUG_PRINTF("t %.*s\n", (int)t->len, t->tld);
-		}
-#endif
-		// dt will be the next HASH table to insert items into. it is OK to be
-		// NULL. it means empty HASH.
-		// (0) dt will be NULL; this is a new entry for subdomains of 'com'
-		// (1) dt will be NULL; this is a new entry for subdomains of
-		// 'google.com'
-		// (2) dt will be NULL; this is new entry for subdomains of 'www'
-		dt = &(ndt->child);
-		// (0) parent will be 'com'
-		// (1) parent will be 'google'
-		// (2) parent will be 'www'
-
-	// (1) set sdv to 'google' in 'www.google.com'
-	// (2) set sdv to 'www' in 'www.google.com'
-	// (3) set sdv to <NULL>; end of iteration
+		// labels left over when the run is full go below it.
+		children = &ndt->children;
 	} while(next_DomainView(it, sdv));
 
-	// (3) sdv is NULL; prev_sdv is 'www'
-	// need to set the DomainInfo for 'www' held at ndt
+	// need to set the DomainInfo for the last label held at ndt
 	ASSERT(ndt);
 	ASSERT(it->dv->match_strength > MATCH_NOTSET);
-	ndt->di = convert_DomainInfo(it->dv);
+	fill_DomainInfo(&ndt->di, arena, it->dv);
 
 	return ndt;
 }
 
-static DomainTree_t* replace_if_stronger(DomainTree_t *entry, DomainView_t *dv)
+/**
+ * Split the run of the given node after the first 'keep' bytes of its tail.
+ * The labels after those become a node of their own taking the domain and the
+ * children of the given node, which is left without a domain. The labels stay
+ * where they are in the arena.
+ */
+static void split_DomainTree(DomainTree_t *entry, Arena_t *arena, size_t keep)
+{
+	ASSERT(entry);
+	ASSERT(keep < entry->len_tail);
+
+	char *label = entry->tld + entry->len + keep;
+
+	DomainTree_t *rest = calloc_Arena(arena, sizeof(DomainTree_t));
+	rest->len = (uchar)*label;
+	rest->tld = label + 1;
+	rest->len_tail = entry->len_tail - keep - 1 - rest->len;
+	rest->children = entry->children;
+	rest->di = entry->di;
+
+	entry->len_tail = keep;
+	memset(&entry->children, 0, sizeof(DomainChildren_t));
+	memset(&entry->di, 0, sizeof(DomainInfo_t));
+	entry->di.match_strength = MATCH_NOTSET;
+
+	add_DomainChildren(&entry->children,
+			hash_Label(rest->tld, rest->len), rest);
+}
+
+static DomainTree_t* replace_if_stronger(DomainTree_t *entry, Arena_t *arena,
+		DomainView_t *dv, InsertOutcome_t *outcome)
 {
 	ASSERT(entry);
 	ASSERT(dv);
@@ -264,29 +301,33 @@ static DomainTree_t* replace_if_stronger(DomainTree_t *entry, DomainView_t *dv)
 	ASSERT(dv->match_strength > MATCH_NOTSET);
 	ASSERT(dv->match_strength != MATCH_REGEX);
 
-	if(entry->di == NULL || dv->match_strength > entry->di->match_strength)
+	if(!has_DomainInfo(entry) || dv->match_strength > entry->di.match_strength)
 	{
-		replace_DomainInfo(entry, dv);
+		// an interior node that only held labels so far is a new domain.
+		*outcome = has_DomainInfo(entry) ? INSERT_REPLACED : INSERT_NEW;
+		replace_DomainInfo(entry, arena, dv);
 
-		ASSERT(entry->di);
-		if(entry->di->match_strength == MATCH_FULL)
+		ASSERT(has_DomainInfo(entry));
+		if(entry->di.match_strength == MATCH_FULL)
 		{
-			free_DomainTree(&entry->child);
+			// the nodes below remain in the arena until the tree is freed.
+			clear_DomainTree(&entry->children);
 		}
 		DEBUG_PRINTF("[%s:%d] %s replace existing entry with stronger match; inserted.\n", __FILE__, __LINE__, __FUNCTION__);
 		DEBUG_PRINTF("\ttld=%.*s\n", (int)entry->len, entry->tld);
 #ifdef BUILD_TESTS
-		DEBUG_PRINTF("\tfqd=%.*s\n", (int)entry->di->len, entry->di->fqd);
+		DEBUG_PRINTF("\tfqd=%.*s\n", (int)entry->di.len, entry->di.fqd);
 #endif
 		return entry;
 	}
 	else // not strong enough to override
 	{
+		*outcome = INSERT_IDENTICAL;
 		DEBUG_PRINTF("[%s:%d] %s identical; skip insert.\n", __FILE__, __LINE__, __FUNCTION__);
 		DEBUG_PRINTF("\ttld=%.*s\n", (int)entry->len, entry->tld);
 #ifdef BUILD_TESTS
-		ASSERT(entry->di);
-		DEBUG_PRINTF("\tfqd=%.*s\n", (int)entry->di->len, entry->di->fqd);
+		ASSERT(has_DomainInfo(entry));
+		DEBUG_PRINTF("\tfqd=%.*s\n", (int)entry->di.len, entry->di.fqd);
 #endif
 	}
 
@@ -296,62 +337,131 @@ static DomainTree_t* replace_if_stronger(DomainTree_t *entry, DomainView_t *dv)
 static bool leaf_DomainTree(DomainTree_t const *dt)
 {
 	ASSERT(dt);
-	// HASH_CNT(<hh>, <obj>)
-	// even if 'child' is NULL, HASH_COUNT has defined behavior and returns 0.
-	return HASH_COUNT(dt->child) == 0;
+	return len_DomainChildren(&dt->children) == 0;
 }
 
-static DomainTree_t* insert_Domain(DomainTree_t **root_dt, DomainView_t *dv)
+static DomainTree_t* insert_Domain(DomainTree_t **root_dt, Arena_t *arena,
+		DomainView_t *dv, InsertOutcome_t *outcome)
 {
 	ASSERT(root_dt);
 
-	DomainTree_t **dt = root_dt;
+	DomainTreeRoot_t *root = root_DomainTree(root_dt, arena);
+	DomainChildren_t *children = &root->node.children;
 	DomainTree_t *entry = NULL;
 
 	DomainViewIter_t it = begin_DomainView(dv);
 	SubdomainView_t sdv;
+	bool more = next_DomainView(&it, &sdv);
 
-	while(next_DomainView(&it, &sdv))
+	while(more)
 	{
-		ASSERT(dt);
+		ASSERT(children);
 		ASSERT(sdv.data);
 		ASSERT(sdv.len > 0);
-		HASH_FIND(hh, *dt, sdv.data, sdv.len, entry);
+
+		// hashed by update_DomainView() when the domain was split.
+		const uint32_t hash = sdv.hash;
+#ifndef NDEBUG
+		ASSERT(hash == hash_Label(sdv.data, sdv.len));
+#endif
+
+		size_t slot = TLD_TABLE_NONE;
+		if(children == &root->node.children &&
+				(slot = find_TldTable(sdv.data, sdv.len)) != TLD_TABLE_NONE)
+		{
+			entry = root->tlds[slot];
+		}
+		else
+		{
+			entry = find_DomainChildren(children, hash, sdv.data, sdv.len);
+		}
 
 		if(!entry)
 		{
-			entry = ctor_DomainTree(dt, &it, &sdv);
+			char const *label = sdv.data;
+			const size_t len = sdv.len;
+
+			entry = ctor_DomainTree(children, arena, &it, &sdv);
+			if(slot != TLD_TABLE_NONE)
+			{
+				// once per TLD; the node holding it is the first created.
+				root->tlds[slot] = find_DomainChildren(children, hash, label,
+						len);
+				ASSERT(root->tlds[slot]);
+			}
+			*outcome = INSERT_NEW;
 			ASSERT(entry);
-			ASSERT(entry->di);
-			ASSERT(entry->di->match_strength > MATCH_NOTSET);
+			ASSERT(has_DomainInfo(entry));
+			ASSERT(entry->di.match_strength > MATCH_NOTSET);
 			return entry;
 		}
 
+		// the rest of the run must be the next labels of the domain.
+		size_t matched = 0;
+		while(matched < entry->len_tail)
+		{
+			char const *label = entry->tld + entry->len + matched;
+			more = next_DomainView(&it, &sdv);
+			if(!more || (uchar)*label != sdv.len ||
+					memcmp(label + 1, sdv.data, sdv.len))
+			{
+				break;
+			}
+			matched += 1 + sdv.len;
+		}
+
+		if(matched < entry->len_tail)
+		{
+			// the domain ends or branches off within the run. either the
+			// node is now the domain or the label is a sibling of the rest.
+			split_DomainTree(entry, arena, matched);
+			children = &entry->children;
+			continue;
+		}
+
 		if(leaf_DomainTree(entry))
 		{
-			ASSERT(entry->di);
-			ASSERT(entry->di->match_strength > MATCH_NOTSET);
-			ASSERT(entry->di->match_strength != MATCH_REGEX);
-			if(entry->di->match_strength == MATCH_FULL)
+			ASSERT(has_DomainInfo(entry));
+			ASSERT(entry->di.match_strength > MATCH_NOTSET);
+			ASSERT(entry->di.match_strength != MATCH_REGEX);
+			if(entry->di.match_strength == MATCH_FULL)
 			{
+				// the last label is the same domain, not a subdomain.
+				*outcome = it.cur_seg == dv->segs_used ? INSERT_IDENTICAL :
+					INSERT_UNDER_FULL;
 				return NULL;
 			}
 		}
 
-		dt = &entry->child;
+		children = &entry->children;
+		more = next_DomainView(&it, &sdv);
 	}
 
 	// if 'entry' is null, then 'dv' is garbage, i.e., not a domain.
 	ASSERT(entry);
-	entry = replace_if_stronger(entry, dv);
+	entry = replace_if_stronger(entry, arena, dv, outcome);
 	return entry;
 }
 
-DomainTree_t* insert_DomainTree(DomainTree_t **dt, DomainView_t *dv)
+/**
+ * Insert the given domain into the tree. New nodes, labels and DomainInfo are
+ * allocated from the given arena which must be the same for the whole tree.
+ * When 'outcome' is not NULL it is set to what became of the domain.
+ */
+DomainTree_t* insert_DomainTree(DomainTree_t **dt, Arena_t *arena,
+		DomainView_t *dv, InsertOutcome_t *outcome)
 {
 	ASSERT(dt);
+	ASSERT(arena);
 	ASSERT(dv);
 
+	InsertOutcome_t ignored;
+	if(!outcome)
+	{
+		outcome = &ignored;
+	}
+	*outcome = INSERT_SKIPPED;
+
 	// mandate the match strength be set before inserting to communicate that
 	// the tree insertion REQUIRES knowing this information or else it'll be a
 	// bad day in hell to know why the matches are bogused. the insertion
@@ -369,36 +479,32 @@ DomainTree_t* insert_DomainTree(DomainTree_t **dt, DomainView_t *dv)
 		return NULL;
 	}
 
-	DomainTree_t *entry = insert_Domain(dt, dv);
+	DomainTree_t *entry = insert_Domain(dt, arena, dv, outcome);
 
 	return entry;
 }
 
-static void do_visit_DomainTree(DomainTree_t *root,
+static void do_visit_DomainTree(DomainChildren_t const *children,
 		void(*visitor_func)(DomainInfo_t const *di, void *context),
 		void *context)
 {
 	ASSERT(visitor_func);
 
-	if(root == NULL)
-	{
-		return;
-	}
+	size_t pos = 0;
+	DomainTree_t *dt;
 
-	DomainTree_t *dt, *tmp;
-
-	HASH_ITER(hh, root, dt, tmp)
+	while((dt = next_DomainChildren(children, &pos)))
 	{
 		// must visit each child
-		do_visit_DomainTree(dt->child, visitor_func, context);
+		do_visit_DomainTree(&dt->children, visitor_func, context);
 
-		if(dt->di)
+		if(has_DomainInfo(dt))
 		{
-			DEBUG_PRINTF("DT: Visited strength=%d label=%.*s\n", dt->di->match_strength, (int)dt->len, dt->tld);
+			DEBUG_PRINTF("DT: Visited strength=%d label=%.*s\n", dt->di.match_strength, (int)dt->len, dt->tld);
 #ifdef BUILD_TESTS
-			DEBUG_PRINTF("DT: Visited fqd=%.*s\n", (int)dt->di->len, dt->di->fqd);
+			DEBUG_PRINTF("DT: Visited fqd=%.*s\n", (int)dt->di.len, dt->di.fqd);
 #endif
-			(*visitor_func)(dt->di, context);
+			(*visitor_func)(&dt->di, context);
 		}
 	}
 
@@ -410,7 +516,360 @@ void visit_DomainTree(DomainTree_t *root,
 {
 	ASSERT(visitor_func);
 
-	do_visit_DomainTree(root, visitor_func, context);
+	if(root)
+	{
+		do_visit_DomainTree(&root->children, visitor_func, context);
+	}
+}
+
+// longest domain name rebuilt from the labels of the tree.
+#define PRUNE_FQD_MAX 4096
+
+/**
+ * Rebuilds the name of every domain below the given children right aligned
+ * in 'buf' and passes it to 'visit'. The labels of each child are placed in
+ * front of the 'suffix' characters already at the end of 'buf'. Returns the
+ * number of domains for which 'visit' returned true.
+ */
+static size_t do_walk_DomainTree(DomainChildren_t const *children, char *buf,
+		size_t suffix,
+		bool(*visit)(char const *fqd, size_t len, DomainInfo_t *di,
+			void *context),
+		void *context)
+{
+	size_t pos_child = 0;
+	DomainTree_t *dt;
+	size_t count = 0;
+
+	while((dt = next_DomainChildren(children, &pos_child)))
+	{
+		// labels plus a period when not at the top level. a label of the run
+		// takes as many bytes in the name as it does in the tail.
+		const size_t len_first = dt->len + (suffix ? 1 : 0);
+		const size_t len = suffix + len_first + dt->len_tail;
+		if(len > PRUNE_FQD_MAX)
+		{
+			ELOG_STDERR("WARNING: domain too long to rebuild its name: %.*s...\n",
+					(int)dt->len, dt->tld);
+			continue;
+		}
+
+		char *pos = buf + PRUNE_FQD_MAX - suffix - len_first;
+		memcpy(pos, dt->tld, dt->len);
+		if(suffix)
+		{
+			pos[dt->len] = '.';
+		}
+
+		// the labels of the run go in front one by one.
+		char const *label = dt->tld + dt->len;
+		char const *const end = label + dt->len_tail;
+		while(label != end)
+		{
+			const uchar len_label = *label++;
+			*--pos = '.';
+			pos -= len_label;
+			memcpy(pos, label, len_label);
+			label += len_label;
+		}
+
+		char *fqd = pos;
+		ASSERT(fqd == buf + PRUNE_FQD_MAX - len);
+
+		if(has_DomainInfo(dt) && (*visit)(fqd, len, &dt->di, context))
+		{
+			count++;
+		}
+
+		count += do_walk_DomainTree(&dt->children, buf, len, visit, context);
+	}
+
+	return count;
+}
+
+static size_t walk_DomainTree(DomainTree_t *root,
+		bool(*visit)(char const *fqd, size_t len, DomainInfo_t *di,
+			void *context),
+		void *context)
+{
+	if(!root)
+	{
+		return 0;
+	}
+
+	char *buf = malloc(PRUNE_FQD_MAX + 1);
+	if(!buf)
+	{
+		ELOG_STDERR("ERROR: failed to allocate domain buffer\n");
+		exit(EXIT_FAILURE);
+	}
+	buf[PRUNE_FQD_MAX] = '\0';
+
+	const size_t count = do_walk_DomainTree(&root->children, buf, 0, visit,
+			context);
+
+	free(buf);
+	return count;
+}
+
+typedef struct PruneWalk
+{
+	bool(*drop)(char const *fqd, size_t len, void *context);
+	void *context;
+} PruneWalk_t;
+
+static bool prune_walk(char const *fqd, size_t len, DomainInfo_t *di,
+		void *context)
+{
+	PruneWalk_t const *pw = context;
+	if(!(*pw->drop)(fqd, len, pw->context))
+	{
+		return false;
+	}
+
+	DEBUG_PRINTF("DT: Pruned label=%.*s\n", (int)len, fqd);
+	di->match_strength = MATCH_NOTSET;
+	return true;
+}
+
+/**
+ * Removes every domain of the tree for which 'drop' returns true. 'drop' is
+ * given the null terminated name of the domain rebuilt from the labels of the
+ * tree. Labels no longer leading to a domain remain in the tree and are
+ * skipped by visit_DomainTree() and transfer_DomainInfo(). Returns the number
+ * of domains removed.
+ */
+size_t prune_DomainTree(DomainTree_t *root,
+		bool(*drop)(char const *fqd, size_t len, void *context),
+		void *context)
+{
+	ASSERT(drop);
+
+	PruneWalk_t pw = { drop, context };
+	return walk_DomainTree(root, prune_walk, &pw);
+}
+
+typedef struct NameWalk
+{
+	void(*visit)(char const *fqd, size_t len, DomainInfo_t const *di,
+			void *context);
+	void *context;
+} NameWalk_t;
+
+static bool name_walk(char const *fqd, size_t len, DomainInfo_t *di,
+		void *context)
+{
+	NameWalk_t const *nw = context;
+	(*nw->visit)(fqd, len, di, nw->context);
+	return true;
+}
+
+/**
+ * Calls 'visit' with every domain of the tree, its null terminated name
+ * rebuilt from the labels of the tree, and its DomainInfo. The name is valid
+ * only for the duration of the call. Returns the number of domains visited.
+ */
+size_t visit_names_DomainTree(DomainTree_t *root,
+		void(*visit)(char const *fqd, size_t len, DomainInfo_t const *di,
+			void *context),
+		void *context)
+{
+	ASSERT(visit);
+
+	NameWalk_t nw = { visit, context };
+	return walk_DomainTree(root, name_walk, &nw);
+}
+
+#ifdef COLLECT_DIAGNOSTICS
+typedef struct TreeMemory
+{
+	size_t nodes;
+	size_t domains;
+	size_t label_bytes;
+	size_t children_bytes;
+	// nodes with children held in place, sorted and hashed.
+	size_t held[3];
+	size_t widest;
+} TreeMemory_t;
+
+static void measure_DomainTree(DomainTree_t const *dt, TreeMemory_t *tm)
+{
+	DomainChildren_t const *children = &dt->children;
+	const size_t len = len_DomainChildren(children);
+	if(len)
+	{
+		tm->held[children->alloc == 0 ? 0 :
+			children->alloc <= DOMAIN_CHILDREN_SORTED_MAX ? 1 : 2]++;
+		tm->children_bytes += bytes_DomainChildren(children);
+		tm->widest = len > tm->widest ? len : tm->widest;
+	}
+
+	size_t pos = 0;
+	DomainTree_t const *child;
+	while((child = next_DomainChildren(children, &pos)))
+	{
+		tm->nodes++;
+		tm->label_bytes += child->len + child->len_tail;
+		tm->domains += has_DomainInfo(child) ? 1 : 0;
+		measure_DomainTree(child, tm);
+	}
+}
+
+/**
+ * Log the nodes of the tree, how their children are held and the memory taken
+ * per node.
+ */
+void log_DomainTree(DomainTree_t const *root)
+{
+	if(!root)
+	{
+		return;
+	}
+
+	TreeMemory_t tm;
+	memset(&tm, 0, sizeof(TreeMemory_t));
+	measure_DomainTree(root, &tm);
+	if(!tm.nodes)
+	{
+		return;
+	}
+
+	size_t known = 0;
+	DomainTree_t *const *tlds = ((DomainTreeRoot_t const*)root)->tlds;
+	for(size_t s = 0; s < slots_TldTable(); s++)
+	{
+		known += tlds[s] ? 1 : 0;
+	}
+
+	const size_t bytes = tm.nodes * sizeof(DomainTree_t) + tm.label_bytes +
+		tm.children_bytes;
+	LOG_DIAG("DomainTree", root,
+			"%lu nodes holding %lu domains in %lu bytes; %.1f bytes per node (%lu node, %.1f labels, %.1f children).\n",
+			tm.nodes, tm.domains, bytes, (double)bytes / tm.nodes,
+			sizeof(DomainTree_t), (double)tm.label_bytes / tm.nodes,
+			(double)tm.children_bytes / tm.nodes);
+	LOG_DIAG_CONT("children held in place by %lu nodes, sorted by %lu, hashed by %lu; widest has %lu.\n",
+			tm.held[0], tm.held[1], tm.held[2], tm.widest);
+	LOG_DIAG_CONT("%lu of %lu TLDs found by their slot in the table of known TLDs.\n\n",
+			known, len_DomainChildren(&root->children));
+}
+#endif
+
+void init_DomainTreeShards(DomainTreeShards_t *shards, size_t len_shards)
+{
+	ASSERT(shards);
+	ASSERT(len_shards > 0);
+
+	shards->len_shards = len_shards;
+	shards->roots = calloc(len_shards, sizeof(DomainTree_t*));
+	shards->arenas = malloc(sizeof(Arena_t) * len_shards);
+	if(!shards->roots || !shards->arenas)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	for(size_t i = 0; i < len_shards; i++)
+	{
+		init_Arena(&shards->arenas[i]);
+	}
+}
+
+void free_DomainTreeShards(DomainTreeShards_t *shards)
+{
+	ASSERT(shards);
+
+	for(size_t i = 0; i < shards->len_shards; i++)
+	{
+		free_DomainTree(&shards->roots[i], &shards->arenas[i]);
+	}
+
+	free(shards->roots);
+	free(shards->arenas);
+	shards->roots = NULL;
+	shards->arenas = NULL;
+	shards->len_shards = 0;
+}
+
+/**
+ * Returns the shard that holds the given domain; decided by its TLD alone.
+ */
+size_t shard_DomainTree(DomainTreeShards_t const *shards, DomainView_t *dv)
+{
+	ASSERT(shards);
+	ASSERT(dv);
+
+	DomainViewIter_t it = begin_DomainView(dv);
+	SubdomainView_t sdv;
+
+	if(!next_DomainView(&it, &sdv))
+	{
+		return 0;
+	}
+
+	return sdv.hash % shards->len_shards;
+}
+
+/**
+ * Same as insert_DomainTree() on the given shard. The caller guarantees the
+ * domain belongs to the shard and that only one thread inserts into a shard.
+ */
+DomainTree_t* insert_DomainTreeShards(DomainTreeShards_t *shards, size_t shard,
+		DomainView_t *dv, InsertOutcome_t *outcome)
+{
+	ASSERT(shards);
+	ASSERT(shard < shards->len_shards);
+	ASSERT(shard == shard_DomainTree(shards, dv));
+
+	return insert_DomainTree(&shards->roots[shard], &shards->arenas[shard], dv,
+			outcome);
+}
+
+/**
+ * Move the TLD entries of every shard into the given root and the memory of
+ * every shard into the given arena of the root. Only the root level is touched;
+ * the subtrees are moved as is. The shards are empty afterwards.
+ */
+void merge_DomainTreeShards(DomainTreeShards_t *shards, DomainTree_t **root,
+		Arena_t *arena)
+{
+	ASSERT(shards);
+	ASSERT(root);
+	ASSERT(arena);
+
+	for(size_t i = 0; i < shards->len_shards; i++)
+	{
+		DomainTree_t *shard_root = shards->roots[i];
+		shards->roots[i] = NULL;
+		if(!*root)
+		{
+			// the root node moves along with the memory of its shard.
+			*root = shard_root;
+		}
+		else if(shard_root)
+		{
+			DomainTree_t **tlds = ((DomainTreeRoot_t*)*root)->tlds;
+			DomainTree_t *const *shard_tlds = ((DomainTreeRoot_t*)shard_root)->tlds;
+			for(size_t s = 0; s < slots_TldTable(); s++)
+			{
+				if(shard_tlds[s])
+				{
+					ASSERT(!tlds[s]);
+					tlds[s] = shard_tlds[s];
+				}
+			}
+
+			size_t pos = 0;
+			DomainTree_t *current;
+			while((current = next_DomainChildren(&shard_root->children, &pos)))
+			{
+				add_DomainChildren(&(*root)->children,
+						hash_Label(current->tld, current->len), current);
+			}
+			free_DomainChildren(&shard_root->children);
+		}
+
+		merge_Arena(arena, &shards->arenas[i]);
+	}
 }
 
 #ifdef BUILD_TESTS
@@ -467,7 +926,7 @@ static void test_visitor(DomainInfo_t const *di, void *context)
 	update_DomainView(&dv, value, strlen(value)); \
 	dv.linenumber = __LINE__; \
 	dv.match_strength = strength; \
-	ret = insert_DomainTree(&root, &dv); \
+	ret = insert_DomainTree(&root, &arena, &dv, NULL); \
 	printf("%p\n", ret); \
 	printf("%d\n", !ret); \
 	assert(!ret == !(nilret))
@@ -483,10 +942,12 @@ static void test_duplicates()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("abc.www.somedomain.com", 1, true);
 
@@ -503,17 +964,19 @@ static void test_duplicates()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_prune3()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("abc.www.somedomain.com", 1, true);
 
@@ -530,17 +993,19 @@ static void test_prune3()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_prune2()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("www.somedomain.com", 1, true);
 
@@ -557,17 +1022,19 @@ static void test_prune2()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_weak3()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("abc.www.somedomain.com", 0, true);
 
@@ -584,17 +1051,19 @@ static void test_weak3()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_weak2()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("www.somedomain.com", 0, true);
 
@@ -611,17 +1080,19 @@ static void test_weak2()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_unique_weak()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("abc.www.somedomain.com", 0, true);
 
@@ -649,17 +1120,19 @@ static void test_unique_weak()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_unique_weak2()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("go.abc.www.somedomain.com", 0, true);
 
@@ -687,17 +1160,19 @@ static void test_unique_weak2()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_unique_weak_strong()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("abc.www.somedomain.com", 0, true);
 
@@ -725,17 +1200,19 @@ static void test_unique_weak_strong()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_unique_weak_to_strong()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("go.abc.www.somedomain.com", 1, true);
 
@@ -763,17 +1240,19 @@ static void test_unique_weak_to_strong()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_replace_weak_w_strong()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("abc.www.weak-w-strong.com", 0, true);
 
@@ -789,44 +1268,60 @@ static void test_replace_weak_w_strong()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_uninitialized()
 {
 	DomainTree_t *root = NULL;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 	dv.linenumber = __LINE__;
 
 	update_DomainView(&dv, "abc.www.strong-o-weak.com",
 			strlen("abc.www.strong-o-weak.com"));
-	assert(!insert_DomainTree(&root, &dv));
+	InsertOutcome_t outcome;
+	assert(!insert_DomainTree(&root, &arena, &dv, &outcome));
+	assert(outcome == INSERT_SKIPPED);
 
 	dv.match_strength = MATCH_BOGUS;
-	assert(!insert_DomainTree(&root, &dv));
+	assert(!insert_DomainTree(&root, &arena, &dv, &outcome));
+	assert(outcome == INSERT_SKIPPED);
 
 	dv.match_strength = MATCH_FULL;
-	assert(insert_DomainTree(&root, &dv));
+	assert(insert_DomainTree(&root, &arena, &dv, &outcome));
+	assert(outcome == INSERT_NEW);
+
+	// identical, then a subdomain of the FULL match.
+	assert(!insert_DomainTree(&root, &arena, &dv, &outcome));
+	assert(outcome == INSERT_IDENTICAL);
+	update_DomainView(&dv, "x.abc.www.strong-o-weak.com",
+			strlen("x.abc.www.strong-o-weak.com"));
+	assert(!insert_DomainTree(&root, &arena, &dv, &outcome));
+	assert(outcome == INSERT_UNDER_FULL);
 	visit_DomainTree(root, &test_visitor, NULL);
 	assert(HASH_COUNT(root_visited) == 1);
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_strong_over_weak()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("abc.www.strong-o-weak.com", 1, true);
 
@@ -842,17 +1337,19 @@ static void test_strong_over_weak()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_e2e_discovered()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	/*
 	 * ,notlong.com,,0,samplebug,DNSBL_Compilation,1
@@ -888,38 +1385,51 @@ static void test_e2e_discovered()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_insert_stronger()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	INSERT_DOMAIN("cdn.lenzmx.com", 0, true);
 	INSERT_DOMAIN("lenzmx.com", 0, true);
+	assert(ret->di.match_strength == MATCH_WEAK);
+	assert(ret->di.file_index == 0);
+
+	// the DomainInfo held inline is overwritten by the stronger match
+	dv.file_index = 3;
 	INSERT_DOMAIN("lenzmx.com", 1, true);
+	assert(ret->di.match_strength == MATCH_FULL);
+	assert(ret->di.file_index == 3);
+	assert(ret->di.linenumber == dv.linenumber);
+	assert(!len_DomainChildren(&ret->children));
 
 	visit_DomainTree(root, &test_visitor, NULL);
 	assert(HASH_COUNT(root_visited) == 1);
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
 }
 
 static void test_e2e_discovered2()
 {
 	DomainTree_t *root = NULL, *ret;
 	DomainView_t dv;
+	Arena_t arena;
 	TestTable_t *t, *tmp;
 	assert(!root_visited);
 
 	init_DomainView(&dv);
+	init_Arena(&arena);
 
 	/*
 	 * ,01proxy.notlong.com,,0,samplebug,DNSBL_Compilation,1
@@ -968,7 +1478,232 @@ static void test_e2e_discovered2()
 	FREE_VISITED;
 
 	free_DomainView(&dv);
-	free_DomainTree(&root);
+	free_DomainTree(&root, &arena);
+}
+
+static void test_shards()
+{
+	DomainTree_t *root = NULL, *ret;
+	DomainTreeShards_t shards;
+	DomainView_t dv;
+	Arena_t arena;
+	TestTable_t *t, *tmp;
+	assert(!root_visited);
+
+	init_DomainView(&dv);
+	init_Arena(&arena);
+	init_DomainTreeShards(&shards, 3);
+
+	const char *domains[] = {"abc.www.somedomain.com", "www.example.org",
+		"somedomain.com", "ads.example.net", "x.ads.example.net",
+		"tracker.io", "example.org", "a.b.c.d"};
+	const MatchStrength_t strengths[] = {0, 0, 1, 1, 0, 0, 0, 0};
+	// 'x.ads.example.net' is below a full match
+	const bool inserted[] = {true, true, true, true, false, true, true, true};
+
+	for(size_t i = 0; i < 8; i++)
+	{
+		INSERT_DOMAIN(domains[i], strengths[i], inserted[i]);
+		size_t shard = shard_DomainTree(&shards, &dv);
+		assert(shard < shards.len_shards);
+		// the shard depends on the TLD alone
+		assert(shard == shard_DomainTree(&shards, &dv));
+		insert_DomainTreeShards(&shards, shard, &dv, NULL);
+	}
+
+	visit_DomainTree(root, &test_visitor, NULL);
+	const size_t expected = HASH_COUNT(root_visited);
+	assert(expected == 6);
+	FREE_VISITED;
+
+	DomainTree_t *merged = NULL;
+	Arena_t merged_arena;
+	init_Arena(&merged_arena);
+	size_t len_slabs = 0;
+	for(size_t i = 0; i < shards.len_shards; i++)
+	{
+		len_slabs += shards.arenas[i].len_slabs;
+	}
+	merge_DomainTreeShards(&shards, &merged, &merged_arena);
+	for(size_t i = 0; i < shards.len_shards; i++)
+	{
+		assert(!shards.arenas[i].slabs);
+	}
+	assert(merged_arena.len_slabs == len_slabs);
+	for(size_t i = 0; i < shards.len_shards; i++)
+	{
+		assert(!shards.roots[i]);
+	}
+
+	// identical to the tree built without shards
+	assert(len_DomainChildren(&merged->children) ==
+			len_DomainChildren(&root->children));
+
+	// known TLDs keep their slot in the merged root; 'd' has none.
+	DomainTree_t *const *tlds = ((DomainTreeRoot_t*)merged)->tlds;
+	const char *known[] = {"com", "org", "net", "io"};
+	for(size_t i = 0; i < 4; i++)
+	{
+		const size_t len = strlen(known[i]);
+		DomainTree_t *tld = tlds[find_TldTable(known[i], len)];
+		assert(tld);
+		assert(tld == find_DomainChildren(&merged->children,
+					hash_Label(known[i], len), known[i], len));
+	}
+	assert(find_TldTable("d", 1) == TLD_TABLE_NONE);
+	assert(find_DomainChildren(&merged->children, hash_Label("d", 1),
+				"d", 1));
+	visit_DomainTree(merged, &test_visitor, NULL);
+	assert(HASH_COUNT(root_visited) == expected);
+	FREE_VISITED;
+
+	free_DomainTreeShards(&shards);
+	assert(!shards.roots);
+	free_DomainView(&dv);
+	free_DomainTree(&root, &arena);
+	free_DomainTree(&merged, &merged_arena);
+}
+
+static bool test_drop_ads(char const *fqd, size_t len, void *context)
+{
+	size_t *calls = context;
+	(*calls)++;
+	assert(strlen(fqd) == len);
+	return !strncmp(fqd, "ads.", 4) || !strcmp(fqd, "tracker.io");
+}
+
+static void test_prune_DomainTree()
+{
+	DomainTree_t *root = NULL, *ret;
+	DomainView_t dv;
+	Arena_t arena;
+	TestTable_t *t, *tmp;
+	assert(!root_visited);
+
+	init_DomainView(&dv);
+	init_Arena(&arena);
+
+	INSERT_DOMAIN("ads.example.net", 0, true);
+	INSERT_DOMAIN("x.ads.example.net", 0, true);
+	INSERT_DOMAIN("example.net", 0, true);
+	INSERT_DOMAIN("tracker.io", 1, true);
+	INSERT_DOMAIN("www.ads.example.org", 0, true);
+
+	size_t calls = 0;
+	assert(prune_DomainTree(root, test_drop_ads, &calls) == 2);
+	// every domain is checked once; labels without a domain are not.
+	assert(calls == 5);
+
+	visit_DomainTree(root, &test_visitor, NULL);
+	assert(HASH_COUNT(root_visited) == 3);
+	HASH_FIND(hh, root_visited, "x.ads.example.net", 17, t);
+	assert(t);
+	HASH_FIND(hh, root_visited, "ads.example.net", 15, t);
+	assert(!t);
+	FREE_VISITED;
+
+	// nothing left to remove
+	assert(prune_DomainTree(root, test_drop_ads, &calls) == 0);
+	assert(prune_DomainTree(NULL, test_drop_ads, &calls) == 0);
+
+	free_DomainView(&dv);
+	free_DomainTree(&root, &arena);
+}
+
+static size_t count_nodes(DomainChildren_t const *children)
+{
+	size_t count = 0, pos = 0;
+	DomainTree_t *dt;
+	while((dt = next_DomainChildren(children, &pos)))
+	{
+		count += 1 + count_nodes(&dt->children);
+	}
+	return count;
+}
+
+static void test_name_visitor(char const *fqd, size_t len,
+		DomainInfo_t const *di, void *context)
+{
+	size_t *calls = context;
+	(*calls)++;
+	assert(strlen(fqd) == len);
+	assert(len == di->len);
+	assert(!memcmp(fqd, di->fqd, len));
+}
+
+static void test_path_compression()
+{
+	DomainTree_t *root = NULL, *ret, *com;
+	DomainView_t dv;
+	Arena_t arena;
+	TestTable_t *t, *tmp;
+	InsertOutcome_t outcome;
+	size_t calls = 0;
+	assert(!root_visited);
+
+	init_DomainView(&dv);
+	init_Arena(&arena);
+
+	// a chain of single labels is one node keyed on the TLD.
+	INSERT_DOMAIN("a.b.c.example.com", 0, true);
+	assert(count_nodes(&root->children) == 1);
+	com = find_DomainChildren(&root->children, hash_Label("com", 3),
+			"com", 3);
+	assert(com);
+	assert(com->len_tail == 8 + 2 * 3);
+	assert(!len_DomainChildren(&com->children));
+
+	// ends within the run; split after 'b'.
+	INSERT_DOMAIN("b.c.example.com", 0, true);
+	assert(count_nodes(&root->children) == 2);
+
+	// branches off within the run; split after 'c'.
+	INSERT_DOMAIN("x.c.example.com", 0, true);
+	assert(count_nodes(&root->children) == 4);
+
+	visit_DomainTree(root, &test_visitor, NULL);
+	assert(HASH_COUNT(root_visited) == 3);
+	HASH_FIND(hh, root_visited, "a.b.c.example.com", 17, t);
+	assert(t);
+	FREE_VISITED;
+
+	assert(visit_names_DomainTree(root, test_name_visitor, &calls) == 3);
+	assert(calls == 3);
+
+	// matches the whole run of 'a'.
+	INSERT_DOMAIN("a.b.c.example.com", 0, false);
+
+	// a FULL parent at the end of a run drops everything below it.
+	INSERT_DOMAIN("c.example.com", 1, true);
+	assert(count_nodes(&root->children) == 1);
+
+	update_DomainView(&dv, "y.x.c.example.com", 17);
+	dv.match_strength = MATCH_WEAK;
+	assert(!insert_DomainTree(&root, &arena, &dv, &outcome));
+	assert(outcome == INSERT_UNDER_FULL);
+
+	update_DomainView(&dv, "c.example.com", 13);
+	dv.match_strength = MATCH_FULL;
+	assert(!insert_DomainTree(&root, &arena, &dv, &outcome));
+	assert(outcome == INSERT_IDENTICAL);
+
+	// a parent within the run of the FULL domain is not under it.
+	INSERT_DOMAIN("example.com", 0, true);
+	assert(count_nodes(&root->children) == 2);
+
+	visit_DomainTree(root, &test_visitor, NULL);
+	assert(HASH_COUNT(root_visited) == 2);
+	HASH_FIND(hh, root_visited, "c.example.com", 13, t);
+	assert(t);
+	HASH_FIND(hh, root_visited, "example.com", 11, t);
+	assert(t);
+	FREE_VISITED;
+
+	calls = 0;
+	assert(visit_names_DomainTree(root, test_name_visitor, &calls) == 2);
+
+	free_DomainView(&dv);
+	free_DomainTree(&root, &arena);
 }
 
 #undef INSERT_DOMAIN
@@ -996,5 +1731,8 @@ void test_DomainTree()
 	test_e2e_discovered();
 	test_e2e_discovered2();
 	test_insert_stronger();
+	test_shards();
+	test_prune_DomainTree();
+	test_path_compression();
 }
 #endif
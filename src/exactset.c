@@ -0,0 +1,236 @@
+/**
+ * exactset.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "exactset.h"
+#include "logdiagnostics.h"
+
+static const size_t INITIAL_EXACT_SLOTS = 1 << 14;
+
+/**
+ * Hash the key eight bytes at a time. Never returns zero.
+ */
+static uint64_t hash_key(char const *key, size_t len)
+{
+	uint64_t h = len * 0x9e3779b97f4a7c15ULL;
+	while(len >= sizeof(uint64_t))
+	{
+		uint64_t v;
+		memcpy(&v, key, sizeof(uint64_t));
+		h = (h ^ v) * 0xc2b2ae3d27d4eb4fULL;
+		h ^= h >> 29;
+		key += sizeof(uint64_t);
+		len -= sizeof(uint64_t);
+	}
+
+	uint64_t last = 0;
+	memcpy(&last, key, len);
+	h = (h ^ last) * 0xc2b2ae3d27d4eb4fULL;
+	h ^= h >> 32;
+
+	return h ? h : 1;
+}
+
+static ExactSlot_t *alloc_slots(size_t alloc)
+{
+	ExactSlot_t *slots = calloc(alloc, sizeof(ExactSlot_t));
+	if(!slots)
+	{
+		ELOG_STDERR("ERROR: failed to allocate ExactSet\n");
+		exit(EXIT_FAILURE);
+	}
+	return slots;
+}
+
+void init_ExactSet(ExactSet_t *es)
+{
+	ASSERT(es);
+
+	es->alloc = INITIAL_EXACT_SLOTS;
+	es->slots = alloc_slots(es->alloc);
+	es->len = 0;
+	init_Arena(&es->arena);
+	es->probes = 0;
+	es->hits = 0;
+}
+
+void free_ExactSet(ExactSet_t *es)
+{
+	ASSERT(es);
+
+#ifdef COLLECT_DIAGNOSTICS
+	if(es->probes)
+	{
+		LOG_DIAG("ExactSet", es,
+				"dropped %lu of %lu lines (%.1f%%) as exact duplicates; held %lu domains in %lu slots.\n\n",
+				es->hits, es->probes, 100.0 * es->hits / es->probes, es->len,
+				es->alloc);
+	}
+#endif
+
+	free(es->slots);
+	free_Arena(&es->arena);
+	memset(es, 0, sizeof(ExactSet_t));
+}
+
+/**
+ * Returns the slot of the key or the empty slot it belongs in.
+ */
+static ExactSlot_t *find_slot(ExactSlot_t *slots, size_t alloc, uint64_t hash,
+		char const *key, size_t len)
+{
+	const size_t mask = alloc - 1;
+	for(size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		ExactSlot_t *slot = &slots[i];
+		if(!slot->hash || (slot->hash == hash && slot->len == len &&
+					!memcmp(slot->key, key, len)))
+		{
+			return slot;
+		}
+	}
+}
+
+static void grow_ExactSet(ExactSet_t *es)
+{
+	const size_t alloc = es->alloc * 2;
+	ExactSlot_t *slots = alloc_slots(alloc);
+
+	for(size_t i = 0; i < es->alloc; i++)
+	{
+		ExactSlot_t const *old = &es->slots[i];
+		if(old->hash)
+		{
+			*find_slot(slots, alloc, old->hash, old->key, old->len) = *old;
+		}
+	}
+
+	free(es->slots);
+	es->slots = slots;
+	es->alloc = alloc;
+}
+
+/**
+ * Returns true when the domain is held with a match at least as strong as the
+ * given one, i.e., inserting it again would change nothing.
+ */
+bool held_ExactSet(ExactSet_t *es, char const *key, size_t len,
+		MatchStrength_t ms)
+{
+	ASSERT(es);
+
+	if(ms != MATCH_WEAK && ms != MATCH_FULL)
+	{
+		return false;
+	}
+
+	es->probes++;
+	ExactSlot_t const *slot = find_slot(es->slots, es->alloc,
+			hash_key(key, len), key, len);
+	if(slot->hash && slot->match_strength >= ms)
+	{
+		es->hits++;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Remember the domain with the given match; a stronger match replaces a weaker
+ * one held.
+ */
+void insert_ExactSet(ExactSet_t *es, char const *key, size_t len,
+		MatchStrength_t ms)
+{
+	ASSERT(es);
+	ASSERT(key);
+	ASSERT(len && len <= UINT32_MAX);
+
+	// at most half full so probe sequences stay short.
+	if((es->len + 1) * 2 > es->alloc)
+	{
+		grow_ExactSet(es);
+	}
+
+	const uint64_t hash = hash_key(key, len);
+	ExactSlot_t *slot = find_slot(es->slots, es->alloc, hash, key, len);
+	if(!slot->hash)
+	{
+		slot->hash = hash;
+		slot->key = copy_Arena(&es->arena, key, len);
+		slot->len = len;
+		slot->match_strength = ms;
+		es->len++;
+	}
+	else if(ms > slot->match_strength)
+	{
+		slot->match_strength = ms;
+	}
+}
+
+#ifdef BUILD_TESTS
+void test_ExactSet()
+{
+	ExactSet_t es;
+	init_ExactSet(&es);
+
+	assert(!held_ExactSet(&es, "www.example.com", 15, MATCH_WEAK));
+	insert_ExactSet(&es, "www.example.com", 15, MATCH_WEAK);
+	assert(held_ExactSet(&es, "www.example.com", 15, MATCH_WEAK));
+	assert(!held_ExactSet(&es, "www.example.com", 15, MATCH_FULL));
+	// a prefix or suffix of the key is a different domain.
+	assert(!held_ExactSet(&es, "www.example.co", 14, MATCH_WEAK));
+	assert(!held_ExactSet(&es, "ww.example.com", 14, MATCH_WEAK));
+	// never held, whatever the strength.
+	assert(!held_ExactSet(&es, "www.example.com", 15, MATCH_REGEX));
+	assert(!held_ExactSet(&es, "www.example.com", 15, MATCH_BOGUS));
+
+	insert_ExactSet(&es, "www.example.com", 15, MATCH_FULL);
+	assert(held_ExactSet(&es, "www.example.com", 15, MATCH_FULL));
+	// a weaker match does not replace a stronger one.
+	insert_ExactSet(&es, "www.example.com", 15, MATCH_WEAK);
+	assert(held_ExactSet(&es, "www.example.com", 15, MATCH_FULL));
+	assert(es.len == 1);
+
+	// enough to grow the slots several times; keys are copied.
+	char key[32];
+	const size_t count = INITIAL_EXACT_SLOTS * 4;
+	for(size_t i = 0; i < count; i++)
+	{
+		const int len = snprintf(key, sizeof(key), "d%lu.example.org", i);
+		insert_ExactSet(&es, key, len, i % 2 ? MATCH_FULL : MATCH_WEAK);
+	}
+	memset(key, 0, sizeof(key));
+	assert(es.len == count + 1);
+	assert(es.alloc >= es.len * 2);
+
+	for(size_t i = 0; i < count; i++)
+	{
+		const int len = snprintf(key, sizeof(key), "d%lu.example.org", i);
+		assert(held_ExactSet(&es, key, len, MATCH_WEAK));
+		assert(held_ExactSet(&es, key, len, MATCH_FULL) == (i % 2 == 1));
+	}
+	assert(held_ExactSet(&es, "www.example.com", 15, MATCH_FULL));
+	assert(es.hits <= es.probes);
+
+	free_ExactSet(&es);
+	assert(!es.slots && !es.len);
+}
+#endif
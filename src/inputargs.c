@@ -19,11 +19,13 @@
  * limitations under the License.
  */
 #include "inputargs.h"
+#include "unbound.h"
 #include "version.nogit.h"
 #include <unistd.h>
 #include <getopt.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #define ELOG_IFARGS(args, fmt, ...) do { \
 	open_logfile(args); \
@@ -104,6 +106,20 @@ typedef struct globalLog
 
 static globalLog_t *global_errLog = NULL;
 static globalLog_t *global_stdLog = NULL;
+// log files are opened on the first message and kept open until freed;
+// serializes writes to them from the log writer and from threads that log
+// directly.
+static pthread_mutex_t global_logLock = PTHREAD_MUTEX_INITIALIZER;
+
+void lock_globalLogs()
+{
+	pthread_mutex_lock(&global_logLock);
+}
+
+void unlock_globalLogs()
+{
+	pthread_mutex_unlock(&global_logLock);
+}
 
 void open_globalErrLog()
 {
@@ -144,6 +160,7 @@ void free_globalErrLog()
 {
 	if(global_errLog)
 	{
+		close_globalErrLog();
 		free(global_errLog);
 		global_errLog = NULL;
 	}
@@ -188,6 +205,7 @@ void free_globalStdLog()
 {
 	if(global_stdLog)
 	{
+		close_globalStdLog();
 		free(global_stdLog);
 		global_stdLog = NULL;
 	}
@@ -245,6 +263,7 @@ void init_input_args(input_args_t *iargs)
 	iargs->out_ext = ".txt";
 	iargs->outFile = stdout;
 	iargs->errFile = stderr;
+	iargs->num_threads = 1;
 }
 
 void free_input_args(input_args_t *iargs)
@@ -269,16 +288,31 @@ bool silent_mode(const input_args_t *iargs)
 	return (iargs->silent_flag && !iargs->log_flag);
 }
 
+// long options have no single character equivalent.
+enum { OPT_STATS = 256, OPT_SNAPSHOT, OPT_ENGINE, OPT_UNBOUND, OPT_SINKHOLE,
+	OPT_STATS_FILE };
+
+static const struct option LONG_OPTIONS[] = {
+	{ "stats", required_argument, NULL, OPT_STATS },
+	{ "snapshot", required_argument, NULL, OPT_SNAPSHOT },
+	{ "engine", required_argument, NULL, OPT_ENGINE },
+	{ "unbound", required_argument, NULL, OPT_UNBOUND },
+	{ "sinkhole", required_argument, NULL, OPT_SINKHOLE },
+	{ "stats-file", required_argument, NULL, OPT_STATS_FILE },
+	{ NULL, 0, NULL, 0 }
+};
+
 /**
  * getopt() dictates const-signature of 'argv'.
  */
 static bool do_parse_input_args(int argc, char * const* argv, input_args_t *iargs)
 {
 	int errorFlag = 0;
-	char opt;
+	int opt;
 
-	// getopt(int, char * const *, char const *);
-	while(errorFlag == 0 && (opt = getopt(argc, argv, ":vstbL:i:r:d:x:o:E:")) != -1)
+	// getopt_long(int, char * const *, char const *, struct option const *, int *);
+	while(errorFlag == 0 && (opt = getopt_long(argc, argv,
+					":vstbmpRL:j:d:x:o:E:", LONG_OPTIONS, NULL)) != -1)
 	{
 		switch(opt)
 		{
@@ -288,6 +322,15 @@ static bool do_parse_input_args(int argc, char * const* argv, input_args_t *iarg
 			case 's':
 				iargs->silent_flag = true;
 				break;
+			case 'm':
+				iargs->use_mmap = true;
+				break;
+			case 'p':
+				iargs->use_spans = true;
+				break;
+			case 'R':
+				iargs->prune_regex = true;
+				break;
 			case 'L':
 				iargs->log_flag = true;
 				iargs->log_fname = optarg;
@@ -296,27 +339,11 @@ static bool do_parse_input_args(int argc, char * const* argv, input_args_t *iarg
 				iargs->errLog_flag = true;
 				iargs->errLog_fname = optarg;
 				break;
-			case 'i': // # elements for initial alloc buffer
-				if(!iargs->override_buffersize)
+			case 'j': // # threads to read input files and write output files
+				iargs->num_threads = atoi(optarg);
+				if(iargs->num_threads < 1)
 				{
-					iargs->override_buffersize = true;
-					iargs->initial_buffer_size = atoi(optarg);
-				}
-				else
-				{
-					ELOG_IFARGS(iargs, "Option -i (override initial DomainInfo buffer size) is expected at most once.\n");
-					errorFlag++;
-				}
-				break;
-			case 'r': // # elements for realloc buffers
-				if(!iargs->override_reallocsize)
-				{
-					iargs->override_reallocsize = true;
-					iargs->realloc_buffer_size = atoi(optarg);
-				}
-				else
-				{
-					ELOG_IFARGS(iargs, "Option -r (override realloc DomainInfo buffer size) is expected at most once.\n");
+					ELOG_IFARGS(iargs, "Option -j (number of threads) must be at least 1.\n");
 					errorFlag++;
 				}
 				break;
@@ -341,21 +368,76 @@ static bool do_parse_input_args(int argc, char * const* argv, input_args_t *iarg
 				iargs->out_ext_flag = true;
 				iargs->out_ext = optarg;
 				break;
+			case OPT_STATS:
+				if(strcmp(optarg, "json") != 0)
+				{
+					ELOG_IFARGS(iargs, "Option --stats supports only 'json'.\n");
+					errorFlag++;
+				}
+				iargs->stats_json = true;
+				break;
+			case OPT_STATS_FILE:
+				iargs->stats_json = true;
+				iargs->stats_fname = optarg;
+				break;
+			case OPT_SNAPSHOT:
+				iargs->snapshot_flag = true;
+				iargs->snapshot_fname = optarg;
+				break;
+			case OPT_ENGINE:
+				if(strcmp(optarg, "sort") == 0)
+				{
+					iargs->sort_engine = true;
+				}
+				else if(strcmp(optarg, "tree") == 0)
+				{
+					iargs->sort_engine = false;
+				}
+				else
+				{
+					ELOG_IFARGS(iargs, "Option --engine supports only 'tree' or 'sort'.\n");
+					errorFlag++;
+				}
+				break;
+			case OPT_UNBOUND:
+				iargs->unbound_flag = true;
+				iargs->unbound_fname = optarg;
+				break;
+			case OPT_SINKHOLE:
+				if(!valid_sinkhole(optarg))
+				{
+					ELOG_IFARGS(iargs, "Option --sinkhole requires an IPv4 or IPv6 address.\n");
+					errorFlag++;
+				}
+				iargs->sinkhole = optarg;
+				break;
 			case ':':
-				ELOG_IFARGS(iargs, "Option -%c requires an operand\n", optopt);
+				if(optopt >= OPT_STATS && optopt <= OPT_STATS_FILE)
+				{
+					ELOG_IFARGS(iargs, "Option --%s requires an operand\n",
+							LONG_OPTIONS[optopt - OPT_STATS].name);
+				}
+				else
+				{
+					ELOG_IFARGS(iargs, "Option -%c requires an operand\n", optopt);
+				}
 				errorFlag++;
 				break;
 			case '?':
 			default:
 				ELOG_IFARGS(iargs, "Usage: %s "
-						"[-vstb] "
+						"[-vstbmpR] "
 						"[-L <log file>] "
 						"[-E <errlog file>] "
-						"[-i <NUMBER>] "
-						"[-r <NUMBER>] "
+						"[-j <threads>] "
 						"[-d <directory>] "
 						"[-x .<in ext>] "
 						"[-o .<out ext>] "
+						"[--stats=json] "
+						"[--stats-file=<file>] "
+						"[--snapshot=<file>] "
+						"[--engine=tree|sort] "
+						"[--unbound=<file> [--sinkhole=<address>]] "
 						"[file1, file2, ...] "
 						"\n", argv[0]);
 				errorFlag++;
@@ -368,6 +450,18 @@ static bool do_parse_input_args(int argc, char * const* argv, input_args_t *iarg
 		return false;
 	}
 
+	if(iargs->sinkhole && !iargs->unbound_flag)
+	{
+		ELOG_IFARGS(iargs, "Option --sinkhole requires --unbound.\n");
+		return false;
+	}
+
+	// stdout is left to the JSON alone.
+	if(iargs->stats_json && !iargs->stats_fname)
+	{
+		iargs->silent_flag = true;
+	}
+
 	if(iargs->log_flag)
 	{
 		if(!open_logfile(iargs))
@@ -705,19 +799,11 @@ static void test_do_parse_input_args()
 	char *argsin1[] = {"prog.real", "-t"};
 	TC_DPIA(2, argsin1, args, true);
 	assert(args.runtests);
-	assert(!args.override_reallocsize);
-	assert(args.realloc_buffer_size == 0);
-	assert(!args.override_buffersize);
-	assert(args.initial_buffer_size == 0);
 	assert(!silent_mode(&args));
 
 	char *argsin2[] = {"prog2.real", "-s", "-d", "./tests/001_inputs"};
 	TC_DPIA(4, argsin2, args, true);
 	assert(!args.runtests);
-	assert(!args.override_reallocsize);
-	assert(args.realloc_buffer_size == 0);
-	assert(!args.override_buffersize);
-	assert(args.initial_buffer_size == 0);
 	assert(args.dir_flag);
 	// file names are parsed later
 	assert(!args.filenames);
@@ -729,19 +815,12 @@ static void test_do_parse_input_args()
 	char *argsin3[] = {"prog3.real", "-s", "-d"};
 	TC_DPIA(3, argsin3, args, false);
 
-	char *argsin4[] = {"prog4.real", "-t", "-i44"};
-	TC_DPIA(3, argsin4, args, true);
-	assert(args.override_buffersize);
-	assert(args.initial_buffer_size == 44);
-	assert(!args.override_reallocsize);
-	assert(args.realloc_buffer_size == 0);
+	// the DomainInfo buffer sizes are no longer tunable.
+	char *argsin4[] = {"prog4.real", "-t", "-i"};
+	TC_DPIA(3, argsin4, args, false);
 
-	char *argsin5[] = {"prog5.real", "-t", "-r51"};
-	TC_DPIA(3, argsin5, args, true);
-	assert(args.override_reallocsize);
-	assert(args.realloc_buffer_size == 51);
-	assert(!args.override_buffersize);
-	assert(args.initial_buffer_size == 0);
+	char *argsin5[] = {"prog5.real", "-t", "-r"};
+	TC_DPIA(3, argsin5, args, false);
 
 	char *argsin6[] = {"prog6.real", "-x.nothere", "file1"};
 	TC_DPIA(3, argsin6, args, true);
@@ -797,6 +876,80 @@ static void test_do_parse_input_args()
 	assert(strcmp(args.inp_ext, ".input") == 0);
 	assert(strcmp(args.out_ext, "output") == 0);
 
+	char *argsin14[] = {"prog14.real", "-j", "4", "file1"};
+	TC_DPIA(4, argsin14, args, true);
+	assert(args.num_threads == 4);
+
+	char *argsin15[] = {"prog15.real", "-j0", "file1"};
+	TC_DPIA(3, argsin15, args, false);
+
+	char *argsin16[] = {"prog16.real", "file1"};
+	TC_DPIA(2, argsin16, args, true);
+	assert(args.num_threads == 1);
+	assert(!args.use_mmap);
+
+	char *argsin17[] = {"prog17.real", "-m", "file1"};
+	TC_DPIA(3, argsin17, args, true);
+	assert(args.use_mmap);
+	assert(!args.use_spans);
+
+	char *argsin18[] = {"prog18.real", "-mp", "file1"};
+	TC_DPIA(3, argsin18, args, true);
+	assert(args.use_mmap);
+	assert(args.use_spans);
+	assert(!args.prune_regex);
+
+	char *argsin19[] = {"prog19.real", "-R", "file1"};
+	TC_DPIA(3, argsin19, args, true);
+	assert(args.prune_regex);
+	assert(!args.stats_json);
+
+	char *argsin20[] = {"prog20.real", "--stats=json", "file1"};
+	TC_DPIA(3, argsin20, args, true);
+	assert(args.stats_json);
+	assert(!args.stats_fname);
+	assert(args.silent_flag);
+
+	char *argsin21[] = {"prog21.real", "--stats=xml", "file1"};
+	TC_DPIA(3, argsin21, args, false);
+
+	char *argsin22[] = {"prog22.real", "--snapshot", "state.snap", "file1"};
+	TC_DPIA(4, argsin22, args, true);
+	assert(args.snapshot_flag);
+	assert(!strcmp(args.snapshot_fname, "state.snap"));
+	assert(!args.sort_engine);
+
+	char *argsin23[] = {"prog23.real", "--engine=sort", "file1"};
+	TC_DPIA(3, argsin23, args, true);
+	assert(args.sort_engine);
+
+	char *argsin24[] = {"prog24.real", "--engine=heap", "file1"};
+	TC_DPIA(3, argsin24, args, false);
+
+	char *argsin25[] = {"prog25.real", "--unbound=pfb_dnsbl.conf", "file1"};
+	TC_DPIA(3, argsin25, args, true);
+	assert(args.unbound_flag);
+	assert(!strcmp(args.unbound_fname, "pfb_dnsbl.conf"));
+	assert(!args.sinkhole);
+
+	char *argsin26[] = {"prog26.real", "--unbound=u.conf", "--sinkhole=10.10.10.1",
+		"file1"};
+	TC_DPIA(4, argsin26, args, true);
+	assert(!strcmp(args.sinkhole, "10.10.10.1"));
+
+	char *argsin27[] = {"prog27.real", "--unbound=u.conf", "--sinkhole=blarg",
+		"file1"};
+	TC_DPIA(4, argsin27, args, false);
+
+	char *argsin28[] = {"prog28.real", "--stats-file=stats.json", "file1"};
+	TC_DPIA(3, argsin28, args, true);
+	assert(args.stats_json);
+	assert(!strcmp(args.stats_fname, "stats.json"));
+	assert(!args.silent_flag);
+
+	char *argsin29[] = {"prog29.real", "--sinkhole=10.10.10.1", "file1"};
+	TC_DPIA(3, argsin29, args, false);
+
 	free_input_args(&args);
 }
 
@@ -846,14 +999,14 @@ static void test_duped_args()
 	input_args_t args;
 	init_input_args(&args);
 
-	char *arg1[] = {"duped1.real", "-d", "./tests/001_inputs", "-i", "100", "-r", "500", "-x", ".xyz", "-i", "10"};
-	TC_DPIA(11, arg1, args, false);
+	// options given more than once take the last value.
+	char *arg1[] = {"duped1.real", "-d", "./tests/001_inputs", "-x", ".xyz", "-o", ".wat", "-x", ".abc"};
+	TC_DPIA(9, arg1, args, true);
+	assert(!strcmp(args.inp_ext, ".abc"));
+	assert(!strcmp(args.out_ext, ".wat"));
 
-	char *arg2[] = {"duped2.real", "-d", "./tests/001_inputs", "-r", "100", "-i", "500", "-r", "20", "-o", ".wat"};
-	TC_DPIA(11, arg2, args, false);
-
-	char *arg3[] = {"duped3.real", "-d", "./tests/001_inputs", "-$", "-i", "500", "-r", "20", "-o", ".wat"};
-	TC_DPIA(11, arg3, args, false);
+	char *arg2[] = {"duped2.real", "-d", "./tests/001_inputs", "-$", "-x", ".xyz", "-o", ".wat"};
+	TC_DPIA(8, arg2, args, false);
 
 	free_input_args(&args);
 }
@@ -934,6 +1087,9 @@ static void test_parse_input()
 
 static void test_errLog()
 {
+	// the global logs are swapped below; nothing may write to them meanwhile.
+	stop_AsyncLog();
+
 	// static initialized global variable
 	assert(!global_errLog);
 	assert(get_globalErrLog() == stderr);
@@ -980,6 +1136,8 @@ static void test_errLog()
 	free_input_args(&args);
 	free(global_errLog);
 	global_errLog = NULL;
+
+	start_AsyncLog();
 }
 
 void test_input_args()
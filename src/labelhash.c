@@ -0,0 +1,184 @@
+/**
+ * labelhash.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "labelhash.h"
+#include "uthash.h"
+
+static const uint64_t WY_P0 = 0xa0761d6478bd642fULL;
+static const uint64_t WY_P1 = 0xe7037ed1a0b428dbULL;
+
+static uint64_t wymix(uint64_t a, uint64_t b)
+{
+	const __uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static uint64_t read8(unsigned char const *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t read4(unsigned char const *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/**
+ * Short key hash after wyhash. Labels of up to 16 bytes, nearly all of them,
+ * are read as at most four overlapping words and mixed with two multiplies.
+ */
+uint32_t hash_label_wy(char const *label, size_t len)
+{
+	unsigned char const *p = (unsigned char const*)label;
+	uint64_t seed = WY_P0, a, b;
+
+	if(len <= 16)
+	{
+		if(len >= 4)
+		{
+			const size_t mid = (len >> 3) << 2;
+			a = (read4(p) << 32) | read4(p + mid);
+			b = (read4(p + len - 4) << 32) | read4(p + len - 4 - mid);
+		}
+		else if(len > 0)
+		{
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) |
+				p[len - 1];
+			b = 0;
+		}
+		else
+		{
+			a = b = 0;
+		}
+	}
+	else
+	{
+		size_t left = len;
+		while(left > 16)
+		{
+			seed = wymix(read8(p) ^ WY_P1, read8(p + 8) ^ seed);
+			p += 16;
+			left -= 16;
+		}
+		// the last 16 bytes of the label; may overlap those already read.
+		a = read8(p + left - 16);
+		b = read8(p + left - 8);
+	}
+
+	return (uint32_t)wymix(WY_P1 ^ len, wymix(a ^ WY_P1, b ^ seed));
+}
+
+/**
+ * 32 bit FNV-1a; one multiply per byte.
+ */
+uint32_t hash_label_fnv(char const *label, size_t len)
+{
+	uint32_t h = 0x811c9dc5u;
+	for(size_t i = 0; i < len; i++)
+	{
+		h = (h ^ (unsigned char)label[i]) * 0x01000193u;
+	}
+	return h;
+}
+
+/**
+ * Bob Jenkins' hash as used by uthash.
+ */
+uint32_t hash_label_jen(char const *label, size_t len)
+{
+	unsigned hashv;
+	HASH_JEN(label, len, hashv);
+	return hashv;
+}
+
+/**
+ * Hash of a label selected by LABEL_HASH. Never returns zero so zero may mark
+ * an empty slot.
+ */
+uint32_t hash_Label(char const *label, size_t len)
+{
+#if LABEL_HASH == LABEL_HASH_WY
+	const uint32_t h = hash_label_wy(label, len);
+#elif LABEL_HASH == LABEL_HASH_FNV
+	const uint32_t h = hash_label_fnv(label, len);
+#elif LABEL_HASH == LABEL_HASH_JEN
+	const uint32_t h = hash_label_jen(label, len);
+#else
+#error "unknown LABEL_HASH"
+#endif
+	return h ? h : 1;
+}
+
+char const *name_LabelHash()
+{
+#if LABEL_HASH == LABEL_HASH_WY
+	return "wy";
+#elif LABEL_HASH == LABEL_HASH_FNV
+	return "fnv";
+#else
+	return "jen";
+#endif
+}
+
+#ifdef BUILD_TESTS
+void test_LabelHash()
+{
+	uint32_t (*const hashes[])(char const*, size_t) = { hash_label_wy,
+		hash_label_fnv, hash_label_jen };
+
+	// every length up to a long label; only the given bytes are read.
+	char label[80];
+	for(size_t f = 0; f < 3; f++)
+	{
+		for(size_t len = 0; len <= sizeof(label); len++)
+		{
+			char *copy = malloc(len ? len : 1);
+			assert(copy);
+			for(size_t i = 0; i < len; i++)
+			{
+				copy[i] = label[i] = 'a' + (i * 7) % 26;
+			}
+
+			const uint32_t h = hashes[f](copy, len);
+			assert(h == hashes[f](label, len));
+
+			// a change of any one byte changes the hash.
+			for(size_t i = 0; i < len; i++)
+			{
+				copy[i] ^= 1;
+				assert(hashes[f](copy, len) != h);
+				copy[i] ^= 1;
+			}
+
+			// the length is part of the hash.
+			if(len)
+			{
+				assert(hashes[f](copy, len - 1) != h);
+			}
+			free(copy);
+		}
+	}
+}
+#endif
@@ -0,0 +1,237 @@
+/**
+ * linebitmap.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "linebitmap.h"
+
+static const size_t INITIAL_LINE_BITMAP_WORDS = 1024;
+
+/**
+ * Initialize the given LineBitmap_t with no lines set. Calls to
+ * free_LineBitmap() are safe after calling this.
+ */
+void init_LineBitmap(LineBitmap_t *lb)
+{
+	ASSERT(lb);
+	lb->words = NULL;
+	lb->len_words = 0;
+	lb->count = 0;
+}
+
+void free_LineBitmap(LineBitmap_t *lb)
+{
+	ASSERT(lb);
+	free(lb->words);
+	init_LineBitmap(lb);
+}
+
+/**
+ * Mark the given line as kept. The bitmap grows to hold the line as needed.
+ */
+void set_LineBitmap(LineBitmap_t *lb, linenumber_t ln)
+{
+	ASSERT(lb);
+	ASSERT(ln > 0);
+
+	const size_t word = ln / 64;
+	if(word >= lb->len_words)
+	{
+		size_t len_words = lb->len_words ? lb->len_words : INITIAL_LINE_BITMAP_WORDS;
+		while(len_words <= word)
+		{
+			len_words *= 2;
+		}
+
+		uint64_t *tmp = realloc(lb->words, sizeof(uint64_t) * len_words);
+		if(!tmp)
+		{
+			free_LineBitmap(lb);
+			ELOG_STDERR("ERROR: failed to realloc LineBitmap\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(tmp + lb->len_words, 0,
+				sizeof(uint64_t) * (len_words - lb->len_words));
+		lb->words = tmp;
+		lb->len_words = len_words;
+	}
+
+	const uint64_t bit = (uint64_t)1 << (ln % 64);
+	if(!(lb->words[word] & bit))
+	{
+		lb->words[word] |= bit;
+		lb->count++;
+	}
+}
+
+bool has_LineBitmap(LineBitmap_t const *lb, linenumber_t ln)
+{
+	ASSERT(lb);
+	const size_t word = ln / 64;
+	return word < lb->len_words && (lb->words[word] >> (ln % 64)) & 1;
+}
+
+/**
+ * Returns the first kept line after the given line number or 0 if there is
+ * none. Pass 0 to get the first kept line.
+ */
+linenumber_t next_LineBitmap(LineBitmap_t const *lb, linenumber_t ln)
+{
+	ASSERT(lb);
+
+	size_t word = (size_t)ln / 64;
+	if(word >= lb->len_words)
+	{
+		return 0;
+	}
+
+	// drop the given line and those before it.
+	const uint shift = ln % 64;
+	uint64_t bits = shift == 63 ? 0 : lb->words[word] & (~(uint64_t)0 << (shift + 1));
+
+	while(!bits)
+	{
+		if(++word == lb->len_words)
+		{
+			return 0;
+		}
+		bits = lb->words[word];
+	}
+
+	return word * 64 + __builtin_ctzll(bits);
+}
+
+/**
+ * Returns the highest kept line or 0 if there is none.
+ */
+linenumber_t last_LineBitmap(LineBitmap_t const *lb)
+{
+	ASSERT(lb);
+
+	for(size_t word = lb->len_words; word > 0; word--)
+	{
+		const uint64_t bits = lb->words[word - 1];
+		if(bits)
+		{
+			return (word - 1) * 64 + 63 - __builtin_clzll(bits);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Returns true when both bitmaps have the same lines set regardless of how
+ * many words each has allocated.
+ */
+bool equal_LineBitmap(LineBitmap_t const *a, LineBitmap_t const *b)
+{
+	ASSERT(a);
+	ASSERT(b);
+
+	if(a->count != b->count)
+	{
+		return false;
+	}
+
+	LineBitmap_t const *longer = a->len_words > b->len_words ? a : b;
+	const size_t len_common = a->len_words < b->len_words ? a->len_words :
+		b->len_words;
+
+	if(len_common && memcmp(a->words, b->words, sizeof(uint64_t) * len_common))
+	{
+		return false;
+	}
+
+	for(size_t word = len_common; word < longer->len_words; word++)
+	{
+		if(longer->words[word])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#ifdef BUILD_TESTS
+void test_LineBitmap()
+{
+	LineBitmap_t lb;
+	memset(&lb, 0xf, sizeof(LineBitmap_t));
+
+	init_LineBitmap(&lb);
+	assert(!lb.words && !lb.len_words && !lb.count);
+	assert(!next_LineBitmap(&lb, 0));
+	assert(!last_LineBitmap(&lb));
+	assert(!has_LineBitmap(&lb, 1));
+
+	// out of order, repeated and far enough apart to grow more than once
+	const linenumber_t lines[] = {63, 1, 64, 65, 127, 128, 1, 64,
+		INITIAL_LINE_BITMAP_WORDS * 64 * 3 + 5};
+	const linenumber_t sorted[] = {1, 63, 64, 65, 127, 128,
+		INITIAL_LINE_BITMAP_WORDS * 64 * 3 + 5};
+
+	for(size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+	{
+		set_LineBitmap(&lb, lines[i]);
+	}
+
+	const size_t len_sorted = sizeof(sorted) / sizeof(sorted[0]);
+	assert(lb.count == len_sorted);
+	assert(lb.len_words > INITIAL_LINE_BITMAP_WORDS * 2);
+	assert(!has_LineBitmap(&lb, 2));
+	assert(!has_LineBitmap(&lb, lb.len_words * 64 + 1));
+
+	linenumber_t ln = 0;
+	for(size_t i = 0; i < len_sorted; i++)
+	{
+		ln = next_LineBitmap(&lb, ln);
+		assert(ln == sorted[i]);
+		assert(has_LineBitmap(&lb, ln));
+	}
+	assert(!next_LineBitmap(&lb, ln));
+	assert(last_LineBitmap(&lb) == ln);
+	assert(next_LineBitmap(&lb, 62) == 63);
+	assert(next_LineBitmap(&lb, 63) == 64);
+
+	LineBitmap_t other;
+	init_LineBitmap(&other);
+	assert(!equal_LineBitmap(&lb, &other));
+	for(size_t i = 0; i < len_sorted - 1; i++)
+	{
+		set_LineBitmap(&other, sorted[i]);
+	}
+	// same count, fewer words, different lines
+	set_LineBitmap(&other, 2);
+	assert(!equal_LineBitmap(&lb, &other));
+	free_LineBitmap(&other);
+
+	for(size_t i = 0; i < len_sorted; i++)
+	{
+		set_LineBitmap(&other, sorted[i]);
+	}
+	assert(equal_LineBitmap(&lb, &other));
+	assert(equal_LineBitmap(&other, &lb));
+	free_LineBitmap(&other);
+
+	free_LineBitmap(&lb);
+	assert(!lb.words && !lb.len_words && !lb.count);
+}
+#endif
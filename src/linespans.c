@@ -0,0 +1,117 @@
+/**
+ * linespans.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "linespans.h"
+
+static const linenumber_t INITIAL_LINE_SPANS = 4096;
+
+/**
+ * Initialize the given LineSpans_t to hold no spans. Calls to free_LineSpans()
+ * are safe after calling this.
+ */
+void init_LineSpans(LineSpans_t *ls)
+{
+	ASSERT(ls);
+	ls->spans = NULL;
+	ls->len = 0;
+	ls->alloc = 0;
+}
+
+void free_LineSpans(LineSpans_t *ls)
+{
+	ASSERT(ls);
+	free(ls->spans);
+	init_LineSpans(ls);
+}
+
+/**
+ * Record the span of the given line. Lines are expected in the order they are
+ * read: the line number is one more than the previous one recorded.
+ */
+void insert_LineSpans(LineSpans_t *ls, linenumber_t ln, size_t offset,
+		size_len_t len)
+{
+	ASSERT(ls);
+	ASSERT(ln == ls->len + 1);
+
+	if(ls->len == ls->alloc)
+	{
+		const linenumber_t alloc = ls->alloc ? ls->alloc * 2 : INITIAL_LINE_SPANS;
+		LineSpan_t *tmp = realloc(ls->spans, sizeof(LineSpan_t) * alloc);
+		if(!tmp)
+		{
+			free_LineSpans(ls);
+			ELOG_STDERR("ERROR: failed to realloc LineSpans\n");
+			exit(EXIT_FAILURE);
+		}
+		ls->spans = tmp;
+		ls->alloc = alloc;
+	}
+
+	ls->spans[ls->len].offset = offset;
+	ls->spans[ls->len].len = len;
+	ls->len++;
+}
+
+/**
+ * Returns the span of the given line number or NULL if it was not recorded.
+ */
+LineSpan_t const *get_LineSpans(LineSpans_t const *ls, linenumber_t ln)
+{
+	ASSERT(ls);
+	if(ln == 0 || ln > ls->len)
+	{
+		return NULL;
+	}
+	return &ls->spans[ln - 1];
+}
+
+#ifdef BUILD_TESTS
+void test_LineSpans()
+{
+	LineSpans_t ls, ls_zero;
+	memset(&ls_zero, 0, sizeof(LineSpans_t));
+	memset(&ls, 0xf, sizeof(LineSpans_t));
+
+	init_LineSpans(&ls);
+	assert(!memcmp(&ls, &ls_zero, sizeof(LineSpans_t)));
+	assert(!get_LineSpans(&ls, 1));
+
+	// enough lines to grow the array more than once
+	for(linenumber_t ln = 1; ln <= INITIAL_LINE_SPANS * 3; ln++)
+	{
+		insert_LineSpans(&ls, ln, ln * 10, ln % 100);
+	}
+
+	assert(ls.len == INITIAL_LINE_SPANS * 3);
+	assert(!get_LineSpans(&ls, 0));
+	assert(!get_LineSpans(&ls, ls.len + 1));
+	for(linenumber_t ln = 1; ln <= ls.len; ln++)
+	{
+		LineSpan_t const *span = get_LineSpans(&ls, ln);
+		assert(span->offset == ln * 10);
+		assert(span->len == ln % 100);
+	}
+
+	free_LineSpans(&ls);
+	assert(!memcmp(&ls, &ls_zero, sizeof(LineSpans_t)));
+}
+#endif
@@ -28,15 +28,16 @@
 #include "rw_pfb_csv.h"
 #include "pfb_prune.h"
 #include "inputargs.h"
+#include "scan.h"
+#include "runstats.h"
+#include "snapshot.h"
+#include "unbound.h"
 #include "test.h"
 #include <unistd.h>
 #include <getopt.h>
 #include <sys/stat.h>
 #include <dirent.h>
 
-extern void set_DomainInfo_array_size(int v);
-extern void set_realloc_DomainInfo_size(int v);
-
 int main(int argc, char *const * argv)
 {
 #if defined(RELEASE) || defined(RELEASE_LOGGING)
@@ -45,6 +46,9 @@ int main(int argc, char *const * argv)
 	assert(false && "smoke test for 'assert'");
 #endif
 
+	// pick the widest byte scanning the CPU supports before any threads start.
+	init_scan();
+
 	input_args_t flags;
 	init_input_args(&flags);
 
@@ -53,18 +57,33 @@ int main(int argc, char *const * argv)
 		exit(EXIT_FAILURE);
 	}
 
-	if(flags.override_buffersize)
+	// diagnostics are dropped in silent mode; errors are always logged. from
+	// here on a background thread writes the messages of all threads.
+	set_silent_AsyncLog(silent_mode(&flags));
+	start_AsyncLog();
+
+	if(flags.use_mmap)
+	{
+		LOG_IFARGS(&flags, "NOTE: Memory mapping input files\n");
+		set_read_mmap(true);
+	}
+
+	if(flags.use_spans)
 	{
-		LOG_IFARGS(&flags, "NOTE: Overriding initial buffer size to %d\n",
-					flags.initial_buffer_size);
-		set_DomainInfo_array_size(flags.initial_buffer_size);
+		LOG_IFARGS(&flags, "NOTE: Writing kept lines by their recorded offsets\n");
+		set_write_spans(true);
 	}
 
-	if(flags.override_reallocsize)
+	if(flags.prune_regex)
 	{
-		LOG_IFARGS(&flags, "NOTE: Overriding realloc buffer size to %d\n",
-				flags.realloc_buffer_size);
-		set_realloc_DomainInfo_size(flags.realloc_buffer_size);
+		LOG_IFARGS(&flags, "NOTE: Pruning domains matched by regexes\n");
+		set_prune_regex(true);
+	}
+
+	if(flags.sort_engine)
+	{
+		LOG_IFARGS(&flags, "NOTE: Deduplicating by sorting instead of the domain tree\n");
+		set_sort_engine(true);
 	}
 
 	if(!silent_mode(&flags))
@@ -89,6 +108,7 @@ int main(int argc, char *const * argv)
 	{
 		extern void run_tests();
 		run_tests();
+		stop_AsyncLog();
 		free_globalErrLog();
 		free_globalStdLog();
 		return 0;
@@ -100,11 +120,28 @@ int main(int argc, char *const * argv)
 		LOG_IFARGS(&flags, "Zero files to prune. Terminating..\n");
 
 		free_input_args(&flags);
+		stop_AsyncLog();
 		free_globalErrLog();
 		return 0;
 	}
 
 	const bool use_shared_buffer = flags.use_shared_buffer;
+	const size_t num_threads = (size_t)flags.num_threads;
+	const bool stats_json = flags.stats_json;
+	char const *const stats_fname = flags.stats_fname;
+	const bool sort_engine = flags.sort_engine;
+	char const *const snapshot_fname = flags.snapshot_flag ?
+		flags.snapshot_fname : NULL;
+	char const *const unbound_fname = flags.unbound_flag ?
+		flags.unbound_fname : NULL;
+	char const *const sinkhole = flags.sinkhole;
+
+	RunStats_t stats;
+	init_RunStats(&stats);
+	if(sort_engine)
+	{
+		stats.engine = "sort";
+	}
 
 	// iterate over the input arguments and create context for each one
 	pfb_contexts_t contexts = pfb_init_contexts(flags.num_files, flags.out_ext,
@@ -130,8 +167,27 @@ int main(int argc, char *const * argv)
 	ASSERT(contexts.begin_context->dt[0] == NULL);
 
 	// open the files to verify all files can be read. open output files to
-	// verify those can be written.
-	pfb_read_csv(&contexts);
+	// verify those can be written. inputs unchanged since the snapshot are
+	// replayed from it instead.
+	begin_RunStats(&stats);
+	Snapshot_t snap;
+	init_Snapshot(&snap);
+	if(snapshot_fname)
+	{
+		load_Snapshot(&snap, snapshot_fname);
+		attach_Snapshot(&snap, &contexts);
+	}
+
+	pfb_read_csv_parallel(&contexts, num_threads);
+	end_RunStats(&stats, PHASE_READ);
+
+	// regexes of all files apply to the domains of all files. the sort engine
+	// applies them while consolidating.
+	begin_RunStats(&stats);
+	if(!sort_engine)
+	{
+		pfb_prune_regex(&contexts);
+	}
 
 	// confirm that reading didn't bork a pointer
 	ASSERT(contexts.begin_context->dt);
@@ -144,38 +200,90 @@ int main(int argc, char *const * argv)
 		ASSERT(c->dt[0] == contexts.begin_context->dt[0]);
 	}
 
-	// the tree has the full set of DomainInfo. allocate a chunk of space to
-	// hold DomainInfo and grow as needed. move DomainInfo over to the new
-	// array. free the tree as items move to the array.
+	// the tree has the full set of DomainInfo. mark the line of each one in a
+	// bitmap of the FILE it was read from. free the tree as items are marked.
 	//
 	// the number of contexts is expected to be small enough to not be a problem.
-	//
-	// create an ArrayDomain_t for each context to collect the domains for each
-	// FILE to be written to.
 	ArrayDomainInfo_t array_di;
 	init_ArrayDomainInfo(&array_di, pfb_len_contexts(&contexts));
 	array_di.begin_pfb_context = contexts.begin_context;
 
-	pfb_consolidate(contexts.begin_context->dt, &array_di);
+	// the Unbound configuration is written from the consolidated domains
+	// while they are still at hand.
+	UnboundConf_t unbound;
+	const bool write_unbound = unbound_fname &&
+		open_UnboundConf(&unbound, unbound_fname, sinkhole);
+
+	if(sort_engine)
+	{
+		pfb_consolidate_sorted(&contexts, &array_di, num_threads,
+				write_unbound ? &unbound : NULL);
+	}
+	else
+	{
+		if(write_unbound)
+		{
+			pfb_write_unbound(&contexts, &unbound);
+		}
+		pfb_consolidate(contexts.begin_context->dt,
+				contexts.begin_context->arena, &array_di);
+	}
+
+	if(write_unbound && close_UnboundConf(&unbound))
+	{
+		write_AsyncLog(LOG_TARGET_STD,
+				"Wrote %lu zones and %lu records to %s\n", unbound.zones,
+				unbound.records, unbound_fname);
+	}
+	end_RunStats(&stats, PHASE_CONSOLIDATE);
 
 	// DomainTree is free'd during above consolidation
 	ASSERT(contexts.begin_context->dt);
 	ASSERT(!contexts.begin_context->dt[0]);
 
 	// write all unique domains to respective output files
-	pfb_write_csv(&contexts, &array_di, use_shared_buffer);
+	begin_RunStats(&stats);
+	pfb_write_csv_parallel(&contexts, &array_di, use_shared_buffer,
+			num_threads);
+	if(snapshot_fname)
+	{
+		save_Snapshot(&snap, snapshot_fname, &contexts, &array_di);
+	}
+	end_RunStats(&stats, PHASE_WRITE);
+
+#ifdef COLLECT_DIAGNOSTICS
+	LOG_STR("Collected %lu unique domains.\n", collected_domains_counter);
+#endif
+
+	// the log messages of the run come first. without a file, stdout is left
+	// to the JSON alone; see parse_input_args().
+	stop_AsyncLog();
+
+	if(stats_json)
+	{
+		FILE *out = stats_fname ? fopen(stats_fname, "w") : stdout;
+		if(out)
+		{
+			write_json_RunStats(out, &stats, &contexts);
+			if(out != stdout)
+			{
+				fclose(out);
+			}
+		}
+		else
+		{
+			ELOG_STDERR("ERROR: unable to open '%s' for writing.\n", stats_fname);
+		}
+	}
 
 	free_ArrayDomainInfo(&array_di);
 	pfb_free_contexts(&contexts);
+	free_Snapshot(&snap);
 
 	ASSERT(!contexts.begin_context);
 	ASSERT(!contexts.end_context);
 	ASSERT(!array_di.begin_pfb_context);
 
-#ifdef COLLECT_DIAGNOSTICS
-	LOG_STR("Collected %lu unique domains.\n", collected_domains_counter);
-#endif
-
 	free_globalErrLog();
 	free_globalStdLog();
 
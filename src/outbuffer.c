@@ -0,0 +1,206 @@
+/**
+ * outbuffer.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// posix_memalign() is hidden by -std=c17 otherwise
+#define _POSIX_C_SOURCE 200809L
+#include "dedupdomains.h"
+#include "outbuffer.h"
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+
+static const size_t OUT_BUFFER_SIZE = 1 << 20;
+static const size_t OUT_BUFFER_ALIGN = 4096;
+
+/**
+ * Initialize the given OutBuffer_t to write to the given file descriptor.
+ * Nothing is allocated until a line is appended. Calls to free_OutBuffer() are
+ * safe after calling this.
+ */
+void init_OutBuffer(OutBuffer_t *ob, int fd)
+{
+	ASSERT(ob);
+	ob->fd = fd;
+	ob->data = NULL;
+	ob->len = 0;
+	ob->alloc = 0;
+	ob->bytes = 0;
+	ob->syscalls = 0;
+}
+
+/**
+ * Release the buffer. Lines not yet flushed are dropped.
+ */
+void free_OutBuffer(OutBuffer_t *ob)
+{
+	ASSERT(ob);
+	free(ob->data);
+	init_OutBuffer(ob, -1);
+}
+
+/**
+ * write(2) all of the given bytes; retries short writes and interruptions.
+ */
+static int write_all(OutBuffer_t *ob, char const *data, size_t len)
+{
+	while(len)
+	{
+		const ssize_t wrote = write(ob->fd, data, len);
+		ob->syscalls++;
+		if(wrote < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		data += wrote;
+		len -= wrote;
+		ob->bytes += wrote;
+	}
+	return 0;
+}
+
+/**
+ * Write the buffered lines to the file. Returns 0 on success.
+ */
+int flush_OutBuffer(OutBuffer_t *ob)
+{
+	ASSERT(ob);
+
+	if(!ob->len)
+	{
+		return 0;
+	}
+
+	const int err = write_all(ob, ob->data, ob->len);
+	ob->len = 0;
+	return err;
+}
+
+/**
+ * Append the line and a newline to the buffer. The buffer is flushed when
+ * full; a line larger than the buffer is written directly after the flush.
+ * Returns 0 on success.
+ */
+int append_OutBuffer(OutBuffer_t *ob, char const *line, size_t len)
+{
+	ASSERT(ob);
+	ASSERT(line);
+	ASSERT(ob->fd >= 0);
+
+	if(!ob->data)
+	{
+		void *data = NULL;
+		if(posix_memalign(&data, OUT_BUFFER_ALIGN, OUT_BUFFER_SIZE))
+		{
+			ELOG_STDERR("ERROR: failed to allocate OutBuffer\n");
+			exit(EXIT_FAILURE);
+		}
+		ob->data = data;
+		ob->alloc = OUT_BUFFER_SIZE;
+	}
+
+	if(ob->len + len + 1 > ob->alloc && flush_OutBuffer(ob))
+	{
+		return -1;
+	}
+
+	// the newline starts the next batch.
+	if(len + 1 > ob->alloc)
+	{
+		if(write_all(ob, line, len))
+		{
+			return -1;
+		}
+		ob->data[ob->len++] = '\n';
+		return 0;
+	}
+
+	memcpy(ob->data + ob->len, line, len);
+	ob->data[ob->len + len] = '\n';
+	ob->len += len + 1;
+
+	return 0;
+}
+
+#ifdef BUILD_TESTS
+void test_OutBuffer()
+{
+	OutBuffer_t ob;
+	memset(&ob, 0xf, sizeof(OutBuffer_t));
+
+	FILE *f = tmpfile();
+	assert(f);
+
+	init_OutBuffer(&ob, fileno(f));
+	assert(!ob.data && !ob.len && !ob.bytes && !ob.syscalls);
+	assert(!flush_OutBuffer(&ob));
+	assert(!ob.syscalls);
+
+	// enough lines to fill the buffer more than once and one larger than it.
+	const char line[] = "line,of,some,length";
+	const size_t len_line = sizeof(line) - 1;
+	const size_t count = OUT_BUFFER_SIZE / len_line * 2;
+	char *huge = malloc(OUT_BUFFER_SIZE + 10);
+	memset(huge, 'h', OUT_BUFFER_SIZE + 10);
+
+	for(size_t i = 0; i < count; i++)
+	{
+		assert(!append_OutBuffer(&ob, line, len_line));
+		if(i == count / 3)
+		{
+			assert(!append_OutBuffer(&ob, huge, OUT_BUFFER_SIZE + 10));
+		}
+	}
+	assert(((uintptr_t)ob.data % OUT_BUFFER_ALIGN) == 0);
+	assert(!flush_OutBuffer(&ob));
+
+	const size_t expect = (len_line + 1) * count + OUT_BUFFER_SIZE + 11;
+	assert(ob.bytes == expect);
+	// a handful of batches instead of two calls per line
+	assert(ob.syscalls <= 6);
+
+	char *check = malloc(expect + 1);
+	rewind(f);
+	assert(fread(check, 1, expect + 1, f) == expect);
+	size_t pos = 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		assert(!memcmp(check + pos, line, len_line));
+		assert(check[pos + len_line] == '\n');
+		pos += len_line + 1;
+		if(i == count / 3)
+		{
+			assert(!memcmp(check + pos, huge, OUT_BUFFER_SIZE + 10));
+			assert(check[pos + OUT_BUFFER_SIZE + 10] == '\n');
+			pos += OUT_BUFFER_SIZE + 11;
+		}
+	}
+	assert(pos == expect);
+
+	free(check);
+	free(huge);
+	free_OutBuffer(&ob);
+	assert(!ob.data && ob.fd == -1);
+	fclose(f);
+}
+#endif
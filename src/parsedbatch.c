@@ -0,0 +1,330 @@
+/**
+ * parsedbatch.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "parsedbatch.h"
+#include "domain.h"
+
+// number of domains handed off at once. large enough to keep the hand off
+// between threads infrequent; small enough to not hold an entire file.
+static const size_t PARSED_BATCH_DOMAINS = 16384;
+static const size_t PARSED_BATCH_BYTES = 16384 * 24;
+static const size_t PARSED_BATCH_LABELS = 16384 * 4;
+
+void init_ParsedBatch(ParsedBatch_t *pb)
+{
+	ASSERT(pb);
+
+#ifdef USE_MEMSET
+	memset(pb, 0, sizeof(ParsedBatch_t));
+#else
+	pb->len_bytes = 0;
+	pb->len_labels = 0;
+	pb->len_domains = 0;
+	pb->next = NULL;
+	pb->pending = 0;
+#endif
+
+	pb->alloc_bytes = PARSED_BATCH_BYTES;
+	pb->bytes = malloc(sizeof(char) * pb->alloc_bytes);
+	if(!pb->bytes)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	pb->alloc_labels = PARSED_BATCH_LABELS;
+	pb->label_indexes = malloc(sizeof(size_len_t) * pb->alloc_labels);
+	pb->lengths = malloc(sizeof(uchar) * pb->alloc_labels);
+	pb->hashes = malloc(sizeof(uint32_t) * pb->alloc_labels);
+	if(!pb->label_indexes || !pb->lengths || !pb->hashes)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	pb->alloc_domains = PARSED_BATCH_DOMAINS;
+	pb->domains = malloc(sizeof(ParsedDomain_t) * pb->alloc_domains);
+	if(!pb->domains)
+	{
+		exit(EXIT_FAILURE);
+	}
+}
+
+void free_ParsedBatch(ParsedBatch_t *pb)
+{
+	ASSERT(pb);
+
+	free(pb->bytes);
+	free(pb->label_indexes);
+	free(pb->lengths);
+	free(pb->hashes);
+	free(pb->domains);
+
+	memset(pb, 0, sizeof(ParsedBatch_t));
+}
+
+/**
+ * Forget the domains held without releasing memory so the batch can be filled
+ * again.
+ */
+void reset_ParsedBatch(ParsedBatch_t *pb)
+{
+	ASSERT(pb);
+	pb->len_bytes = 0;
+	pb->len_labels = 0;
+	pb->len_domains = 0;
+	pb->next = NULL;
+	pb->pending = 0;
+}
+
+/**
+ * Returns true when the batch holds enough domains to be handed off.
+ */
+bool full_ParsedBatch(ParsedBatch_t const *pb)
+{
+	ASSERT(pb);
+	return pb->len_domains >= PARSED_BATCH_DOMAINS;
+}
+
+static void *grow_array(void *array, size_t *alloc, size_t need, size_t size)
+{
+	size_t n = *alloc;
+	while(n < need)
+	{
+		n *= 2;
+	}
+
+	void *tmp = realloc(array, size * n);
+	if(!tmp)
+	{
+		free(array);
+		ELOG_STDERR("ERROR: failed to realloc ParsedBatch\n");
+		exit(EXIT_FAILURE);
+	}
+
+	*alloc = n;
+	return tmp;
+}
+
+/**
+ * Copy the domain and its labels described by the given DomainView to the end
+ * of the batch. The DomainView may be reused immediately after.
+ */
+void append_ParsedBatch(ParsedBatch_t *pb, DomainView_t const *dv,
+		size_t shard)
+{
+	ASSERT(pb);
+	ASSERT(dv);
+	ASSERT(dv->fqd);
+
+	if(pb->len_bytes + dv->len > pb->alloc_bytes)
+	{
+		pb->bytes = grow_array(pb->bytes, &pb->alloc_bytes,
+				pb->len_bytes + dv->len, sizeof(char));
+	}
+
+	if(pb->len_labels + dv->segs_used > pb->alloc_labels)
+	{
+		size_t alloc = pb->alloc_labels;
+		pb->label_indexes = grow_array(pb->label_indexes, &alloc,
+				pb->len_labels + dv->segs_used, sizeof(size_len_t));
+		alloc = pb->alloc_labels;
+		pb->hashes = grow_array(pb->hashes, &alloc,
+				pb->len_labels + dv->segs_used, sizeof(uint32_t));
+		pb->lengths = grow_array(pb->lengths, &pb->alloc_labels,
+				pb->len_labels + dv->segs_used, sizeof(uchar));
+	}
+
+	if(pb->len_domains >= pb->alloc_domains)
+	{
+		pb->domains = grow_array(pb->domains, &pb->alloc_domains,
+				pb->len_domains + 1, sizeof(ParsedDomain_t));
+	}
+
+	ParsedDomain_t *pd = &pb->domains[pb->len_domains++];
+	pd->offset = pb->len_bytes;
+	pd->first_label = pb->len_labels;
+	pd->len = dv->len;
+	pd->segs_used = dv->segs_used;
+	pd->linenumber = dv->linenumber;
+	pd->match_strength = dv->match_strength;
+	pd->shard = shard;
+
+	memcpy(pb->bytes + pb->len_bytes, dv->fqd, dv->len);
+	pb->len_bytes += dv->len;
+
+	// label indexes are relative to the start of the domain and need no
+	// adjustment.
+	memcpy(pb->label_indexes + pb->len_labels, dv->label_indexes,
+			sizeof(size_len_t) * dv->segs_used);
+	memcpy(pb->lengths + pb->len_labels, dv->lengths,
+			sizeof(uchar) * dv->segs_used);
+	memcpy(pb->hashes + pb->len_labels, dv->hashes,
+			sizeof(uint32_t) * dv->segs_used);
+	pb->len_labels += dv->segs_used;
+}
+
+/**
+ * Point the given DomainView at the domain held in the batch at the given
+ * index. The DomainView borrows the memory of the batch: it must NOT be passed
+ * to free_DomainView() and is valid until the batch is reset or freed. The
+ * file index is not known to the batch and is left for the caller to assign.
+ */
+void view_ParsedBatch(ParsedBatch_t const *pb, size_t idx, DomainView_t *dv)
+{
+	ASSERT(pb);
+	ASSERT(dv);
+	ASSERT(idx < pb->len_domains);
+
+	ParsedDomain_t const *pd = &pb->domains[idx];
+
+	dv->fqd = pb->bytes + pd->offset;
+	dv->len = pd->len;
+	dv->label_indexes = pb->label_indexes + pd->first_label;
+	dv->lengths = pb->lengths + pd->first_label;
+	dv->hashes = pb->hashes + pd->first_label;
+	dv->segs_used = pd->segs_used;
+	dv->segs_alloc = pd->segs_used;
+	dv->linenumber = pd->linenumber;
+	dv->match_strength = pd->match_strength;
+}
+
+#ifdef BUILD_TESTS
+static void test_init_ParsedBatch()
+{
+	ParsedBatch_t pb, pb_zero;
+	memset(&pb, 0xf, sizeof(ParsedBatch_t));
+	memset(&pb_zero, 0, sizeof(ParsedBatch_t));
+
+	init_ParsedBatch(&pb);
+
+	assert(pb.bytes);
+	assert(pb.label_indexes);
+	assert(pb.lengths);
+	assert(pb.hashes);
+	assert(pb.domains);
+	assert(pb.len_domains == 0);
+	assert(!pb.next);
+	assert(!full_ParsedBatch(&pb));
+
+	free_ParsedBatch(&pb);
+
+	assert(!memcmp(&pb, &pb_zero, sizeof(ParsedBatch_t)));
+}
+
+static void test_append_ParsedBatch()
+{
+	ParsedBatch_t pb;
+	DomainView_t dv, view;
+	SubdomainView_t sdv;
+
+	init_ParsedBatch(&pb);
+	init_DomainView(&dv);
+
+	const char *domains[] = {"www.google.com", "a.b.c.d.e.f.g.h.example.org",
+		"localhost"};
+
+	for(size_t i = 0; i < 3; i++)
+	{
+		assert(update_DomainView(&dv, domains[i], strlen(domains[i])));
+		dv.linenumber = i + 1;
+		dv.match_strength = i % 2;
+		append_ParsedBatch(&pb, &dv, i);
+	}
+
+	// the DomainView is reused while the batch holds copies.
+	assert(update_DomainView(&dv, "overwritten.net", 15));
+
+	assert(pb.len_domains == 3);
+	for(size_t i = 0; i < 3; i++)
+	{
+		view_ParsedBatch(&pb, i, &view);
+		assert(view.len == strlen(domains[i]));
+		assert(!memcmp(view.fqd, domains[i], view.len));
+		assert(view.linenumber == i + 1);
+		assert(view.match_strength == (MatchStrength_t)(i % 2));
+		assert(pb.domains[i].shard == i);
+
+		// labels of the view are identical to a fresh split
+		assert(update_DomainView(&dv, domains[i], strlen(domains[i])));
+		assert(view.segs_used == dv.segs_used);
+
+		DomainViewIter_t it = begin_DomainView(&view);
+		size_len_t seg = 0;
+		while(next_DomainView(&it, &sdv))
+		{
+			assert(sdv.len == dv.lengths[seg]);
+			assert(sdv.hash == dv.hashes[seg]);
+			assert(!memcmp(sdv.data, dv.fqd + dv.label_indexes[seg], sdv.len));
+			seg++;
+		}
+		assert(seg == dv.segs_used);
+	}
+
+	reset_ParsedBatch(&pb);
+	assert(pb.len_domains == 0);
+
+	free_DomainView(&dv);
+	free_ParsedBatch(&pb);
+}
+
+static void test_grow_ParsedBatch()
+{
+	ParsedBatch_t pb;
+	DomainView_t dv, view;
+
+	init_ParsedBatch(&pb);
+	init_DomainView(&dv);
+
+	char *long_domain = malloc(250);
+	memset(long_domain, 'x', 250);
+	for(size_t i = 1; i < 250; i += 2)
+	{
+		long_domain[i] = '.';
+	}
+
+	size_t count = 0;
+	while(!full_ParsedBatch(&pb))
+	{
+		assert(update_DomainView(&dv, long_domain, 249));
+		dv.linenumber = ++count;
+		dv.match_strength = MATCH_WEAK;
+		append_ParsedBatch(&pb, &dv, 0);
+	}
+
+	assert(pb.alloc_bytes >= pb.len_bytes);
+	assert(pb.alloc_labels >= pb.len_labels);
+
+	view_ParsedBatch(&pb, count - 1, &view);
+	assert(view.linenumber == count);
+	assert(view.segs_used == 125);
+	assert(!memcmp(view.fqd, long_domain, 249));
+
+	free(long_domain);
+	free_DomainView(&dv);
+	free_ParsedBatch(&pb);
+}
+
+void test_ParsedBatch()
+{
+	test_init_ParsedBatch();
+	test_append_ParsedBatch();
+	test_grow_ParsedBatch();
+}
+#endif
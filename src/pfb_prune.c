@@ -30,33 +30,41 @@
 #include "contextpair.h"
 #include "pfb_prune.h"
 #include "matchstrength.h"
+#include "parsedbatch.h"
+#include "arena.h"
+#include "regexset.h"
+#include "snapshot.h"
+#include "sorteddomains.h"
+#include "unbound.h"
+#include "exactset.h"
 #include <limits.h>
+#include <pthread.h>
 
-static size_t INITIAL_ARRAY_DOMAIN_INFO = 100000;
-static size_t REALLOC_ARRAY_DOMAIN_INFO = 4096;
+// when true, the offset and length of every line read is recorded so the write
+// phase copies the kept lines instead of reading the input files again.
+static bool write_spans = false;
 
-void set_DomainInfo_array_size(int v)
+void set_write_spans(bool v)
 {
-	if(v > 0)
-	{
-		INITIAL_ARRAY_DOMAIN_INFO = v;
-	}
-	else
-	{
-		ELOG_STDERR("WARNING: ignoring user specified buffer size %d; using default.\n", v);
-	}
+	write_spans = v;
 }
 
-void set_realloc_DomainInfo_size(int v)
+// when true, the regexes of the input files are compiled while reading and the
+// domains they match are removed by pfb_prune_regex().
+static bool prune_regex = false;
+
+void set_prune_regex(bool v)
 {
-	if(v > 0)
-	{
-		REALLOC_ARRAY_DOMAIN_INFO = v;
-	}
-	else
-	{
-		ELOG_STDERR("WARNING: ignoring user specified realloc size %d; using default.\n", v);
-	}
+	prune_regex = v;
+}
+
+// when true, domains are deduplicated by sorting a flat array of keys with
+// pfb_consolidate_sorted() instead of inserting them into the DomainTree.
+static bool sort_engine = false;
+
+void set_sort_engine(bool v)
+{
+	sort_engine = v;
 }
 
 #ifdef COLLECT_DIAGNOSTICS
@@ -129,14 +137,19 @@ char* outputfilename(const char *input, const char *ext)
 	return output;
 }
 
-static MatchStrength_t get_csvline_match(CsvLineView_t *lv)
+// pfBlockerNG CSV columns used: the domain and the match strength.
+enum { CSV_COL_DOMAIN = 1, CSV_COL_MATCH = 6 };
+static const size_len_t CSV_COLS[] = { CSV_COL_DOMAIN, CSV_COL_MATCH };
+#define LEN_CSV_COLS (sizeof(CSV_COLS) / sizeof(CSV_COLS[0]))
+
+static MatchStrength_t get_csvline_match(size_len_t cols_used,
+		CsvColView_t const *cv_6)
 {
-	ASSERT(lv);
+	ASSERT(cv_6);
+	ASSERT(cv_6->idx == CSV_COL_MATCH);
 
-	if(lv->cols_used >= 7)
+	if(cols_used >= 7)
 	{
-		const CsvColView_t cv_6 = get_CsvColView(lv, 6);
-
 		// ISO/IEC 9899:201x Committee Draft — April 12, 2011 N1570
 		// 5.2 Environmental considerations
 		// 5.2.1 Character sets
@@ -144,17 +157,17 @@ static MatchStrength_t get_csvline_match(CsvLineView_t *lv)
 		// In both the source and execution basic character sets, the value of
 		// each character after 0 in the above list of decimal digits shall be
 		// one greater than the value of the previous.
-		if(cv_6.len > 1)
+		if(cv_6->len != 1)
 		{
 			// undefined / unsupported.
 			ELOG_STDERR("WARNING: line has bogus unsupported value in column 7: %.*s\n",
-					(int)cv_6.len, cv_6.data);
+					(int)cv_6->len, cv_6->data ? cv_6->data : "");
 			// flag line bogus to skip further processing
 			return MATCH_BOGUS;
 		}
 		else
 		{
-			return cv_6.data[0] - '0';
+			return cv_6->data[0] - '0';
 		}
 	}
 	else
@@ -163,49 +176,110 @@ static MatchStrength_t get_csvline_match(CsvLineView_t *lv)
 	}
 }
 
-static void pfb_insert(PortLineData_t const *const pld, pfb_context_t *pfbc,
-		void *context)
+/**
+ * Tokenize a line of pfBlockerNG CSV and split the domain into labels. Regex
+ * lines are carried over on the given context. A domain the optional ExactSet
+ * already holds at least as strongly is dropped before it is split. Returns
+ * true when the given DomainView is ready to be inserted into the DomainTree.
+ */
+static bool parse_csvline(PortLineData_t const *const pld, pfb_context_t *pfbc,
+		DomainView_t *dv, ExactSet_t *exact)
 {
-	ASSERT(pld);
-	ASSERT(pfbc);
-	ASSERT(pfbc->in_file);
-	ASSERT(pfbc->out_file);
-	ASSERT(pfbc->dt);
-	ASSERT(context);
-
-	ContextPair_t *pc = context;
-	CsvLineView_t *lv = pc->lv;
-	DomainView_t *dv = pc->dv;
-
-	ASSERT(lv);
 	ASSERT(dv);
 
-	update_CsvLineView(lv, pld->data);
+	// lines replayed from a snapshot are not in the input file as is; neither
+	// recorded again nor copied by their span.
+	SnapshotFile_t *record = pfbc->snap && !pfbc->snap->unchanged ?
+		pfbc->snap : NULL;
+
+	if(write_spans && (!pfbc->snap || record))
+	{
+		insert_LineSpans(&pfbc->spans, pld->linenumber, pld->offset, pld->len);
+	}
 
-	const CsvColView_t cv_1 = get_CsvColView(lv, 1);
+	// only the columns of interest are located; the line is not split.
+	CsvColView_t cols[LEN_CSV_COLS];
+	const size_len_t cols_used = extract_CsvCols(pld->data, pld->len, CSV_COLS,
+			LEN_CSV_COLS, cols);
+	CsvColView_t const *cv_1 = &cols[0];
 
-	const MatchStrength_t ms = get_csvline_match(lv);
+	const MatchStrength_t ms = get_csvline_match(cols_used, &cols[1]);
 	if(ms == MATCH_REGEX)
 	{
 		// add the line information to list for direct carry over to the final
 		// list.
 		insert_carry_over(&pfbc->co, pld->linenumber);
+		pfbc->stats.regex++;
+		if(record)
+		{
+			record_SnapshotFile(record, pld->linenumber, ms, cv_1->data,
+					cv_1->len);
+		}
+		if(prune_regex && cv_1->len &&
+				!insert_RegexSet(&pfbc->regexes, cv_1->data, cv_1->len))
+		{
+			ELOG_STDERR("WARNING: regex is carried over but not used to prune; unsupported: %.*s\n",
+					(int)cv_1->len, cv_1->data);
+		}
+		return false;
 	}
-	else
+
+	if(exact && held_ExactSet(exact, cv_1->data, cv_1->len, ms))
 	{
-		ASSERT(!null_DomainView(dv));
-		if(!update_DomainView(dv, cv_1.data, cv_1.len))
+		if(record)
 		{
-			ELOG_STDERR("ERROR: failed to update DomainView; possibly garbage input. insert skipped.\n");
+			record_SnapshotFile(record, pld->linenumber, ms, cv_1->data,
+					cv_1->len);
 		}
-		else
-		{
-			// DomainView is valid only during an insert.
-			dv->match_strength = ms;
-			dv->context = pfbc;
-			dv->linenumber = pld->linenumber;
+		count_FileStats(&pfbc->stats, INSERT_IDENTICAL);
+		return false;
+	}
+
+	ASSERT(!null_DomainView(dv));
+	if(!update_DomainView(dv, cv_1->data, cv_1->len))
+	{
+		ELOG_STDERR("ERROR: failed to update DomainView; possibly garbage input. insert skipped.\n");
+		pfbc->stats.bogus++;
+		return false;
+	}
+
+	if(record && ms != MATCH_BOGUS)
+	{
+		record_SnapshotFile(record, pld->linenumber, ms, cv_1->data, cv_1->len);
+	}
+
+	// DomainView is valid only during an insert.
+	dv->match_strength = ms;
+	dv->file_index = pfbc->file_index;
+	dv->linenumber = pld->linenumber;
 
-			insert_DomainTree(pfbc->dt, dv);
+	return true;
+}
+
+static void pfb_insert(PortLineData_t const *const pld, pfb_context_t *pfbc,
+		void *context)
+{
+	ASSERT(pld);
+	ASSERT(pfbc);
+	// lines replayed from a snapshot come without the files being open.
+	ASSERT((pfbc->in_file && pfbc->out_file) ||
+			(pfbc->snap && pfbc->snap->unchanged));
+	ASSERT(pfbc->dt);
+	ASSERT(context);
+
+	ContextPair_t *pc = context;
+	DomainView_t *dv = pc->dv;
+	// optional; see pfb_read_csv().
+	ExactSet_t *exact = pfbc->exact;
+
+	if(parse_csvline(pld, pfbc, dv, exact))
+	{
+		InsertOutcome_t outcome;
+		insert_DomainTree(pfbc->dt, pfbc->arena, dv, &outcome);
+		count_FileStats(&pfbc->stats, outcome);
+		if(exact && (outcome == INSERT_NEW || outcome == INSERT_REPLACED))
+		{
+			insert_ExactSet(exact, dv->fqd, dv->len, dv->match_strength);
 		}
 	}
 }
@@ -235,6 +309,13 @@ pfb_contexts_t pfb_init_contexts(size_t alloc_contexts, const char *out_ext,
 		return cs;
 	}
 
+	if(alloc_contexts > (size_t)FILEINDEX_MAX + 1)
+	{
+		ELOG_STDERR("ERROR: at most %u input files are supported.\n",
+				(uint)FILEINDEX_MAX + 1);
+		exit(EXIT_FAILURE);
+	}
+
 	// using calloc for the included 'memset' to zero the DomainView instance.
 	cs.begin_context = calloc(alloc_contexts, sizeof(pfb_context_t));
 	// an array of size 1 to hold the one DomainTree and share across all
@@ -243,6 +324,18 @@ pfb_contexts_t pfb_init_contexts(size_t alloc_contexts, const char *out_ext,
 	// every context references the same dt. only have to null the place holder
 	// for one of the contexts.
 	ASSERT(cs.begin_context->dt[0] == NULL);
+	cs.begin_context->arena = malloc(sizeof(Arena_t));
+	if(!cs.begin_context->dt || !cs.begin_context->arena)
+	{
+		exit(EXIT_FAILURE);
+	}
+	init_Arena(cs.begin_context->arena);
+	cs.begin_context->sorted = malloc(sizeof(SortedDomains_t));
+	if(!cs.begin_context->sorted)
+	{
+		exit(EXIT_FAILURE);
+	}
+	init_SortedDomains(cs.begin_context->sorted);
 
 	cs.end_context = cs.begin_context + alloc_contexts;
 
@@ -251,10 +344,14 @@ pfb_contexts_t pfb_init_contexts(size_t alloc_contexts, const char *out_ext,
 		ASSERT(!c->in_file);
 		ASSERT(!c->out_file);
 		c->dt = cs.begin_context->dt;
+		c->arena = cs.begin_context->arena;
+		c->sorted = cs.begin_context->sorted;
+		c->file_index = (fileindex_t)(c - cs.begin_context);
 		ASSERT(*argv);
 		c->in_fname = pfb_strdup(*argv, strlen(*argv));
 		c->out_fname = outputfilename(c->in_fname, out_ext);
 		init_carry_over(&c->co);
+		init_OutBuffer(&c->out, -1);
 	}
 
 	return cs;
@@ -300,6 +397,8 @@ void pfb_open_context(pfb_context_t *c, bool append_output)
 		return;
 	}
 
+	// nothing is written through the FILE; the descriptor is written directly.
+	init_OutBuffer(&c->out, fileno(c->out_file));
 }
 
 void pfb_flush_out_context(pfb_context_t *c)
@@ -312,6 +411,10 @@ void pfb_flush_out_context(pfb_context_t *c)
 		return;
 	}
 
+	if(flush_OutBuffer(&c->out))
+	{
+		ELOG_STDERR("ERROR: failed to write to '%s'\n", c->out_fname);
+	}
 	fflush(c->out_file);
 }
 
@@ -327,6 +430,19 @@ void pfb_close_context(pfb_context_t *c)
 
 	if(c->out_file)
 	{
+		if(flush_OutBuffer(&c->out))
+		{
+			ELOG_STDERR("ERROR: failed to write to '%s'\n", c->out_fname);
+		}
+#ifdef COLLECT_DIAGNOSTICS
+		if(c->out.bytes)
+		{
+			LOG_DIAG("OutBuffer", &c->out, "wrote %lu bytes in %lu syscalls.\n",
+					c->out.bytes, c->out.syscalls);
+			LOG_DIAG_CONT("Output file: %s\n\n", c->out_fname);
+		}
+#endif
+		free_OutBuffer(&c->out);
 		fclose(c->out_file);
 		c->out_file = NULL;
 	}
@@ -353,18 +469,34 @@ void pfb_free_contexts(pfb_contexts_t *cs)
 			// unexpected though not harmful situation.
 			ELOG_STDERR("WARNING: domain tree is still set on context pfb_free_context()\n");
 
-			free_DomainTree(&cs->begin_context->dt[0]);
+			free_DomainTree(&cs->begin_context->dt[0], cs->begin_context->arena);
 			cs->begin_context->dt[0] = NULL;
 		}
 		free(cs->begin_context->dt);
 		cs->begin_context->dt = NULL;
 
+		if(cs->begin_context->arena)
+		{
+			free_Arena(cs->begin_context->arena);
+			free(cs->begin_context->arena);
+			cs->begin_context->arena = NULL;
+		}
+
+		if(cs->begin_context->sorted)
+		{
+			free_SortedDomains(cs->begin_context->sorted);
+			free(cs->begin_context->sorted);
+			cs->begin_context->sorted = NULL;
+		}
+
 		for(pfb_context_t *c = cs->begin_context; c < cs->end_context; c++)
 		{
 			pfb_close_context(c);
 			free(c->in_fname);
 			free(c->out_fname);
 			free_carry_over(&c->co);
+			free_LineSpans(&c->spans);
+			free_RegexSet(&c->regexes);
 		}
 
 		free(cs->begin_context);
@@ -373,6 +505,29 @@ void pfb_free_contexts(pfb_contexts_t *cs)
 	cs->end_context = NULL;
 }
 
+/**
+ * Hand every line of the input file of the given context to 'do_stuff'. An
+ * input unchanged since the snapshot is replayed from it; its output file is
+ * left as is until written.
+ */
+static void pfb_read_context(pfb_context_t *c,
+		void(*do_stuff)(PortLineData_t const *const pld, pfb_context_t *, void *),
+		void *context)
+{
+	if(replay_SnapshotFile(c, do_stuff, context))
+	{
+		write_AsyncLog(LOG_TARGET_STD, "Replaying %s from snapshot...\n",
+				c->in_fname);
+		return;
+	}
+
+	write_AsyncLog(LOG_TARGET_STD, "Reading %s...\n", c->in_fname);
+	// output file may not exist; if it does, this will ovewrite it.
+	pfb_open_context(c, false);
+	read_pfb_csv(c, do_stuff, context);
+	pfb_close_context(c);
+}
+
 /**
  * Provides a callback that is specific to handling reading the CSV file
  * pfBlockerNG produces and adds appropriate entries to the DomainTree.
@@ -383,59 +538,584 @@ void pfb_read_csv(pfb_contexts_t *cs)
 	ASSERT(cs->begin_context);
 	ASSERT(cs->begin_context != cs->end_context);
 
-	CsvLineView_t lv;
-	// if this is multi-threaded, will need one lv per thread and break the loop
-	// apart for each thread. then find a way to insert into hash table across
-	// multiple threads.
-	init_CsvLineView(&lv);
-
 	DomainView_t dv;
 	init_DomainView(&dv);
 
+	// the full names of the domains in the tree; only needed while reading.
+	ExactSet_t exact;
+	init_ExactSet(&exact);
+
 	ContextPair_t pc;
-	pc.lv = &lv;
+	pc.c1 = NULL;
 	pc.dv = &dv;
 
 	for(pfb_context_t *c = cs->begin_context; c < cs->end_context; c++)
 	{
-		printf("Reading %s...\n", c->in_fname);
-		// output file may not exist; if it does, this will ovewrite it.
-		pfb_open_context(c, false);
-		read_pfb_csv(c, pfb_insert, &pc);
-		pfb_close_context(c);
+		c->exact = &exact;
+		pfb_read_context(c, pfb_insert, &pc);
+		c->exact = NULL;
 	}
 
-	free_CsvLineView(&lv);
+	free_ExactSet(&exact);
 	free_DomainView(&dv);
 
 }
 
-void init_ArrayDomainInfo(ArrayDomainInfo_t *array_di, const size_t alloc_contexts)
+/**
+ * Batches read from one file waiting to be inserted into the DomainTree. Filled
+ * by exactly one reader thread and consumed by every inserting thread.
+ */
+typedef struct ParseQueue
 {
-	ASSERT(array_di);
-	ASSERT(alloc_contexts > 0);
-	ASSERT(INITIAL_ARRAY_DOMAIN_INFO > 0);
+	ParsedBatch_t *head;
+	ParsedBatch_t *tail;
+	// set once the reader thread has queued the last batch of the file.
+	bool done;
+	// number of inserting threads finished with the file.
+	size_t inserters_done;
+} ParseQueue_t;
 
-	if(alloc_contexts == 0)
+/**
+ * State shared by the reader threads and the inserting threads of
+ * pfb_read_csv_parallel(). Except for the shards, all members are guarded by
+ * 'lock'. Each shard is owned by exactly one inserting thread.
+ */
+typedef struct ParallelRead
+{
+	pfb_contexts_t *cs;
+	// one queue per context; same size and order as the contexts.
+	ParseQueue_t *queues;
+	// emptied batches to be reused by the reader threads.
+	ParsedBatch_t *spare;
+
+	DomainTreeShards_t shards;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	// next context to be claimed by a reader thread.
+	size_t next_context;
+	// number of contexts completely inserted into the DomainTree.
+	size_t inserted_contexts;
+	// how many contexts reader threads may run ahead of insertion. bounds the
+	// memory held by parsed batches waiting to be inserted.
+	size_t lookahead;
+} ParallelRead_t;
+
+/**
+ * One per reader thread. The DomainView is private to the thread and reused
+ * for every line the thread reads.
+ */
+typedef struct ParseWorker
+{
+	ParallelRead_t *pr;
+	ParseQueue_t *queue;
+	ParsedBatch_t *pb;
+	DomainView_t dv;
+} ParseWorker_t;
+
+/**
+ * One per inserting thread. The counts of each file are summed into the
+ * contexts once every thread is done.
+ */
+typedef struct ShardWorker
+{
+	ParallelRead_t *pr;
+	size_t shard;
+	// same size and order as the contexts.
+	FileStats_t *stats;
+	// the full names of the domains of the shard. the labels are split by
+	// the reader threads; a duplicate only skips the descent.
+	ExactSet_t exact;
+} ShardWorker_t;
+
+static ParsedBatch_t *take_ParsedBatch(ParallelRead_t *pr)
+{
+	pthread_mutex_lock(&pr->lock);
+	ParsedBatch_t *pb = pr->spare;
+	if(pb)
 	{
-		ELOG_STDERR("ERROR: request to allocate zero context elements.\n");
+		pr->spare = pb->next;
+	}
+	pthread_mutex_unlock(&pr->lock);
+
+	if(!pb)
+	{
+		pb = malloc(sizeof(ParsedBatch_t));
+		if(!pb)
+		{
+			exit(EXIT_FAILURE);
+		}
+		init_ParsedBatch(pb);
+	}
+
+	reset_ParsedBatch(pb);
+	return pb;
+}
+
+/**
+ * Hand the current batch of the worker to the inserting threads.
+ */
+static void publish_ParsedBatch(ParseWorker_t *pw, bool last)
+{
+	ParallelRead_t *pr = pw->pr;
+	ParsedBatch_t *pb = pw->pb;
+	pw->pb = NULL;
+
+	pthread_mutex_lock(&pr->lock);
+	if(pb->len_domains == 0)
+	{
+		pb->next = pr->spare;
+		pr->spare = pb;
+	}
+	else
+	{
+		pb->next = NULL;
+		pb->pending = pr->shards.len_shards;
+		if(pw->queue->tail)
+		{
+			pw->queue->tail->next = pb;
+		}
+		else
+		{
+			pw->queue->head = pb;
+		}
+		pw->queue->tail = pb;
+	}
+	pw->queue->done = last;
+	pthread_cond_broadcast(&pr->cond);
+	pthread_mutex_unlock(&pr->lock);
+
+	if(!last)
+	{
+		pw->pb = take_ParsedBatch(pr);
+	}
+}
+
+/**
+ * Callback for read_pfb_csv() on a reader thread. Same parsing as pfb_insert()
+ * except the result is queued instead of inserted.
+ */
+static void pfb_parse(PortLineData_t const *const pld, pfb_context_t *pfbc,
+		void *context)
+{
+	ASSERT(pld);
+	ASSERT(pfbc);
+	ASSERT(context);
+
+	ParseWorker_t *pw = context;
+
+	if(parse_csvline(pld, pfbc, &pw->dv, NULL))
+	{
+		append_ParsedBatch(pw->pb, &pw->dv,
+				shard_DomainTree(&pw->pr->shards, &pw->dv));
+		if(full_ParsedBatch(pw->pb))
+		{
+			publish_ParsedBatch(pw, false);
+		}
+	}
+}
+
+static void *pfb_read_thread(void *arg)
+{
+	ParseWorker_t *pw = arg;
+	ParallelRead_t *pr = pw->pr;
+	const size_t len_contexts = pfb_len_contexts(pr->cs);
+
+	init_DomainView(&pw->dv);
+
+	for(;;)
+	{
+		pthread_mutex_lock(&pr->lock);
+		while(pr->next_context < len_contexts &&
+				pr->next_context >= pr->inserted_contexts + pr->lookahead)
+		{
+			pthread_cond_wait(&pr->cond, &pr->lock);
+		}
+
+		if(pr->next_context >= len_contexts)
+		{
+			pthread_mutex_unlock(&pr->lock);
+			break;
+		}
+
+		const size_t idx = pr->next_context++;
+		pthread_mutex_unlock(&pr->lock);
+
+		pfb_context_t *c = pr->cs->begin_context + idx;
+		pw->queue = &pr->queues[idx];
+		pw->pb = take_ParsedBatch(pr);
+
+		pfb_read_context(c, pfb_parse, pw);
+
+		publish_ParsedBatch(pw, true);
+	}
+
+	free_DomainView(&pw->dv);
+
+	return NULL;
+}
+
+/**
+ * Wait for the batch following the given one and release the given one. The
+ * last inserting thread to release a batch returns it to the spares. Returns
+ * NULL once the file has no more batches.
+ */
+static ParsedBatch_t *next_queued_batch(ParallelRead_t *pr, ParseQueue_t *q,
+		ParsedBatch_t *pb)
+{
+	pthread_mutex_lock(&pr->lock);
+	if(!pb)
+	{
+		while(!q->head && !q->done)
+		{
+			pthread_cond_wait(&pr->cond, &pr->lock);
+		}
+		pb = q->head;
+		pthread_mutex_unlock(&pr->lock);
+		return pb;
+	}
+
+	while(!pb->next && !q->done)
+	{
+		pthread_cond_wait(&pr->cond, &pr->lock);
+	}
+
+	ParsedBatch_t *next = pb->next;
+
+	ASSERT(pb->pending > 0);
+	if(--pb->pending == 0)
+	{
+		// every inserting thread consumes the batches in the same order; the
+		// batch released last is always at the head.
+		ASSERT(q->head == pb);
+		q->head = next;
+		if(!q->head)
+		{
+			q->tail = NULL;
+		}
+		pb->next = pr->spare;
+		pr->spare = pb;
+	}
+	pthread_mutex_unlock(&pr->lock);
+
+	return next;
+}
+
+/**
+ * Insert every domain that belongs to the given shard. Files are visited in
+ * order and the batches of each file in the order they were read; within its
+ * shard the insertion order is the same as pfb_read_csv().
+ */
+static void *pfb_insert_thread(void *arg)
+{
+	ShardWorker_t *sw = arg;
+	ParallelRead_t *pr = sw->pr;
+	const size_t len_contexts = pfb_len_contexts(pr->cs);
+
+	// borrows the memory of each batch; never passed to free_DomainView().
+	DomainView_t dv;
+	memset(&dv, 0, sizeof(DomainView_t));
+
+	for(size_t idx = 0; idx < len_contexts; idx++)
+	{
+		pfb_context_t *c = pr->cs->begin_context + idx;
+		ParseQueue_t *q = &pr->queues[idx];
+
+		for(ParsedBatch_t *pb = next_queued_batch(pr, q, NULL); pb;
+				pb = next_queued_batch(pr, q, pb))
+		{
+			for(size_t i = 0; i < pb->len_domains; i++)
+			{
+				if(pb->domains[i].shard != sw->shard)
+				{
+					continue;
+				}
+
+				view_ParsedBatch(pb, i, &dv);
+				if(held_ExactSet(&sw->exact, dv.fqd, dv.len, dv.match_strength))
+				{
+					count_FileStats(&sw->stats[idx], INSERT_IDENTICAL);
+					continue;
+				}
+
+				dv.file_index = c->file_index;
+				InsertOutcome_t outcome;
+				insert_DomainTreeShards(&pr->shards, sw->shard, &dv, &outcome);
+				count_FileStats(&sw->stats[idx], outcome);
+				if(outcome == INSERT_NEW || outcome == INSERT_REPLACED)
+				{
+					insert_ExactSet(&sw->exact, dv.fqd, dv.len,
+							dv.match_strength);
+				}
+			}
+		}
+
+		pthread_mutex_lock(&pr->lock);
+		if(++q->inserters_done == pr->shards.len_shards)
+		{
+			pr->inserted_contexts++;
+			pthread_cond_broadcast(&pr->cond);
+		}
+		pthread_mutex_unlock(&pr->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * One per thread of pfb_read_csv_sorted(). Domains are appended to the array
+ * of the thread; the arrays are merged once every file is read.
+ */
+typedef struct SortWorker
+{
+	pfb_contexts_t *cs;
+	pthread_mutex_t *lock;
+	// next context to be claimed; guarded by 'lock'.
+	size_t *next_context;
+	SortedDomains_t sd;
+	DomainView_t dv;
+} SortWorker_t;
+
+static void pfb_append(PortLineData_t const *const pld, pfb_context_t *pfbc,
+		void *context)
+{
+	ASSERT(pld);
+	ASSERT(pfbc);
+	ASSERT(context);
+
+	SortWorker_t *sw = context;
+
+	if(parse_csvline(pld, pfbc, &sw->dv, NULL) &&
+			!append_SortedDomains(&sw->sd, &sw->dv))
+	{
+		count_FileStats(&pfbc->stats, INSERT_SKIPPED);
+	}
+}
+
+static void *pfb_read_sort_thread(void *arg)
+{
+	SortWorker_t *sw = arg;
+	const size_t len_contexts = pfb_len_contexts(sw->cs);
+
+	for(;;)
+	{
+		pthread_mutex_lock(sw->lock);
+		const size_t idx = (*sw->next_context)++;
+		pthread_mutex_unlock(sw->lock);
+
+		if(idx >= len_contexts)
+		{
+			break;
+		}
+
+		pfb_read_context(sw->cs->begin_context + idx, pfb_append, sw);
+	}
+
+	return NULL;
+}
+
+/**
+ * Read every file into the SortedDomains_t of the contexts. Lines are not
+ * resolved while reading so the files are read by up to 'num_threads' threads
+ * in any order; pfb_consolidate_sorted() restores the order.
+ */
+static void pfb_read_csv_sorted(pfb_contexts_t *cs, size_t num_threads)
+{
+	const size_t len_contexts = pfb_len_contexts(cs);
+	size_t len_workers = num_threads < len_contexts ? num_threads : len_contexts;
+	if(!len_workers)
+	{
+		len_workers = 1;
+	}
+
+	SortWorker_t *workers = calloc(len_workers, sizeof(SortWorker_t));
+	pthread_t *threads = calloc(len_workers, sizeof(pthread_t));
+	if(!workers || !threads)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	pthread_mutex_t lock;
+	pthread_mutex_init(&lock, NULL);
+	size_t next_context = 0;
+
+	for(size_t t = 0; t < len_workers; t++)
+	{
+		workers[t].cs = cs;
+		workers[t].lock = &lock;
+		workers[t].next_context = &next_context;
+		init_SortedDomains(&workers[t].sd);
+		init_DomainView(&workers[t].dv);
+	}
+
+	// the calling thread is the first worker.
+	for(size_t t = 1; t < len_workers; t++)
+	{
+		if(pthread_create(&threads[t], NULL, pfb_read_sort_thread, &workers[t]))
+		{
+			ELOG_STDERR("ERROR: failed to create reader thread.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	pfb_read_sort_thread(&workers[0]);
+
+	for(size_t t = 1; t < len_workers; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+
+	for(size_t t = 0; t < len_workers; t++)
+	{
+		merge_SortedDomains(cs->begin_context->sorted, &workers[t].sd);
+		free_SortedDomains(&workers[t].sd);
+		free_DomainView(&workers[t].dv);
+	}
+
+	pthread_mutex_destroy(&lock);
+	free(threads);
+	free(workers);
+}
+
+/**
+ * Same result as pfb_read_csv() using 'num_threads' reader threads to tokenize
+ * lines and split domains into labels, and 'num_threads' inserting threads
+ * each owning one shard of the DomainTree (the calling thread being one of
+ * them). Each reader thread works on one file at a time. Every shard is
+ * inserted into in the same order as pfb_read_csv() does: file by file and
+ * line by line. The order is significant since the first of equally strong
+ * duplicates is the one kept. The shards are merged into the DomainTree of the
+ * contexts at the end.
+ */
+void pfb_read_csv_parallel(pfb_contexts_t *cs, size_t num_threads)
+{
+	ASSERT(cs);
+	ASSERT(cs->begin_context);
+	ASSERT(cs->begin_context != cs->end_context);
+
+	const size_t len_contexts = pfb_len_contexts(cs);
+	const size_t num_readers = num_threads < len_contexts ? num_threads :
+		len_contexts;
+
+	if(sort_engine)
+	{
+		pfb_read_csv_sorted(cs, num_threads);
 		return;
 	}
 
-	if(INITIAL_ARRAY_DOMAIN_INFO == 0)
+	if(num_threads <= 1)
 	{
-		ELOG_STDERR("ERROR: request to allocate zero DomainInfo elements.\n");
+		pfb_read_csv(cs);
 		return;
 	}
 
-	if(alloc_contexts > UINT_MAX)
+	ParallelRead_t pr;
+	memset(&pr, 0, sizeof(ParallelRead_t));
+	pr.cs = cs;
+	pr.lookahead = num_readers * 2;
+	init_DomainTreeShards(&pr.shards, num_threads);
+	pr.queues = calloc(len_contexts, sizeof(ParseQueue_t));
+	ParseWorker_t *readers = calloc(num_readers, sizeof(ParseWorker_t));
+	ShardWorker_t *inserters = calloc(num_threads, sizeof(ShardWorker_t));
+	pthread_t *threads = calloc(num_readers + num_threads, sizeof(pthread_t));
+	if(!pr.queues || !readers || !inserters || !threads)
 	{
-		ELOG_STDERR("WARNING: allocating over UINT_MAX context elements.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	pthread_mutex_init(&pr.lock, NULL);
+	pthread_cond_init(&pr.cond, NULL);
+
+	for(size_t t = 0; t < num_readers; t++)
+	{
+		readers[t].pr = &pr;
+		if(pthread_create(&threads[t], NULL, pfb_read_thread, &readers[t]))
+		{
+			ELOG_STDERR("ERROR: failed to create reader thread.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for(size_t t = 0; t < num_threads; t++)
+	{
+		inserters[t].pr = &pr;
+		inserters[t].shard = t;
+		inserters[t].stats = calloc(len_contexts, sizeof(FileStats_t));
+		if(!inserters[t].stats)
+		{
+			exit(EXIT_FAILURE);
+		}
+		init_ExactSet(&inserters[t].exact);
 	}
 
-	if(INITIAL_ARRAY_DOMAIN_INFO > UINT_MAX)
+	// the calling thread owns the first shard.
+	for(size_t t = 1; t < num_threads; t++)
 	{
-		ELOG_STDERR("WARNING: allocating more than UINT_MAX DomainInfo elements.\n");
+		if(pthread_create(&threads[num_readers + t], NULL, pfb_insert_thread,
+					&inserters[t]))
+		{
+			ELOG_STDERR("ERROR: failed to create insert thread.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	pfb_insert_thread(&inserters[0]);
+
+	for(size_t t = 0; t < num_readers; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+
+	for(size_t t = 1; t < num_threads; t++)
+	{
+		pthread_join(threads[num_readers + t], NULL);
+	}
+
+	for(size_t t = 0; t < num_threads; t++)
+	{
+		for(size_t idx = 0; idx < len_contexts; idx++)
+		{
+			add_FileStats(&cs->begin_context[idx].stats, &inserters[t].stats[idx]);
+		}
+		free(inserters[t].stats);
+		free_ExactSet(&inserters[t].exact);
+	}
+
+	merge_DomainTreeShards(&pr.shards, cs->begin_context->dt,
+			cs->begin_context->arena);
+	free_DomainTreeShards(&pr.shards);
+
+	while(pr.spare)
+	{
+		ParsedBatch_t *pb = pr.spare;
+		pr.spare = pb->next;
+		free_ParsedBatch(pb);
+		free(pb);
+	}
+
+	pthread_cond_destroy(&pr.cond);
+	pthread_mutex_destroy(&pr.lock);
+	free(threads);
+	free(inserters);
+	free(readers);
+	free(pr.queues);
+}
+
+void init_ArrayDomainInfo(ArrayDomainInfo_t *array_di, const size_t alloc_contexts)
+{
+	ASSERT(array_di);
+	ASSERT(alloc_contexts > 0);
+
+	if(alloc_contexts == 0)
+	{
+		ELOG_STDERR("ERROR: request to allocate zero context elements.\n");
+		return;
+	}
+
+	if(alloc_contexts > UINT_MAX)
+	{
+		ELOG_STDERR("WARNING: allocating over UINT_MAX context elements.\n");
 	}
 
 	array_di->begin_pfb_context = NULL;
@@ -446,25 +1126,12 @@ void init_ArrayDomainInfo(ArrayDomainInfo_t *array_di, const size_t alloc_contex
 		exit(EXIT_FAILURE);
 	}
 
-#ifdef USE_MEMSET
-	memset(array_di->cd, 0, sizeof(ContextDomain_t) * alloc_contexts);
-#endif
-
 	array_di->len_cd = alloc_contexts;
 
+	// the bitmaps grow to the highest line kept; nothing to preallocate.
 	for(size_t i = 0; i < alloc_contexts; i++)
 	{
-		array_di->cd[i].linenumbers = malloc(sizeof(linenumber_t) * INITIAL_ARRAY_DOMAIN_INFO);
-		if(!array_di->cd[i].linenumbers)
-		{
-			exit(EXIT_FAILURE);
-		}
-
-		array_di->cd[i].next_idx = 0;
-		array_di->cd[i].alloc_linenumbers = INITIAL_ARRAY_DOMAIN_INFO;
-#ifdef COLLECT_DIAGNOSTICS
-		array_di->cd[i].count_realloc_linenumbers = 0;
-#endif
+		init_LineBitmap(&array_di->cd[i].kept);
 	}
 }
 
@@ -475,16 +1142,15 @@ void free_ArrayDomainInfo(ArrayDomainInfo_t *array_di)
 	for(size_t i = 0; i < array_di->len_cd; i++)
 	{
 		ASSERT(array_di->cd);
-		free(array_di->cd[i].linenumbers);
 #ifdef COLLECT_DIAGNOSTICS
-		LOG_DIAG("ContextDomain's 'linenumbers'", &(array_di->cd[i]),
-				"realloc'ed %u times to final size of %u with %u used.\n",
-				(uint)array_di->cd[i].count_realloc_linenumbers,
-				(uint)array_di->cd[i].alloc_linenumbers,
-				(uint)array_di->cd[i].next_idx);
+		LOG_DIAG("ContextDomain's 'kept'", &(array_di->cd[i]),
+				"bitmap of %lu words with %u lines kept.\n",
+				array_di->cd[i].kept.len_words,
+				(uint)array_di->cd[i].kept.count);
 		LOG_DIAG_CONT("Input file: %s\n\n",
 				array_di->begin_pfb_context[i].in_fname);
 #endif
+		free_LineBitmap(&array_di->cd[i].kept);
 	}
 
 	free(array_di->cd);
@@ -498,53 +1164,56 @@ void free_ArrayDomainInfo(ArrayDomainInfo_t *array_di)
 #endif
 }
 
-static void resize_ContextLinenumbers(ContextDomain_t *cd, size_t count)
+static bool match_any_RegexSet(char const *fqd, size_t len, void *context)
 {
-	ASSERT(cd);
-	ASSERT(count > 0);
-	cd->alloc_linenumbers += count;
-#ifdef COLLECT_DIAGNOSTICS
-	cd->count_realloc_linenumbers++;
-#endif
-	linenumber_t *tmp = realloc(cd->linenumbers, sizeof(linenumber_t) * cd->alloc_linenumbers);
-	if(tmp)
-	{
-		cd->linenumbers = tmp;
-		tmp = NULL;
-	}
-	else
+	UNUSED(len);
+	return match_RegexSet(context, fqd);
+}
+
+static void merge_context_regexes(pfb_contexts_t *cs, RegexSet_t *all)
+{
+	init_RegexSet(all);
+	for(pfb_context_t *c = cs->begin_context; c != cs->end_context; c++)
 	{
-		free(cd->linenumbers);
-		cd->linenumbers = NULL;
-		ELOG_STDERR("ERROR: failed to realloc linenumbers array\n");
-		exit(EXIT_FAILURE);
+		merge_RegexSet(all, &c->regexes);
 	}
 }
 
-static void transfer_carry_over(ContextDomain_t *cd, pfb_context_t *pfbc)
+/**
+ * Remove every domain matched by a regex of any input file from the
+ * DomainTree. The regex lines themselves are carried over. Does nothing
+ * unless set_prune_regex() was enabled before reading. Call after reading and
+ * before pfb_consolidate(). Returns the number of domains removed.
+ */
+size_t pfb_prune_regex(pfb_contexts_t *cs)
 {
-	ASSERT(cd);
-	ASSERT(pfbc);
-	const linenumber_t count = len_carry_over(&pfbc->co);
+	ASSERT(cs);
+	ASSERT(cs->begin_context);
+
+	// one set so each domain is checked by a single pass of its automaton.
+	RegexSet_t all;
+	merge_context_regexes(cs, &all);
 
-	if(cd->next_idx + count > cd->alloc_linenumbers)
+	size_t pruned = 0;
+	if(all.len)
 	{
-		ASSERT(count > 0);
-		resize_ContextLinenumbers(cd, (cd->next_idx + count - cd->alloc_linenumbers) );
+		pruned = prune_DomainTree(cs->begin_context->dt[0],
+				match_any_RegexSet, &all);
+		write_AsyncLog(LOG_TARGET_STD,
+				"Pruned %lu domains matching %lu regexes.\n", pruned, all.len);
 	}
 
-	transfer_linenumbers(cd->linenumbers + cd->next_idx, &pfbc->co);
-	cd->next_idx += count;
+	free_RegexSet(&all);
 
+	return pruned;
 }
 
 /**
- * Move DomainInfo's to the FILE context specific array.
+ * Mark the line of the DomainInfo as kept in the bitmap of its FILE context.
  */
-static void collect_DomainInfo(DomainInfo_t **di, void *context)
+static void collect_DomainInfo(DomainInfo_t const *di, void *context)
 {
 	ASSERT(di);
-	ASSERT(*di);
 	ASSERT(context);
 
 	ArrayDomainInfo_t *array_di = (ArrayDomainInfo_t*)context;
@@ -556,68 +1225,47 @@ static void collect_DomainInfo(DomainInfo_t **di, void *context)
 	ContextDomain_t *cd = array_di->cd;
 
 	// move to context desired
-	size_t idx = (pfb_context_t*)(*di)->context - array_di->begin_pfb_context;
+	size_t idx = di->file_index;
 	ASSERT(idx < array_di->len_cd);
 
 	// move to desired ContextDomain_t
 	cd += idx;
 
-	if(cd->next_idx >= cd->alloc_linenumbers)
-	{
-		ASSERT(cd->next_idx < cd->alloc_linenumbers + REALLOC_ARRAY_DOMAIN_INFO);
-		resize_ContextLinenumbers(cd, REALLOC_ARRAY_DOMAIN_INFO);
-	}
-
-	// steal the DomainInfo from the DomainTree.
-	// add the DomainInfo to the flat array referenced by context.
-	ASSERT(cd->next_idx < cd->alloc_linenumbers);
-	ASSERT((*di)->linenumber != 0);
-	cd->linenumbers[cd->next_idx++] = (*di)->linenumber;
-	free_DomainInfo(di);
+	ASSERT(di->linenumber != 0);
+	ASSERT(!has_LineBitmap(&cd->kept, di->linenumber));
+	set_LineBitmap(&cd->kept, di->linenumber);
 
 #ifdef COLLECT_DIAGNOSTICS
 	collected_domains_counter++;
 #endif
-
-	ASSERT(*di == NULL);
 }
 
-int sort_LineNumbers(void const *a, void const *b)
+/**
+ * Mark the lines of all DomainInfo and carried over lines in the bitmap of
+ * their FILE context. The bitmaps are scanned in line order when writing so no
+ * sorting is needed. The DomainTree and its arena are released.
+ */
+static void transfer_carry_overs(ArrayDomainInfo_t *array_di)
 {
-	// no line numbers in the 'used' section should be zero
-	ASSERT(*(linenumber_t*)a != 0);
-	ASSERT(*(linenumber_t*)b != 0);
-	return *(linenumber_t*)a - *(linenumber_t*)b;
+	for(size_t i = 0; i < array_di->len_cd; i++)
+	{
+		transfer_carry_over(&array_di->cd[i].kept,
+				&array_di->begin_pfb_context[i].co);
+	}
 }
 
-/**
- * Move all DomainInfo into a flat array of DomainInfo. Sort the DomainInfo
- * based on line number.
- */
-void pfb_consolidate(DomainTree_t **root_dt, ArrayDomainInfo_t *array_di)
+void pfb_consolidate(DomainTree_t **root_dt, Arena_t *arena,
+		ArrayDomainInfo_t *array_di)
 {
 	ASSERT(root_dt);
+	ASSERT(arena);
 	ASSERT(array_di);
 	ASSERT(array_di->len_cd > 0);
 	ASSERT(array_di->cd);
-	for(size_t i = 0; i < array_di->len_cd; i++)
-	{
-		ASSERT(array_di->cd->linenumbers);
-	}
 
-	// 1. consolidate DomainInfo into a flat array
-	// 2. qsort DomainInfo by linenumber; ignore the file info.
-	// 3. iterate the list of DomainInfo and write each one to the respective
-	// file. pfb_context_t will have the file name and each entry has a pointer
-	// to the appropriate context along with linenumber. with the line numbers
-	// in acending order, the file read can be done once and written to the new
-	// files.
-	//
-	// ideally one context passed to the callback and that'll hold all array
-	// information. it will also need to have all contexts to calculate the
-	// index into the array.
 #ifdef COLLECT_DIAGNOSTICS
 	ASSERT(collected_domains_counter == 0);
+	log_DomainTree(*root_dt);
 #endif
 	transfer_DomainInfo(root_dt, collect_DomainInfo, array_di);
 #ifdef COLLECT_DIAGNOSTICS
@@ -626,37 +1274,158 @@ void pfb_consolidate(DomainTree_t **root_dt, ArrayDomainInfo_t *array_di)
 
 	// tree is free'd
 	ASSERT(!*root_dt);
+	free_Arena(arena);
 
-	for(size_t i = 0; i < array_di->len_cd; i++)
-	{
-		// transfer into 'linenumbers' from array_di->begin_pfb_context + i
-		// similar signature to memmove and memcpy:
-		// void *destination, void *source, size_t num
-		transfer_carry_over(&array_di->cd[i], &array_di->begin_pfb_context[i]);
-	}
+	transfer_carry_overs(array_di);
+}
 
-	// this could be done on separate threads.
-	for(size_t i = 0; i < array_di->len_cd; i++)
+static void append_unbound(char const *fqd, size_t len, DomainInfo_t const *di,
+		void *context)
+{
+	append_UnboundConf(context, fqd, len, di->match_strength);
+}
+
+/**
+ * Write every domain of the DomainTree to the Unbound configuration. Call
+ * after pfb_prune_regex() and before pfb_consolidate() releases the tree.
+ */
+void pfb_write_unbound(pfb_contexts_t *cs, UnboundConf_t *uc)
+{
+	ASSERT(cs);
+	ASSERT(cs->begin_context);
+	ASSERT(uc);
+
+	visit_names_DomainTree(cs->begin_context->dt[0], append_unbound, uc);
+}
+
+/**
+ * State of pfb_consolidate_sorted() given to visit_SortedDomain().
+ */
+typedef struct SortedVisit
+{
+	ArrayDomainInfo_t *array_di;
+	UnboundConf_t *uc;
+	// name rebuilt from the key for 'uc'; fits the longest key.
+	char *buf;
+	size_t len_buf;
+} SortedVisit_t;
+
+static void visit_SortedDomain(SortedDomain_t const *d, InsertOutcome_t outcome,
+		bool kept, void *context)
+{
+	SortedVisit_t *sv = context;
+	ArrayDomainInfo_t *array_di = sv->array_di;
+	ASSERT(d->file_index < array_di->len_cd);
+
+	count_FileStats(&array_di->begin_pfb_context[d->file_index].stats, outcome);
+
+	if(kept)
 	{
-#ifdef DEBUG
-		DEBUG_PRINTF("sorting. before sort the line numbers in order are:\n");
-		for(size_t l = 0; l < array_di->cd[i].next_idx; l++)
+		DomainInfo_t di;
+		memset(&di, 0, sizeof(DomainInfo_t));
+		di.linenumber = d->linenumber;
+		di.file_index = d->file_index;
+		di.match_strength = d->match_strength;
+		collect_DomainInfo(&di, array_di);
+
+		// the same names as pfb_write_unbound(); too long ones are reported
+		// by append_UnboundConf().
+		if(sv->uc)
 		{
-			DEBUG_PRINTF("\t%d\n", array_di->cd[i].linenumbers[l]);
+			size_t len;
+			char const *fqd = fqd_SortedDomain(d, sv->buf, sv->len_buf, &len);
+			append_UnboundConf(sv->uc, fqd, len, d->match_strength);
 		}
-#endif
-		ASSERT(i < array_di->len_cd);
-		qsort(array_di->cd[i].linenumbers, array_di->cd[i].next_idx,
-				sizeof(linenumber_t), sort_LineNumbers);
+	}
+}
 
-#ifdef DEBUG
-		DEBUG_PRINTF("sorted. after sort the line numbers in order are:\n");
-		for(size_t l = 0; l < array_di->cd[i].next_idx; l++)
+/**
+ * Same result as pfb_prune_regex() followed by pfb_consolidate() for the
+ * domains read into the SortedDomains_t of the contexts: sort them and mark
+ * the kept lines in one pass. The kept domains are also written to the
+ * optional Unbound configuration. The array is freed.
+ */
+void pfb_consolidate_sorted(pfb_contexts_t *cs, ArrayDomainInfo_t *array_di,
+		size_t num_threads, UnboundConf_t *uc)
+{
+	ASSERT(cs);
+	ASSERT(cs->begin_context);
+	ASSERT(array_di);
+	ASSERT(array_di->begin_pfb_context == cs->begin_context);
+
+	SortedDomains_t *sd = cs->begin_context->sorted;
+	sort_SortedDomains(sd, num_threads);
+
+	RegexSet_t all;
+	merge_context_regexes(cs, &all);
+
+	SortedVisit_t sv;
+	sv.array_di = array_di;
+	sv.uc = uc;
+	sv.buf = NULL;
+	sv.len_buf = sd->max_len_key + 1;
+	if(uc)
+	{
+		sv.buf = malloc(sv.len_buf);
+		if(!sv.buf)
 		{
-			DEBUG_PRINTF("\t%d\n", array_di->cd[i].linenumbers[l]);
+			ELOG_STDERR("ERROR: failed to allocate domain buffer\n");
+			exit(EXIT_FAILURE);
 		}
-#endif
 	}
+
+	const size_t pruned = sweep_SortedDomains(sd,
+			all.len ? match_any_RegexSet : NULL, &all, visit_SortedDomain,
+			&sv);
+	if(all.len)
+	{
+		write_AsyncLog(LOG_TARGET_STD,
+				"Pruned %lu domains matching %lu regexes.\n", pruned, all.len);
+	}
+
+	free(sv.buf);
+	free_RegexSet(&all);
+	free_SortedDomains(sd);
+
+	transfer_carry_overs(array_di);
+}
+
+/**
+ * Write the kept lines of one context to its output file. The buffer is used
+ * to read the input file; pass NULL to have the reader allocate its own.
+ */
+static void pfb_write_context(pfb_context_t *c, ContextDomain_t *cd,
+		void *buffer)
+{
+	ASSERT(c);
+	ASSERT(cd);
+
+	// scan the kept lines in ascending order.
+	NextLineContext_t nlc;
+	init_NextLineContext(&nlc, cd);
+
+	// the output of the previous run is still valid.
+	if(c->snap && skip_write_SnapshotFile(c->snap, nlc.kept))
+	{
+		free_LineSpans(&c->spans);
+		return;
+	}
+
+	// by now, the initial pass and write of regex (if any) is done. now
+	// open the output file in append mode to preserve regexes. the output of
+	// a replayed input was not truncated while reading.
+	pfb_open_context(c, !(c->snap && c->snap->unchanged));
+	// copy the recorded byte ranges when available; otherwise skip lines
+	// until the next_idx line to be read is zero
+	const bool copied = write_spans &&
+		write_pfb_spans(c, nlc.kept) >= 0;
+	if(!copied && nlc.next_linenumber != 0)
+	{
+		read_pfb_line(c, &nlc.next_linenumber, buffer,
+				default_buffer_len(), write_pfb_csv_callback, &nlc);
+	}
+	pfb_close_context(c);
+	free_LineSpans(&c->spans);
 }
 
 /**
@@ -681,50 +1450,138 @@ void pfb_write_csv(pfb_contexts_t *cs, ArrayDomainInfo_t *array_di,
 
 	void *shared_buffer = NULL;
 
-	// optionally use a shared buffer or not. not available for multi-threaded
-	// runs. used by the read function. multi-thread can use a shared buffer for
-	// each thread.
+	// optionally use a shared buffer or not. used by the read function. the
+	// threads of pfb_write_csv_parallel() each use their own.
 	if(use_shared_buffer)
 	{
 		shared_buffer = malloc(sizeof(char) * default_buffer_len());
 	}
 
-	CsvLineView_t lv;
-	// if this is multi-threaded, will need one lv per thread and break the loop
-	// apart for each thread. then find a way to insert into hash table across
-	// multiple threads.
-	init_CsvLineView(&lv);
-
 	for(pfb_context_t *c = cs->begin_context; c != cs->end_context; c++)
 	{
-		// index into parallel array of context associated
-		// DomainInfo/linenumbers
+		// index into parallel array of context associated kept lines
 		const size_t i = c - cs->begin_context;
-
-		// can walk this array of line numbers.
-		NextLineContext_t nlc;
 		ASSERT(i < array_di->len_cd);
-		init_NextLineContext(&nlc, &array_di->cd[i]);
 
-		// by now, the initial pass and write of regex (if any) is done. now
-		// open the output file in append mode to preserve regexes.
-		pfb_open_context(c, true);
-		// skip lines until the next_idx line to be read is zero
-		if(nlc.next_linenumber != 0)
+		pfb_write_context(c, &array_di->cd[i], shared_buffer);
+	}
+
+	if(use_shared_buffer)
+	{
+		free(shared_buffer);
+	}
+
+}
+
+/**
+ * State shared by the threads of pfb_write_csv_parallel().
+ */
+typedef struct ParallelWrite
+{
+	pfb_contexts_t *cs;
+	ArrayDomainInfo_t *array_di;
+	bool use_shared_buffer;
+
+	pthread_mutex_t lock;
+	// next context to be claimed by a writing thread; guarded by 'lock'.
+	size_t next_context;
+} ParallelWrite_t;
+
+static void *pfb_write_thread(void *arg)
+{
+	ParallelWrite_t *pw = arg;
+	const size_t len_contexts = pfb_len_contexts(pw->cs);
+
+	// one buffer per thread, reused for every file it writes.
+	void *buffer = NULL;
+	if(pw->use_shared_buffer)
+	{
+		buffer = malloc(sizeof(char) * default_buffer_len());
+	}
+
+	for(;;)
+	{
+		pthread_mutex_lock(&pw->lock);
+		const size_t idx = pw->next_context;
+		if(idx < len_contexts)
 		{
-			read_pfb_line(c, &nlc.next_linenumber, shared_buffer,
-					default_buffer_len(), write_pfb_csv_callback, &nlc);
+			pw->next_context++;
 		}
-		pfb_close_context(c);
+		pthread_mutex_unlock(&pw->lock);
+
+		if(idx >= len_contexts)
+		{
+			break;
+		}
+
+		pfb_write_context(pw->cs->begin_context + idx, &pw->array_di->cd[idx],
+				buffer);
 	}
 
-	free_CsvLineView(&lv);
+	free(buffer);
 
-	if(use_shared_buffer)
+	return NULL;
+}
+
+/**
+ * Same as pfb_write_csv() with up to 'num_threads' files written at once.
+ * Each file is written by a single thread in line order so the outputs are
+ * identical to pfb_write_csv().
+ */
+void pfb_write_csv_parallel(pfb_contexts_t *cs, ArrayDomainInfo_t *array_di,
+		bool use_shared_buffer, size_t num_threads)
+{
+	ASSERT(cs);
+	ASSERT(cs->begin_context);
+	ASSERT(cs->begin_context != cs->end_context);
+
+	ASSERT(array_di);
+	ASSERT(array_di->begin_pfb_context == cs->begin_context);
+	ASSERT(array_di->len_cd == (uintptr_t)(cs->end_context - cs->begin_context));
+	ASSERT(!*((pfb_context_t*)array_di->begin_pfb_context)->dt);
+
+	const size_t len_contexts = pfb_len_contexts(cs);
+	const size_t num_writers = num_threads < len_contexts ? num_threads :
+		len_contexts;
+
+	if(num_writers <= 1)
 	{
-		free(shared_buffer);
+		pfb_write_csv(cs, array_di, use_shared_buffer);
+		return;
+	}
+
+	ParallelWrite_t pw;
+	memset(&pw, 0, sizeof(ParallelWrite_t));
+	pw.cs = cs;
+	pw.array_di = array_di;
+	pw.use_shared_buffer = use_shared_buffer;
+	pthread_mutex_init(&pw.lock, NULL);
+
+	pthread_t *threads = calloc(num_writers, sizeof(pthread_t));
+	if(!threads)
+	{
+		exit(EXIT_FAILURE);
 	}
 
+	// the calling thread is the first writer.
+	for(size_t t = 1; t < num_writers; t++)
+	{
+		if(pthread_create(&threads[t], NULL, pfb_write_thread, &pw))
+		{
+			ELOG_STDERR("ERROR: failed to create write thread.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	pfb_write_thread(&pw);
+
+	for(size_t t = 1; t < num_writers; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+
+	pthread_mutex_destroy(&pw.lock);
+	free(threads);
 }
 
 #ifdef BUILD_TESTS
@@ -966,9 +1823,8 @@ static void test_init_ArrayDi()
 
 	assert(array_di.cd);
 	assert(array_di.len_cd == 1);
-	assert(array_di.cd[0].linenumbers);
-	assert(array_di.cd[0].next_idx == 0);
-	assert(array_di.cd[0].alloc_linenumbers == INITIAL_ARRAY_DOMAIN_INFO);
+	assert(!array_di.cd[0].kept.words);
+	assert(array_di.cd[0].kept.count == 0);
 
 	free_ArrayDomainInfo(&array_di);
 
@@ -1498,6 +2354,17 @@ static void test_pfb_insert()
 
 }
 
+/**
+ * Returns the single TLD held by the given tree.
+ */
+static DomainTree_t *test_only_tld(DomainTree_t *root)
+{
+	size_t pos = 0;
+	assert(root);
+	assert(len_DomainChildren(&root->children) == 1);
+	return next_DomainChildren(&root->children, &pos);
+}
+
 static void test_pfb_insert_0()
 {
 	char *const argv_i[] = {"tests/unit_pfb_prune/FileInput_1.txt"};
@@ -1523,10 +2390,10 @@ static void test_pfb_insert_0()
 	pfb_insert(&pld, pfbc.begin_context, &context);
 
 	assert(pfbc.begin_context->dt[0]);
-	assert(pfbc.begin_context->dt[0]->di);
-	assert(pfbc.begin_context->dt[0]->di->linenumber == 10);
-	assert(pfbc.begin_context->dt[0]->di->match_strength == MATCH_WEAK);
-	assert(pfbc.begin_context->dt[0]->di->context == pfbc.begin_context);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.match_strength != MATCH_NOTSET);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.linenumber == 10);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.match_strength == MATCH_WEAK);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.file_index == 0);
 
 	free_CsvLineView(&lv_context);
 	free_DomainView(&dv_context);
@@ -1566,10 +2433,10 @@ static void test_pfb_insert_1()
 	pfb_insert(&pld, pfbc.begin_context, &context);
 
 	assert(pfbc.begin_context->dt[0]);
-	assert(pfbc.begin_context->dt[0]->di);
-	assert(pfbc.begin_context->dt[0]->di->linenumber == 11);
-	assert(pfbc.begin_context->dt[0]->di->match_strength == MATCH_FULL);
-	assert(pfbc.begin_context->dt[0]->di->context == pfbc.begin_context);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.match_strength != MATCH_NOTSET);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.linenumber == 11);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.match_strength == MATCH_FULL);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.file_index == 0);
 
 	free_CsvLineView(&lv_context);
 	free_DomainView(&dv_context);
@@ -1655,10 +2522,10 @@ static void test_pfb_insert_fewcols()
 	pfb_insert(&pld, pfbc.begin_context, &context);
 
 	assert(pfbc.begin_context->dt[0]);
-	assert(pfbc.begin_context->dt[0]->di);
-	assert(pfbc.begin_context->dt[0]->di->linenumber == 12);
-	assert(pfbc.begin_context->dt[0]->di->match_strength == MATCH_WEAK);
-	assert(pfbc.begin_context->dt[0]->di->context == pfbc.begin_context);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.match_strength != MATCH_NOTSET);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.linenumber == 12);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.match_strength == MATCH_WEAK);
+	assert(test_only_tld(pfbc.begin_context->dt[0])->di.file_index == 0);
 
 	free_CsvLineView(&lv_context);
 	free_DomainView(&dv_context);
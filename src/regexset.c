@@ -0,0 +1,908 @@
+/**
+ * regexset.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "regexset.h"
+#include <regex.h>
+#include <stdint.h>
+
+// no entry or state
+static const size_t NONE = SIZE_MAX;
+
+typedef struct RegexEntry
+{
+	regex_t *compiled;
+	// literal every match of the pattern contains; NULL if there is none.
+	char *literal;
+	size_t len_literal;
+	// next entry whose literal ends at the same state of the automaton.
+	size_t next_out;
+	// value of RegexSet::stamp when last tested against a domain.
+	uint stamp;
+} RegexEntry_t;
+
+/**
+ * Aho-Corasick automaton over the literals of the entries. Bytes that appear
+ * in no literal share class 0 to keep the transition table small.
+ */
+typedef struct RegexAutomaton
+{
+	uchar classes[256];
+	size_t len_classes;
+	// len_states * len_classes transitions
+	size_t *delta;
+	// first entry whose literal ends at the state
+	size_t *out;
+	// nearest state along the failure links with entries of its own
+	size_t *dict;
+	size_t len_states;
+	size_t alloc_states;
+	// entries without a literal are tested against every domain.
+	size_t *always;
+	size_t len_always;
+} RegexAutomaton_t;
+
+/**
+ * Append the given string to 'out' and advance it.
+ */
+static void emit(char **out, char const *s)
+{
+	const size_t len = strlen(s);
+	memcpy(*out, s, len);
+	*out += len;
+}
+
+static int hex_value(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * Translate a Python re pattern of 'len' characters into a null terminated
+ * POSIX extended regular expression written to 'out', which must hold at least
+ * 16 * len + 1 characters. Only whether a pattern matches anywhere in a domain
+ * is of interest so lazy quantifiers become greedy ones. Returns false for
+ * constructs that have no equivalent, e.g., lookarounds and \b.
+ */
+static bool translate_Regex(char const *in, size_t len, char *out)
+{
+	ASSERT(in);
+	ASSERT(out);
+
+	char const *const end = in + len;
+	// start of the current bracket expression or NULL outside of one.
+	char const *bracket = NULL;
+
+	while(in != end)
+	{
+		char c = *in++;
+
+		if(bracket)
+		{
+			// a ']' right after '[' or '[^' is a literal.
+			if(c == ']' && in - 1 != bracket)
+			{
+				bracket = NULL;
+				*out++ = c;
+				continue;
+			}
+
+			if(c == '[')
+			{
+				// POSIX classes and collating elements; unsupported in Python.
+				return false;
+			}
+
+			if(c != '\\')
+			{
+				*out++ = c;
+				continue;
+			}
+
+			if(in == end)
+			{
+				return false;
+			}
+
+			c = *in++;
+			switch(c)
+			{
+				case 's': emit(&out, "[:space:]"); continue;
+				case 'd': emit(&out, "[:digit:]"); continue;
+				case 'w': emit(&out, "[:alnum:]_"); continue;
+				case 'n': *out++ = '\n'; continue;
+				case 't': *out++ = '\t'; continue;
+				case 'x':
+					if(end - in < 2 || hex_value(in[0]) < 0 || hex_value(in[1]) < 0)
+					{
+						return false;
+					}
+					c = hex_value(in[0]) * 16 + hex_value(in[1]);
+					in += 2;
+					break;
+				default:
+					break;
+			}
+
+			// within brackets these only keep their meaning by position.
+			if(c == ']' || c == '[' || c == '^' || c == '-' || c == '\0' ||
+					(c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+					(c >= '0' && c <= '9'))
+			{
+				return false;
+			}
+			*out++ = c;
+			continue;
+		}
+
+		switch(c)
+		{
+			case '[':
+				*out++ = c;
+				bracket = in;
+				if(in != end && *in == '^')
+				{
+					*out++ = *in++;
+					bracket = in;
+				}
+				continue;
+			case '(':
+				if(in != end && *in == '?')
+				{
+					// only non-capturing groups have an equivalent.
+					if(end - in < 2 || in[1] != ':')
+					{
+						return false;
+					}
+					in += 2;
+				}
+				*out++ = c;
+				continue;
+			case '*':
+			case '+':
+			case '?':
+			case '}':
+				*out++ = c;
+				// lazy and greedy quantifiers match the same strings.
+				if(in != end && *in == '?')
+				{
+					in++;
+				}
+				continue;
+			case '\\':
+				break;
+			default:
+				*out++ = c;
+				continue;
+		}
+
+		if(in == end)
+		{
+			return false;
+		}
+
+		c = *in++;
+		switch(c)
+		{
+			case 's': emit(&out, "[[:space:]]"); continue;
+			case 'S': emit(&out, "[^[:space:]]"); continue;
+			case 'd': emit(&out, "[[:digit:]]"); continue;
+			case 'D': emit(&out, "[^[:digit:]]"); continue;
+			case 'w': emit(&out, "[[:alnum:]_]"); continue;
+			case 'W': emit(&out, "[^[:alnum:]_]"); continue;
+			case 'n': *out++ = '\n'; continue;
+			case 't': *out++ = '\t'; continue;
+			case 'x':
+				if(end - in < 2 || hex_value(in[0]) < 0 || hex_value(in[1]) < 0)
+				{
+					return false;
+				}
+				c = hex_value(in[0]) * 16 + hex_value(in[1]);
+				in += 2;
+				break;
+			default:
+				// \b, \A, back references, etc.
+				if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+						(c >= '0' && c <= '9'))
+				{
+					return false;
+				}
+				break;
+		}
+
+		if(c == '\0')
+		{
+			return false;
+		}
+
+		if(strchr(".[]()*+?{}|^$\\", c))
+		{
+			*out++ = '\\';
+		}
+		*out++ = c;
+	}
+
+	*out = '\0';
+
+	// an unterminated bracket expression
+	return !bracket;
+}
+
+/**
+ * Returns the index just past the bracket expression or group that begins at
+ * 'i', or 'len' if it is not terminated.
+ */
+static size_t skip_Regex(char const *in, size_t len, size_t i)
+{
+	size_t depth = 0;
+	bool bracket = false;
+
+	for(; i < len; i++)
+	{
+		const char c = in[i];
+		if(c == '\\')
+		{
+			i++;
+		}
+		else if(bracket)
+		{
+			// a ']' right after '[' or '[^' is a literal.
+			if(c == ']' && in[i - 1] != '[' && !(in[i - 1] == '^' && in[i - 2] == '['))
+			{
+				bracket = false;
+				if(!depth)
+				{
+					return i + 1;
+				}
+			}
+		}
+		else if(c == '[')
+		{
+			bracket = true;
+		}
+		else if(c == '(')
+		{
+			depth++;
+		}
+		else if(c == ')')
+		{
+			depth--;
+			if(!depth)
+			{
+				return i + 1;
+			}
+		}
+	}
+
+	return len;
+}
+
+static bool quantifier(char c)
+{
+	return c == '*' || c == '+' || c == '?' || c == '{';
+}
+
+/**
+ * Find the longest run of literal characters at the top level of a Python re
+ * pattern, i.e., outside of groups, bracket expressions and alternations.
+ * Every match of the pattern contains the run. Returns a copy of the run in
+ * 'literal' and its length; 0 when the pattern has no such run.
+ */
+static size_t required_literal(char const *in, size_t len, char **literal)
+{
+	ASSERT(in);
+	ASSERT(literal);
+
+	char *run = malloc(len + 1);
+	char *best = malloc(len + 1);
+	if(!run || !best)
+	{
+		ELOG_STDERR("ERROR: failed to allocate regex literal\n");
+		exit(EXIT_FAILURE);
+	}
+
+	size_t len_run = 0, len_best = 0;
+	size_t i = 0;
+
+	while(i < len)
+	{
+		char c = in[i];
+		bool is_literal = false;
+
+		if(c == '\\' && i + 1 < len)
+		{
+			const char e = in[i + 1];
+			i += 2;
+			if(e == 'x' && i + 2 <= len && hex_value(in[i]) >= 0 &&
+					hex_value(in[i + 1]) >= 0)
+			{
+				c = hex_value(in[i]) * 16 + hex_value(in[i + 1]);
+				i += 2;
+				is_literal = c != '\0';
+			}
+			else if(e == 'n' || e == 't')
+			{
+				c = e == 'n' ? '\n' : '\t';
+				is_literal = true;
+			}
+			else if(!((e >= 'a' && e <= 'z') || (e >= 'A' && e <= 'Z') ||
+						(e >= '0' && e <= '9')))
+			{
+				c = e;
+				is_literal = true;
+			}
+		}
+		else if(c == '[' || c == '(')
+		{
+			i = skip_Regex(in, len, i);
+		}
+		else if(c == '|')
+		{
+			// any one alternative may match; nothing is required.
+			len_best = len_run = 0;
+			break;
+		}
+		else if(c == '{')
+		{
+			while(i < len && in[i] != '}')
+			{
+				i++;
+			}
+			i++;
+		}
+		else
+		{
+			i++;
+			is_literal = !strchr(".^$*+?)", c);
+		}
+
+		// a quantified character may be absent or repeated.
+		if(is_literal && !(i < len && quantifier(in[i])))
+		{
+			run[len_run++] = c;
+			continue;
+		}
+
+		if(len_run > len_best)
+		{
+			memcpy(best, run, len_run);
+			len_best = len_run;
+		}
+		len_run = 0;
+	}
+
+	if(len_run > len_best)
+	{
+		memcpy(best, run, len_run);
+		len_best = len_run;
+	}
+
+	free(run);
+
+	if(!len_best)
+	{
+		free(best);
+		best = NULL;
+	}
+
+	*literal = best;
+	return len_best;
+}
+
+static void free_RegexAutomaton(RegexAutomaton_t *ac)
+{
+	if(!ac)
+	{
+		return;
+	}
+	free(ac->delta);
+	free(ac->out);
+	free(ac->dict);
+	free(ac->always);
+	free(ac);
+}
+
+/**
+ * Add a state without transitions to the automaton and return its index.
+ */
+static size_t add_state(RegexAutomaton_t *ac)
+{
+	if(ac->len_states == ac->alloc_states)
+	{
+		ac->alloc_states = ac->alloc_states ? ac->alloc_states * 2 : 64;
+		ac->delta = realloc(ac->delta,
+				sizeof(size_t) * ac->alloc_states * ac->len_classes);
+		ac->out = realloc(ac->out, sizeof(size_t) * ac->alloc_states);
+		ac->dict = realloc(ac->dict, sizeof(size_t) * ac->alloc_states);
+		if(!ac->delta || !ac->out || !ac->dict)
+		{
+			ELOG_STDERR("ERROR: failed to realloc regex automaton\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	const size_t state = ac->len_states++;
+	for(size_t c = 0; c < ac->len_classes; c++)
+	{
+		ac->delta[state * ac->len_classes + c] = NONE;
+	}
+	ac->out[state] = NONE;
+	ac->dict[state] = NONE;
+	return state;
+}
+
+/**
+ * Build the automaton over the literals of all entries of the set.
+ */
+static RegexAutomaton_t *build_RegexAutomaton(RegexSet_t *rs)
+{
+	RegexAutomaton_t *ac = calloc(1, sizeof(RegexAutomaton_t));
+	ac->always = malloc(sizeof(size_t) * rs->len);
+	if(!ac || !ac->always)
+	{
+		ELOG_STDERR("ERROR: failed to allocate regex automaton\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// class 0 is every byte not found in a literal.
+	ac->len_classes = 1;
+	for(size_t i = 0; i < rs->len; i++)
+	{
+		RegexEntry_t const *e = &rs->entries[i];
+		for(size_t l = 0; l < e->len_literal; l++)
+		{
+			const uchar b = e->literal[l];
+			if(!ac->classes[b])
+			{
+				ac->classes[b] = ac->len_classes++;
+			}
+		}
+	}
+
+	const size_t k = ac->len_classes;
+	add_state(ac);
+
+	// trie of the literals
+	for(size_t i = 0; i < rs->len; i++)
+	{
+		RegexEntry_t *e = &rs->entries[i];
+		if(!e->literal)
+		{
+			ac->always[ac->len_always++] = i;
+			continue;
+		}
+
+		size_t state = 0;
+		for(size_t l = 0; l < e->len_literal; l++)
+		{
+			const size_t c = ac->classes[(uchar)e->literal[l]];
+			if(ac->delta[state * k + c] == NONE)
+			{
+				const size_t next = add_state(ac);
+				ac->delta[state * k + c] = next;
+			}
+			state = ac->delta[state * k + c];
+		}
+		e->next_out = ac->out[state];
+		ac->out[state] = i;
+	}
+
+	// breadth first: failure links become transitions so matching needs one
+	// table lookup per byte. states are numbered so a parent always precedes
+	// its children; a queue holds them in breadth first order.
+	size_t *fail = malloc(sizeof(size_t) * ac->len_states);
+	size_t *queue = malloc(sizeof(size_t) * ac->len_states);
+	if(!fail || !queue)
+	{
+		ELOG_STDERR("ERROR: failed to allocate regex automaton\n");
+		exit(EXIT_FAILURE);
+	}
+	size_t head = 0, tail = 0;
+
+	fail[0] = 0;
+	for(size_t c = 0; c < k; c++)
+	{
+		const size_t next = ac->delta[c];
+		if(next == NONE)
+		{
+			ac->delta[c] = 0;
+		}
+		else
+		{
+			fail[next] = 0;
+			queue[tail++] = next;
+		}
+	}
+
+	while(head != tail)
+	{
+		const size_t state = queue[head++];
+		for(size_t c = 0; c < k; c++)
+		{
+			const size_t next = ac->delta[state * k + c];
+			const size_t via_fail = ac->delta[fail[state] * k + c];
+			if(next == NONE)
+			{
+				ac->delta[state * k + c] = via_fail;
+				continue;
+			}
+
+			fail[next] = via_fail;
+			ac->dict[next] = ac->out[via_fail] != NONE ? via_fail :
+				ac->dict[via_fail];
+			queue[tail++] = next;
+		}
+	}
+
+	free(fail);
+	free(queue);
+
+	return ac;
+}
+
+void init_RegexSet(RegexSet_t *rs)
+{
+	ASSERT(rs);
+	rs->entries = NULL;
+	rs->len = 0;
+	rs->alloc = 0;
+	rs->ac = NULL;
+	rs->stamp = 0;
+}
+
+void free_RegexSet(RegexSet_t *rs)
+{
+	ASSERT(rs);
+	for(size_t i = 0; i < rs->len; i++)
+	{
+		regfree(rs->entries[i].compiled);
+		free(rs->entries[i].compiled);
+		free(rs->entries[i].literal);
+	}
+	free(rs->entries);
+	free_RegexAutomaton(rs->ac);
+	init_RegexSet(rs);
+}
+
+static void grow_RegexSet(RegexSet_t *rs, size_t count)
+{
+	if(rs->len + count <= rs->alloc)
+	{
+		return;
+	}
+
+	size_t alloc = rs->alloc ? rs->alloc : 16;
+	while(alloc < rs->len + count)
+	{
+		alloc *= 2;
+	}
+
+	RegexEntry_t *tmp = realloc(rs->entries, sizeof(RegexEntry_t) * alloc);
+	if(!tmp)
+	{
+		ELOG_STDERR("ERROR: failed to realloc RegexSet\n");
+		exit(EXIT_FAILURE);
+	}
+	rs->entries = tmp;
+	rs->alloc = alloc;
+}
+
+/**
+ * Translate and compile the given pattern of 'len' characters. Returns false
+ * if the pattern is not supported or does not compile; the set is unchanged.
+ */
+bool insert_RegexSet(RegexSet_t *rs, char const *pattern, size_t len)
+{
+	ASSERT(rs);
+	ASSERT(pattern);
+
+	char *translated = malloc(len * 16 + 1);
+	regex_t *compiled = malloc(sizeof(regex_t));
+	if(!translated || !compiled)
+	{
+		ELOG_STDERR("ERROR: failed to allocate translated regex\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if(!translate_Regex(pattern, len, translated) ||
+			regcomp(compiled, translated, REG_EXTENDED | REG_NOSUB))
+	{
+		free(translated);
+		free(compiled);
+		return false;
+	}
+	free(translated);
+
+	grow_RegexSet(rs, 1);
+
+	RegexEntry_t *e = &rs->entries[rs->len++];
+	e->compiled = compiled;
+	e->len_literal = required_literal(pattern, len, &e->literal);
+	e->next_out = NONE;
+	e->stamp = 0;
+
+	// rebuilt with the new literal on the next match.
+	free_RegexAutomaton(rs->ac);
+	rs->ac = NULL;
+
+	return true;
+}
+
+/**
+ * Move all regexes of 'src' to the end of 'dest'. 'src' is left empty.
+ */
+void merge_RegexSet(RegexSet_t *dest, RegexSet_t *src)
+{
+	ASSERT(dest);
+	ASSERT(src);
+
+	if(!src->len)
+	{
+		return;
+	}
+
+	grow_RegexSet(dest, src->len);
+	memcpy(dest->entries + dest->len, src->entries,
+			sizeof(RegexEntry_t) * src->len);
+	dest->len += src->len;
+
+	free_RegexAutomaton(dest->ac);
+	dest->ac = NULL;
+
+	// the entries now belong to 'dest'
+	src->len = 0;
+	free_RegexSet(src);
+}
+
+/**
+ * Run the entry against the domain unless it already was for this domain.
+ */
+static bool test_RegexEntry(RegexSet_t *rs, size_t idx, char const *fqd)
+{
+	RegexEntry_t *e = &rs->entries[idx];
+	if(e->stamp == rs->stamp)
+	{
+		return false;
+	}
+	e->stamp = rs->stamp;
+	return regexec(e->compiled, fqd, 0, NULL, 0) == 0;
+}
+
+/**
+ * Returns true if any regex of the set matches anywhere in the given null
+ * terminated domain. Only the regexes whose literal is found in the domain in
+ * one pass of the automaton, and those without a literal, are run.
+ */
+bool match_RegexSet(RegexSet_t *rs, char const *fqd)
+{
+	ASSERT(rs);
+	ASSERT(fqd);
+
+	if(!rs->len)
+	{
+		return false;
+	}
+
+	if(!rs->ac)
+	{
+		rs->ac = build_RegexAutomaton(rs);
+	}
+
+	RegexAutomaton_t const *ac = rs->ac;
+
+	// a new stamp marks every entry as not yet tested for this domain.
+	if(++rs->stamp == 0)
+	{
+		for(size_t i = 0; i < rs->len; i++)
+		{
+			rs->entries[i].stamp = 0;
+		}
+		rs->stamp = 1;
+	}
+
+	for(size_t i = 0; i < ac->len_always; i++)
+	{
+		if(test_RegexEntry(rs, ac->always[i], fqd))
+		{
+			return true;
+		}
+	}
+
+	size_t state = 0;
+	for(char const *c = fqd; *c; c++)
+	{
+		state = ac->delta[state * ac->len_classes + ac->classes[(uchar)*c]];
+
+		size_t s = ac->out[state] != NONE ? state : ac->dict[state];
+		for(; s != NONE; s = ac->dict[s])
+		{
+			for(size_t idx = ac->out[s]; idx != NONE; idx = rs->entries[idx].next_out)
+			{
+				if(test_RegexEntry(rs, idx, fqd))
+				{
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+#ifdef BUILD_TESTS
+static void test_translate_Regex()
+{
+	char out[512];
+	const struct { char const *in; char const *out; } cases[] = {
+		{"(?:^|\\.)8[^\"\\x2c\\s]*\\.tianya\\.cn",
+			"(^|\\.)8[^\",[:space:]]*\\.tianya\\.cn"},
+		{"ads\\d+\\.example\\.com$", "ads[[:digit:]]+\\.example\\.com$"},
+		{"^a.*?b\\x2e", "^a.*b\\."},
+		{"[]a]\\S", "[]a][^[:space:]]"},
+	};
+
+	for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		assert(translate_Regex(cases[i].in, strlen(cases[i].in), out));
+		assert(!strcmp(out, cases[i].out));
+	}
+
+	char const *unsupported[] = {"(?=ads)", "\\bads", "(a)\\1", "[a", "a\\",
+		"[\\x5d]", "(?i)ads"};
+	for(size_t i = 0; i < sizeof(unsupported) / sizeof(unsupported[0]); i++)
+	{
+		assert(!translate_Regex(unsupported[i], strlen(unsupported[i]), out));
+	}
+}
+
+static void test_match_RegexSet()
+{
+	RegexSet_t rs;
+	init_RegexSet(&rs);
+	assert(!rs.entries && !rs.len && !rs.alloc && !rs.ac);
+
+	assert(!match_RegexSet(&rs, "anything.com"));
+
+	char const *p1 = "(?:^|\\.)ac[^\"\\x2c\\s]*\\.786ip\\.com";
+	char const *p2 = "^party-[^\"\\x2c\\s]*\\.now\\.sh$";
+	assert(insert_RegexSet(&rs, p1, strlen(p1)));
+	assert(insert_RegexSet(&rs, p2, strlen(p2)));
+	assert(!insert_RegexSet(&rs, "(?!x)", 5));
+	assert(rs.len == 2);
+
+	assert(match_RegexSet(&rs, "acxyz.786ip.com"));
+	assert(match_RegexSet(&rs, "www.ac.786ip.com"));
+	assert(match_RegexSet(&rs, "party-1.now.sh"));
+	assert(!match_RegexSet(&rs, "bac.786ip.com"));
+	assert(!match_RegexSet(&rs, "x.party-1.now.sh"));
+	assert(!match_RegexSet(&rs, "786ip.com"));
+
+	// enough to grow the set
+	for(size_t i = 0; i < 40; i++)
+	{
+		assert(insert_RegexSet(&rs, p1, strlen(p1)));
+	}
+	assert(rs.len == 42);
+
+	free_RegexSet(&rs);
+	assert(!rs.entries && !rs.len && !rs.alloc && !rs.ac);
+}
+
+static void test_required_literal()
+{
+	char *literal;
+	const struct { char const *in; char const *literal; } cases[] = {
+		{"(?:^|\\.)8[^\"\\x2c\\s]*\\.tianya\\.cn", ".tianya.cn"},
+		{"^party-[^\"\\x2c\\s]*\\.now\\.sh$", ".now.sh"},
+		{"ads\\d+\\x2eexample", ".example"},
+		{"abcd?ef", "abc"},
+		{"ab{2}cd", "cd"},
+		{"a(bcdef)g", "a"},
+	};
+
+	for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		const size_t len = required_literal(cases[i].in, strlen(cases[i].in),
+				&literal);
+		assert(len == strlen(cases[i].literal));
+		assert(!memcmp(literal, cases[i].literal, len));
+		free(literal);
+	}
+
+	char const *none[] = {"ads|track", "^.*$", "(abc)", "\\d\\w+", "a*"};
+	for(size_t i = 0; i < sizeof(none) / sizeof(none[0]); i++)
+	{
+		assert(!required_literal(none[i], strlen(none[i]), &literal));
+		assert(!literal);
+	}
+}
+
+static void test_merge_RegexSet()
+{
+	RegexSet_t rs, other;
+	init_RegexSet(&rs);
+	init_RegexSet(&other);
+
+	char const *patterns[] = {"tracker", "^ads\\.", "\\.cdn\\d*\\.net$",
+		"(?:^|\\.)ac[^\"\\x2c\\s]*\\.786ip\\.com", "^[a-z]+-[0-9]+\\.",
+		"ad|ads", "acker\\.org"};
+	const size_t len_patterns = sizeof(patterns) / sizeof(patterns[0]);
+
+	regex_t compiled[sizeof(patterns) / sizeof(patterns[0])];
+	char translated[512];
+	for(size_t i = 0; i < len_patterns; i++)
+	{
+		assert(insert_RegexSet(i % 2 ? &rs : &other, patterns[i],
+					strlen(patterns[i])));
+		assert(translate_Regex(patterns[i], strlen(patterns[i]), translated));
+		assert(!regcomp(&compiled[i], translated, REG_EXTENDED | REG_NOSUB));
+	}
+
+	// built before the merge and rebuilt after.
+	assert(match_RegexSet(&other, "tracker.com"));
+	merge_RegexSet(&rs, &other);
+	assert(rs.len == len_patterns);
+	assert(other.len == 0 && !other.entries && !other.ac);
+
+	// the automaton must agree with running every regex.
+	char const *labels[] = {"ads", "tracker", "cdn7", "net", "ac1", "786ip",
+		"com", "x-1", "acker", "org", "ad"};
+	const size_t len_labels = sizeof(labels) / sizeof(labels[0]);
+	char fqd[128];
+	size_t matched = 0;
+
+	for(size_t i = 0; i < len_labels * len_labels * len_labels; i++)
+	{
+		snprintf(fqd, sizeof(fqd), "%s.%s.%s", labels[i % len_labels],
+				labels[i / len_labels % len_labels],
+				labels[i / len_labels / len_labels]);
+
+		bool expect = false;
+		for(size_t p = 0; p < len_patterns && !expect; p++)
+		{
+			expect = !regexec(&compiled[p], fqd, 0, NULL, 0);
+		}
+
+		assert(match_RegexSet(&rs, fqd) == expect);
+		matched += expect;
+	}
+	assert(matched > 0 && matched < len_labels * len_labels * len_labels);
+
+	for(size_t i = 0; i < len_patterns; i++)
+	{
+		regfree(&compiled[i]);
+	}
+	free_RegexSet(&rs);
+}
+
+void test_RegexSet()
+{
+	test_translate_Regex();
+	test_required_literal();
+	test_match_RegexSet();
+	test_merge_RegexSet();
+}
+#endif
@@ -0,0 +1,244 @@
+/**
+ * runstats.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// clock_gettime() is hidden by -std=c17 otherwise
+#define _POSIX_C_SOURCE 200809L
+#include "dedupdomains.h"
+#include "runstats.h"
+#include "pfb_context.h"
+#include <sys/resource.h>
+
+static const char *PHASE_NAMES[PHASE_COUNT] = { "read", "consolidate",
+	"write" };
+
+/**
+ * Tally the outcome of inserting one domain of a file.
+ */
+void count_FileStats(FileStats_t *fs, InsertOutcome_t outcome)
+{
+	ASSERT(fs);
+
+	switch(outcome)
+	{
+		case INSERT_NEW:
+			fs->inserted++;
+			break;
+		case INSERT_REPLACED:
+			fs->replaced++;
+			break;
+		case INSERT_UNDER_FULL:
+			fs->under_full++;
+			break;
+		case INSERT_IDENTICAL:
+			fs->identical++;
+			break;
+		case INSERT_SKIPPED:
+		default:
+			fs->bogus++;
+			break;
+	}
+}
+
+void add_FileStats(FileStats_t *dest, FileStats_t const *src)
+{
+	ASSERT(dest);
+	ASSERT(src);
+
+	dest->lines += src->lines;
+	dest->bytes += src->bytes;
+	dest->inserted += src->inserted;
+	dest->replaced += src->replaced;
+	dest->under_full += src->under_full;
+	dest->identical += src->identical;
+	dest->regex += src->regex;
+	dest->bogus += src->bogus;
+}
+
+static double cpu_seconds()
+{
+	struct rusage ru;
+	if(getrusage(RUSAGE_SELF, &ru) != 0)
+	{
+		return 0.0;
+	}
+
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+void init_RunStats(RunStats_t *rs)
+{
+	ASSERT(rs);
+	memset(rs, 0, sizeof(RunStats_t));
+	rs->engine = "tree";
+}
+
+/**
+ * Mark the start of the next phase.
+ */
+void begin_RunStats(RunStats_t *rs)
+{
+	ASSERT(rs);
+	clock_gettime(CLOCK_MONOTONIC, &rs->wall_begin);
+	rs->cpu_begin = cpu_seconds();
+}
+
+/**
+ * Add the time since begin_RunStats() to the given phase.
+ */
+void end_RunStats(RunStats_t *rs, RunPhase_t phase)
+{
+	ASSERT(rs);
+	ASSERT(phase < PHASE_COUNT);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	rs->wall[phase] += (now.tv_sec - rs->wall_begin.tv_sec) +
+		(now.tv_nsec - rs->wall_begin.tv_nsec) / 1e9;
+	rs->cpu[phase] += cpu_seconds() - rs->cpu_begin;
+}
+
+static void write_json_string(FILE *out, char const *s)
+{
+	fputc('"', out);
+	for(; *s; s++)
+	{
+		const unsigned char c = *s;
+		if(c == '"' || c == '\\')
+		{
+			fprintf(out, "\\%c", c);
+		}
+		else if(c < 0x20)
+		{
+			fprintf(out, "\\u%04x", c);
+		}
+		else
+		{
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+static void write_json_FileStats(FILE *out, FileStats_t const *fs)
+{
+	fprintf(out, "\"lines\":%zu,\"bytes\":%zu,\"inserted\":%zu,"
+			"\"replaced_by_stronger\":%zu,\"rejected_by_full_ancestor\":%zu,"
+			"\"identical_skipped\":%zu,\"regex_carried\":%zu,"
+			"\"bogus_skipped\":%zu",
+			fs->lines, fs->bytes, fs->inserted, fs->replaced, fs->under_full,
+			fs->identical, fs->regex, fs->bogus);
+}
+
+/**
+ * Write the engine, the timings of every phase, the counts of every file of
+ * the given contexts and the peak resident set size as one line of JSON.
+ */
+void write_json_RunStats(FILE *out, RunStats_t const *rs,
+		pfb_contexts_t *cs)
+{
+	ASSERT(out);
+	ASSERT(rs);
+	ASSERT(cs);
+
+	fputs("{\"engine\":", out);
+	write_json_string(out, rs->engine);
+	fputs(",\"phases\":{", out);
+	for(size_t p = 0; p < PHASE_COUNT; p++)
+	{
+		fprintf(out, "%s\"%s\":{\"wall_s\":%.6f,\"cpu_s\":%.6f}",
+				p ? "," : "", PHASE_NAMES[p], rs->wall[p], rs->cpu[p]);
+	}
+
+	FileStats_t total;
+	memset(&total, 0, sizeof(FileStats_t));
+
+	fputs("},\"files\":[", out);
+	for(pfb_context_t *c = cs->begin_context; c != cs->end_context; c++)
+	{
+		fprintf(out, "%s{\"name\":", c == cs->begin_context ? "" : ",");
+		write_json_string(out, c->in_fname);
+		fputc(',', out);
+		write_json_FileStats(out, &c->stats);
+		fputc('}', out);
+		add_FileStats(&total, &c->stats);
+	}
+
+	fputs("],\"total\":{", out);
+	write_json_FileStats(out, &total);
+
+	// ru_maxrss is in kilobytes on Linux and the BSDs.
+	struct rusage ru;
+	const long peak = getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+	fprintf(out, "},\"peak_rss_kb\":%ld}\n", peak);
+}
+
+#ifdef BUILD_TESTS
+void test_RunStats()
+{
+	FileStats_t fs;
+	memset(&fs, 0, sizeof(FileStats_t));
+
+	count_FileStats(&fs, INSERT_NEW);
+	count_FileStats(&fs, INSERT_NEW);
+	count_FileStats(&fs, INSERT_REPLACED);
+	count_FileStats(&fs, INSERT_UNDER_FULL);
+	count_FileStats(&fs, INSERT_IDENTICAL);
+	count_FileStats(&fs, INSERT_SKIPPED);
+	assert(fs.inserted == 2);
+	assert(fs.replaced == 1);
+	assert(fs.under_full == 1);
+	assert(fs.identical == 1);
+	assert(fs.bogus == 1);
+
+	RunStats_t rs;
+	init_RunStats(&rs);
+	begin_RunStats(&rs);
+	end_RunStats(&rs, PHASE_WRITE);
+	assert(rs.wall[PHASE_WRITE] >= 0.0);
+	assert(rs.wall[PHASE_READ] == 0.0);
+
+	pfb_context_t c;
+	memset(&c, 0, sizeof(pfb_context_t));
+	c.in_fname = "dir/\"quoted\".fat";
+	c.stats = fs;
+	c.stats.lines = 7;
+	pfb_contexts_t cs = { &c, &c + 1 };
+
+	FILE *out = tmpfile();
+	assert(out);
+	write_json_RunStats(out, &rs, &cs);
+	rewind(out);
+
+	char line[1024];
+	assert(fgets(line, sizeof(line), out));
+	fclose(out);
+
+	assert(!strncmp(line, "{\"engine\":\"tree\",", 16));
+	assert(strstr(line, "\"write\":{\"wall_s\":"));
+	assert(strstr(line, "\"name\":\"dir/\\\"quoted\\\".fat\""));
+	assert(strstr(line, "\"lines\":7,"));
+	assert(strstr(line, "\"inserted\":2,"));
+	assert(strstr(line, "\"rejected_by_full_ancestor\":1,"));
+	assert(strstr(line, "\"peak_rss_kb\":"));
+	assert(line[strlen(line) - 2] == '}');
+}
+#endif
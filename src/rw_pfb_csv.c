@@ -18,11 +18,17 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+// posix_madvise() is hidden by -std=c17 otherwise
+#define _POSIX_C_SOURCE 200809L
 #include "dedupdomains.h"
 #include "rw_pfb_csv.h"
 #include "contextdomain.h"
 #include "pfb_context.h"
 #include "pfb_prune.h"
+#include "linespans.h"
+#include "scan.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // 4096 is *probably* a safe sane reasonable default.
 static const size_t READ_BUFFER_SIZE = 4096;
@@ -45,6 +51,14 @@ typedef struct LineData
 	linenumber_t linenumber;
 } LineData_t;
 
+// when true, input files are memory mapped instead of read with fread().
+static bool use_mmap = false;
+
+void set_read_mmap(bool v)
+{
+	use_mmap = v;
+}
+
 size_t default_buffer_len()
 {
 	return READ_BUFFER_SIZE;
@@ -122,14 +136,9 @@ static bool load_LineData(char const *buffer, char const *end_buffer,
 	// could lead to big problems if too much buffer is given
 	ASSERT((size_t)(end_buffer - buffer) <= READ_BUFFER_SIZE);
 
-	char const *c = buffer;
-
 	// the input buffer is maxed to the buffer size read from disk. the maximum
 	// length will be more than the acceptable line length.
-	while(c != end_buffer && *c != '\n' && *c != '\r')
-	{
-		c++;
-	}
+	char const *c = scan_newline(buffer, end_buffer);
 
 	// update position of output buffer. the next line or next block of data
 	// will begin with this position.
@@ -204,37 +213,11 @@ static bool load_LineData(char const *buffer, char const *end_buffer,
 }
 
 /**
- * This is given an iterator to a list of line numbers; when 'next' returns
- * false, then this will terminate and if necessary break out of loops.
- *
- * When 'nextline' is NOT zero and NOT LINENUMBER_MAX, this will skip lines
- * until it has read ONE line before the line number that is requested.
- *
- * @param pfbc Context for FILE to be read/written.
- *
- * @param nextline Pointer to a storage location holding the next line number to
- * be read. LINENUMBER_MAX indicates read and call 'do_stuff' callback for ALL
- * lines. Zero is the invalid line number and indicates no more lines to be read
- * or as an initial value, do not read any lines. All other values are treated
- * as line numbers in the file and only when the matching line number is read
- * will this call 'do_stuff' callback with the provided context and the line
- * read.
- *
- * @param shared_buffer Optional externally managed buffer that this can utilize
- * as a temporary buffer. If NULL, allocates and frees a buffer within.
- *
- * @param buffer_size Size of optionally provided buffer; otherwise number of
- * bytes to read from file.
- *
- * @param do_stuff Callback that is expected to increment 'nextline'.
- *
- * @param context Context for callback 'do_stuff'. It is expected to increment
- * 'nextline'.
- *
- * @return The number of lines read unless nextline is initially zero in which
- * case it returns 0.
+ * Reads the file in chunks of 'buffer_size' bytes with fread() and copies each
+ * line into a LineData buffer before handing it to 'do_stuff'. See
+ * read_pfb_line().
  */
-int read_pfb_line(pfb_context_t *pfbc,
+static int read_pfb_line_buffered(pfb_context_t *pfbc,
 		linenumber_t *nextline,
 		void *shared_buffer, size_t buffer_size,
 		void(*do_stuff)(PortLineData_t const *const pld, pfb_context_t *, void *),
@@ -288,6 +271,11 @@ int read_pfb_line(pfb_context_t *pfbc,
 	LineData_t ld;
 	init_LineData(&ld);
 
+	// bytes read from the file before the current buffer and the offset of the
+	// line being loaded into 'ld'.
+	size_t read_total = 0;
+	size_t line_offset = 0;
+
 	bool escape = false;
 	do
 	{
@@ -297,6 +285,8 @@ int read_pfb_line(pfb_context_t *pfbc,
 			// reset buffer pointers to new 'end' and new current 'pos'
 			end_buffer = *buffer + read_count;
 			pos_buffer = *buffer;
+			const size_t buffer_offset = read_total;
+			read_total += read_count;
 
 			// idea is to read all data from the buffer before reading next
 			// chunk. get as many LineData's as are available filled.
@@ -320,6 +310,12 @@ int read_pfb_line(pfb_context_t *pfbc,
 				//  3| 3rd.domain.com
 				bool newline = false;
 
+				// nothing loaded yet; the line begins here.
+				if(!ld.len)
+				{
+					line_offset = buffer_offset + (pos_buffer - *buffer);
+				}
+
 				// read all lines: do not skip
 				if(*nextline == LINENUMBER_MAX)
 				{
@@ -357,6 +353,7 @@ int read_pfb_line(pfb_context_t *pfbc,
 						ASSERT(ld.linenumber != 0);
 						pld.linenumber = ld.linenumber;
 						pld.len = ld.len;
+						pld.offset = line_offset;
 
 						do_stuff(&pld, pfbc, context);
 					}
@@ -397,6 +394,7 @@ int read_pfb_line(pfb_context_t *pfbc,
 		pld.data = ld.buffer;
 		pld.linenumber = ld.linenumber;
 		pld.len = ld.len;
+		pld.offset = line_offset;
 
 		do_stuff(&pld, pfbc, context);
 
@@ -415,31 +413,175 @@ int read_pfb_line(pfb_context_t *pfbc,
 	return lines_read;
 }
 
-static int writeline(FILE *f, PortLineData_t const *pld)
+/**
+ * Map the input file of the given context read only. Returns MAP_FAILED if it
+ * is not a regular file or cannot be mapped. Returns NULL for an empty file
+ * since a zero length mapping is invalid.
+ */
+static char const *map_input(pfb_context_t *pfbc, size_t *size)
 {
-	ASSERT(f);
-	ASSERT(pld);
-	ASSERT(pld->data);
-	ASSERT(pld->len);
+	ASSERT(pfbc);
+	ASSERT(pfbc->in_file);
+	ASSERT(size);
+
+	*size = 0;
+
+	const int fd = fileno(pfbc->in_file);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		return MAP_FAILED;
+	}
 
-	const size_t wrote = fwrite(pld->data, sizeof(char), pld->len, f);
-	if( wrote != pld->len)
+	if(st.st_size == 0)
+	{
+		return NULL;
+	}
+
+	*size = st.st_size;
+	return mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+}
+
+/**
+ * Maps the file into memory and hands each line to 'do_stuff' as a view into
+ * the mapping; no line is copied. The view is NOT null terminated and is valid
+ * only for the duration of the callback. Lines are counted and truncated the
+ * same as read_pfb_line_buffered(). Returns -1 if the file cannot be mapped.
+ */
+static int read_pfb_line_mmap(pfb_context_t *pfbc,
+		linenumber_t *nextline,
+		void(*do_stuff)(PortLineData_t const *const pld, pfb_context_t *, void *),
+		void *context)
+{
+	ASSERT(pfbc);
+	ASSERT(pfbc->in_file);
+	ASSERT(nextline);
+	ASSERT(do_stuff);
+
+	if(*nextline == 0)
+	{
+		return 0;
+	}
+
+	size_t size;
+	char const *map = map_input(pfbc, &size);
+	if(map == MAP_FAILED)
+	{
 		return -1;
+	}
+
+	// an empty file has no lines.
+	if(!map)
+	{
+		return 0;
+	}
 
-	if(fwrite("\n", sizeof(char), 1, f) != 1)
-		return -2;
+	// the file is read front to back once; let the kernel read ahead.
+	posix_madvise((void*)map, size, POSIX_MADV_SEQUENTIAL);
 
-	return 0; // A-OK
+	char const *pos = map;
+	char const *const end = map + size;
+	linenumber_t linenumber = 0;
+
+	while(*nextline != 0)
+	{
+		// empty lines are not counted as lines.
+		while(pos != end && (*pos == '\r' || *pos == '\n'))
+		{
+			pos++;
+		}
+
+		if(pos == end)
+		{
+			break;
+		}
+
+		char const *eol = scan_newline(pos, end);
+
+		linenumber++;
+
+		if(*nextline == LINENUMBER_MAX || linenumber == *nextline)
+		{
+			PortLineData_t pld;
+			pld.data = pos;
+			pld.len = eol - pos;
+			pld.linenumber = linenumber;
+			pld.offset = pos - map;
+
+			if(pld.len >= MAX_ACCEPTABLE_LINE_LENGTH)
+			{
+				ELOG_STDERR("WARNING: excessive line length. truncating characters after %lu. requested: %lu\n",
+						MAX_ACCEPTABLE_LINE_LENGTH, pld.len + 1);
+				pld.len = MAX_ACCEPTABLE_LINE_LENGTH;
+			}
+
+			do_stuff(&pld, pfbc, context);
+		}
+
+		pos = eol;
+	}
+
+	munmap((void*)map, size);
+
+	return linenumber;
 }
 
-void init_NextLineContext(NextLineContext_t *nlc, ContextDomain_t *cd)
+/**
+ * This is given an iterator to a list of line numbers; when 'next' returns
+ * false, then this will terminate and if necessary break out of loops.
+ *
+ * When 'nextline' is NOT zero and NOT LINENUMBER_MAX, this will skip lines
+ * until it has read ONE line before the line number that is requested.
+ *
+ * @param pfbc Context for FILE to be read/written.
+ *
+ * @param nextline Pointer to a storage location holding the next line number to
+ * be read. LINENUMBER_MAX indicates read and call 'do_stuff' callback for ALL
+ * lines. Zero is the invalid line number and indicates no more lines to be read
+ * or as an initial value, do not read any lines. All other values are treated
+ * as line numbers in the file and only when the matching line number is read
+ * will this call 'do_stuff' callback with the provided context and the line
+ * read.
+ *
+ * @param shared_buffer Optional externally managed buffer that this can utilize
+ * as a temporary buffer. If NULL, allocates and frees a buffer within.
+ *
+ * @param buffer_size Size of optionally provided buffer; otherwise number of
+ * bytes to read from file.
+ *
+ * @param do_stuff Callback that is expected to increment 'nextline'.
+ *
+ * @param context Context for callback 'do_stuff'. It is expected to increment
+ * 'nextline'.
+ *
+ * @return The number of lines read unless nextline is initially zero in which
+ * case it returns 0.
+ */
+int read_pfb_line(pfb_context_t *pfbc,
+		linenumber_t *nextline,
+		void *shared_buffer, size_t buffer_size,
+		void(*do_stuff)(PortLineData_t const *const pld, pfb_context_t *, void *),
+		void *context)
 {
-	memset(nlc, 0, sizeof(NextLineContext_t));
+	if(use_mmap)
+	{
+		const int lines_read = read_pfb_line_mmap(pfbc, nextline, do_stuff,
+				context);
+		if(lines_read >= 0)
+		{
+			return lines_read;
+		}
+		// not a regular file or mapping failed; read it the usual way.
+	}
+
+	return read_pfb_line_buffered(pfbc, nextline, shared_buffer, buffer_size,
+			do_stuff, context);
+}
 
-	nlc->linenumbers = cd->linenumbers;
-	nlc->begin_array = nlc->linenumbers;
-	nlc->len = cd->next_idx;
-	nlc->next_linenumber = nlc->len ? nlc->linenumbers[0] : 0;
+void init_NextLineContext(NextLineContext_t *nlc, ContextDomain_t *cd)
+{
+	nlc->kept = &cd->kept;
+	nlc->next_linenumber = next_LineBitmap(nlc->kept, 0);
 }
 
 void write_pfb_csv_callback(PortLineData_t const *const pld, pfb_context_t *pfbc, void *context)
@@ -453,29 +595,71 @@ void write_pfb_csv_callback(PortLineData_t const *const pld, pfb_context_t *pfbc
 	NextLineContext_t *nlc = (NextLineContext_t*)context;
 	// previous line number was not zero
 	ASSERT(nlc->next_linenumber != 0);
+	ASSERT(nlc->kept);
+	ASSERT(has_LineBitmap(nlc->kept, nlc->next_linenumber));
 
-	ASSERT(nlc->begin_array);
-	ASSERT(nlc->len);
-	ASSERT(nlc->linenumbers != nlc->begin_array + nlc->len);
-	// previous line number was not zero
-	ASSERT(nlc->linenumbers[0] != 0);
+	// get the next line number. zero indicates the end of lines to be read.
+	nlc->next_linenumber = next_LineBitmap(nlc->kept, nlc->next_linenumber);
+}
 
-	// get the next line number. it might be zero. which indicates end of lines
-	// to be read.
-	nlc->linenumbers++;
+/**
+ * Write the kept lines of the input file to the output file by copying the
+ * byte ranges recorded in the context's LineSpans during the initial read.
+ * Returns -1 without writing anything if a line has no recorded span or the
+ * input cannot be mapped, e.g., it has changed since it was read; otherwise
+ * returns the number of lines written.
+ */
+int write_pfb_spans(pfb_context_t *pfbc, LineBitmap_t const *kept)
+{
+	ASSERT(pfbc);
+	ASSERT(pfbc->out_file);
+	ASSERT(kept);
 
-	// if at the end of the array, set 'nextline' to zero to indicate EOL
-	if(nlc->linenumbers == nlc->begin_array + nlc->len)
+	if(!kept->count)
 	{
-		nlc->next_linenumber = 0;
+		return 0;
 	}
-	else
+
+	// the last line has the furthest span.
+	LineSpan_t const *last = get_LineSpans(&pfbc->spans, last_LineBitmap(kept));
+	if(!last)
 	{
-		// there are no more line numbers for this context to be processed.
-		// update the output parameter. 0 means stop.
-		nlc->next_linenumber = *nlc->linenumbers;
+		return -1;
 	}
 
+	size_t size;
+	char const *map = map_input(pfbc, &size);
+	if(map == MAP_FAILED || !map)
+	{
+		return -1;
+	}
+
+	if(last->offset + last->len > size)
+	{
+		munmap((void*)map, size);
+		return -1;
+	}
+
+	posix_madvise((void*)map, size, POSIX_MADV_SEQUENTIAL);
+
+	for(linenumber_t ln = next_LineBitmap(kept, 0); ln;
+			ln = next_LineBitmap(kept, ln))
+	{
+		LineSpan_t const *span = get_LineSpans(&pfbc->spans, ln);
+		ASSERT(span);
+
+		PortLineData_t pld;
+		pld.data = map + span->offset;
+		pld.len = span->len;
+		pld.linenumber = ln;
+		pld.offset = span->offset;
+
+		write_pfb_csv(&pld, pfbc);
+	}
+
+	munmap((void*)map, size);
+
+	return kept->count;
 }
 
 void write_pfb_csv(PortLineData_t const *const pld, pfb_context_t *pfbc)
@@ -484,11 +668,14 @@ void write_pfb_csv(PortLineData_t const *const pld, pfb_context_t *pfbc)
 	ASSERT(pfbc);
 	ASSERT(pfbc->out_file);
 
-	const int err = writeline(pfbc->out_file, pld);
+	ASSERT(pld->data);
+	ASSERT(pld->len);
+
+	const int err = append_OutBuffer(&pfbc->out, pld->data, pld->len);
 	if(err)
 	{
-		ELOG_STDERR("ERROR (%d) while attempting to write line (%s) to '%s'\n",
-				err, pld->data, pfbc->out_fname);
+		ELOG_STDERR("ERROR (%d) while attempting to write line (%.*s) to '%s'\n",
+				err, (int)pld->len, pld->data, pfbc->out_fname);
 	}
 }
 
@@ -500,7 +687,21 @@ void read_pfb_csv(pfb_context_t *pfbc,
 		void *context)
 {
 	linenumber_t nextline = LINENUMBER_MAX;
-	read_pfb_line(pfbc, &nextline, NULL, READ_BUFFER_SIZE, do_stuff, context);
+	const int lines_read = read_pfb_line(pfbc, &nextline, NULL,
+			READ_BUFFER_SIZE, do_stuff, context);
+
+	pfbc->stats.lines += lines_read > 0 ? lines_read : 0;
+	// the whole file is read; unless it is not a regular file, its size.
+	struct stat st;
+	if(fstat(fileno(pfbc->in_file), &st) == 0 && S_ISREG(st.st_mode))
+	{
+		pfbc->stats.bytes += st.st_size;
+	}
+	else
+	{
+		const off_t pos = ftello(pfbc->in_file);
+		pfbc->stats.bytes += pos > 0 ? pos : 0;
+	}
 }
 
 #ifdef BUILD_TESTS
@@ -769,9 +970,17 @@ static void test_writeline()
 	pld.linenumber = 10;
 	pld.len = 58;
 
-	FILE *f = fopen("tests/unit_pfb_prune/FileInput_1.work", "wb");
-	writeline(f, &pld);
-	fclose(f);
+	pfb_context_t pfbc;
+	memset(&pfbc, 0, sizeof(pfb_context_t));
+	pfbc.out_file = fopen("tests/unit_pfb_prune/FileInput_1.work", "wb");
+	init_OutBuffer(&pfbc.out, fileno(pfbc.out_file));
+	write_pfb_csv(&pld, &pfbc);
+	// nothing reaches the file until flushed.
+	assert(pfbc.out.syscalls == 0);
+	assert(!flush_OutBuffer(&pfbc.out));
+	assert(pfbc.out.syscalls == 1);
+	free_OutBuffer(&pfbc.out);
+	fclose(pfbc.out_file);
 
 	char *buffer = malloc(sizeof(char) * 100);
 
@@ -785,6 +994,143 @@ static void test_writeline()
 	free(buffer);
 }
 
+typedef struct CollectedLines
+{
+	char *data[8];
+	size_t len[8];
+	linenumber_t linenumber[8];
+	size_t offset[8];
+	size_t count;
+	// stop after this line number; 0 to read all lines.
+	linenumber_t stop;
+	linenumber_t *nextline;
+} CollectedLines_t;
+
+static void test_cb_collect_lines(PortLineData_t const *const pld,
+		pfb_context_t *pc, void *context)
+{
+	UNUSED(pc);
+	CollectedLines_t *cl = context;
+	assert(cl->count < 8);
+
+	cl->data[cl->count] = malloc(pld->len);
+	memcpy(cl->data[cl->count], pld->data, pld->len);
+	cl->len[cl->count] = pld->len;
+	cl->linenumber[cl->count] = pld->linenumber;
+	cl->offset[cl->count] = pld->offset;
+	cl->count++;
+
+	if(cl->stop && pld->linenumber == cl->stop)
+	{
+		*cl->nextline = 0;
+	}
+}
+
+static void read_collect_lines(char *const *argv_i, bool mmap_mode,
+		size_t buffer_size, linenumber_t nextline, linenumber_t stop,
+		CollectedLines_t *cl)
+{
+	memset(cl, 0, sizeof(CollectedLines_t));
+	cl->stop = stop;
+	cl->nextline = &nextline;
+
+	pfb_contexts_t pfbcs = pfb_init_contexts(1, ".bench", argv_i);
+	pfb_open_context(pfbcs.begin_context, false);
+
+	set_read_mmap(mmap_mode);
+	read_pfb_line(pfbcs.begin_context, &nextline, NULL, buffer_size,
+			test_cb_collect_lines, cl);
+	set_read_mmap(false);
+
+	pfb_free_contexts(&pfbcs);
+}
+
+static void free_collect_lines(CollectedLines_t *cl)
+{
+	for(size_t i = 0; i < cl->count; i++)
+	{
+		free(cl->data[i]);
+	}
+}
+
+/**
+ * The memory mapped reader sees the same lines as the buffered reader: empty
+ * lines skipped, long lines truncated and a last line without a newline. Both
+ * report where each line begins in the file.
+ */
+static void test_read_pfb_line_mmap()
+{
+	char *const argv_i[] = {"tests/unit_pfb_prune/gen_read_pfb_line_mmap_input.txt"};
+
+	FILE *f_out = fopen(argv_i[0], "wb");
+	fwrite("\r\n\nfirst,line\r\n", sizeof(char), 15, f_out);
+	fwrite("second\r\r\n\n", sizeof(char), 10, f_out);
+	const size_t LONG_LENGTH = MAX_ACCEPTABLE_LINE_LENGTH + 300;
+	char *block = malloc(LONG_LENGTH);
+	memset(block, 'x', LONG_LENGTH);
+	fwrite(block, sizeof(char), LONG_LENGTH, f_out);
+	free(block);
+	fwrite("\nlast", sizeof(char), 5, f_out);
+	fclose(f_out);
+
+	CollectedLines_t buffered, mapped, small;
+
+	read_collect_lines(argv_i, false, READ_BUFFER_SIZE, LINENUMBER_MAX, 0,
+			&buffered);
+	read_collect_lines(argv_i, true, READ_BUFFER_SIZE, LINENUMBER_MAX, 0,
+			&mapped);
+	// lines and their newlines split across reads.
+	read_collect_lines(argv_i, false, 7, LINENUMBER_MAX, 0, &small);
+
+	assert(buffered.count == 4);
+	assert(mapped.count == buffered.count);
+	assert(small.count == buffered.count);
+	for(size_t i = 0; i < buffered.count; i++)
+	{
+		assert(mapped.linenumber[i] == buffered.linenumber[i]);
+		assert(mapped.len[i] == buffered.len[i]);
+		assert(!memcmp(mapped.data[i], buffered.data[i], buffered.len[i]));
+		assert(mapped.offset[i] == buffered.offset[i]);
+		assert(small.offset[i] == buffered.offset[i]);
+	}
+	assert(mapped.len[1] == 6);
+	assert(mapped.len[2] == MAX_ACCEPTABLE_LINE_LENGTH);
+	assert(!memcmp(mapped.data[3], "last", 4));
+
+	assert(mapped.offset[0] == 3);
+	assert(mapped.offset[1] == 15);
+	assert(mapped.offset[2] == 25);
+	assert(mapped.offset[3] == 25 + LONG_LENGTH + 1);
+
+	free_collect_lines(&buffered);
+	free_collect_lines(&mapped);
+	free_collect_lines(&small);
+
+	// only the requested line; reading stops when the callback says so.
+	read_collect_lines(argv_i, true, READ_BUFFER_SIZE, 2, 2, &mapped);
+	assert(mapped.count == 1);
+	assert(mapped.linenumber[0] == 2);
+	assert(!memcmp(mapped.data[0], "second", 6));
+	free_collect_lines(&mapped);
+
+	// nothing to read
+	read_collect_lines(argv_i, true, READ_BUFFER_SIZE, 0, 0, &mapped);
+	assert(mapped.count == 0);
+}
+
+static void test_read_pfb_line_mmap_empty()
+{
+	char *const argv_i[] = {"tests/unit_pfb_prune/gen_read_pfb_line_mmap_empty.txt"};
+	CollectedLines_t mapped;
+
+	FILE *f_out = fopen(argv_i[0], "wb");
+	fclose(f_out);
+
+	read_collect_lines(argv_i, true, READ_BUFFER_SIZE, LINENUMBER_MAX, 0,
+			&mapped);
+	assert(mapped.count == 0);
+}
+
 void test_rw_pfb_csv()
 {
 	test_free_LineData();
@@ -798,5 +1144,7 @@ void test_rw_pfb_csv()
 	test_load_LineDataSKIP();
 
 	test_writeline();
+	test_read_pfb_line_mmap();
+	test_read_pfb_line_mmap_empty();
 }
 #endif
@@ -0,0 +1,268 @@
+/**
+ * scan.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "scan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+static const char CSV_DELIMITER = ',';
+
+typedef char const *(*scan_fn)(char const *begin, char const *end);
+
+static char const *scalar_newline(char const *c, char const *end)
+{
+	while(c != end && *c != '\n' && *c != '\r')
+	{
+		c++;
+	}
+	return c;
+}
+
+static char const *scalar_delimiter(char const *c, char const *end)
+{
+	while(c != end && *c != CSV_DELIMITER && *c)
+	{
+		c++;
+	}
+	return c;
+}
+
+#ifdef SCAN_X86
+// SSE2 is part of x86-64; always available.
+static char const *sse2_find2(char const *c, char const *end, char a, char b)
+{
+	const __m128i va = _mm_set1_epi8(a);
+	const __m128i vb = _mm_set1_epi8(b);
+
+	while(end - c >= 16)
+	{
+		const __m128i v = _mm_loadu_si128((__m128i const*)c);
+		const int mask = _mm_movemask_epi8(_mm_or_si128(
+					_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+		if(mask)
+		{
+			return c + __builtin_ctz(mask);
+		}
+		c += 16;
+	}
+
+	while(c != end && *c != a && *c != b)
+	{
+		c++;
+	}
+	return c;
+}
+
+__attribute__((target("avx2")))
+static char const *avx2_find2(char const *c, char const *end, char a, char b)
+{
+	const __m256i va = _mm256_set1_epi8(a);
+	const __m256i vb = _mm256_set1_epi8(b);
+
+	while(end - c >= 32)
+	{
+		const __m256i v = _mm256_loadu_si256((__m256i const*)c);
+		const uint mask = _mm256_movemask_epi8(_mm256_or_si256(
+					_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+		if(mask)
+		{
+			return c + __builtin_ctz(mask);
+		}
+		c += 32;
+	}
+
+	return sse2_find2(c, end, a, b);
+}
+
+static char const *sse2_newline(char const *c, char const *end)
+{
+	return sse2_find2(c, end, '\n', '\r');
+}
+
+static char const *sse2_delimiter(char const *c, char const *end)
+{
+	return sse2_find2(c, end, CSV_DELIMITER, '\0');
+}
+
+static char const *avx2_newline(char const *c, char const *end)
+{
+	return avx2_find2(c, end, '\n', '\r');
+}
+
+static char const *avx2_delimiter(char const *c, char const *end)
+{
+	return avx2_find2(c, end, CSV_DELIMITER, '\0');
+}
+
+static ScanKernel_t kernel = SCAN_SSE2;
+static scan_fn newline_fn = sse2_newline;
+static scan_fn delimiter_fn = sse2_delimiter;
+#else
+static ScanKernel_t kernel = SCAN_SCALAR;
+static scan_fn newline_fn = scalar_newline;
+static scan_fn delimiter_fn = scalar_delimiter;
+#endif
+
+/**
+ * Use the given kernel for all scans. Returns false and leaves the current
+ * kernel in place when the CPU or build does not support it. Not thread safe;
+ * call before any threads are started.
+ */
+bool set_scan_kernel(ScanKernel_t k)
+{
+	switch(k)
+	{
+		case SCAN_SCALAR:
+			newline_fn = scalar_newline;
+			delimiter_fn = scalar_delimiter;
+			break;
+#ifdef SCAN_X86
+		case SCAN_SSE2:
+			newline_fn = sse2_newline;
+			delimiter_fn = sse2_delimiter;
+			break;
+		case SCAN_AVX2:
+			if(!__builtin_cpu_supports("avx2"))
+			{
+				return false;
+			}
+			newline_fn = avx2_newline;
+			delimiter_fn = avx2_delimiter;
+			break;
+#endif
+		default:
+			return false;
+	}
+
+	kernel = k;
+	return true;
+}
+
+ScanKernel_t get_scan_kernel()
+{
+	return kernel;
+}
+
+/**
+ * Select the widest kernel the CPU supports.
+ */
+void init_scan()
+{
+	if(!set_scan_kernel(SCAN_AVX2) && !set_scan_kernel(SCAN_SSE2))
+	{
+		set_scan_kernel(SCAN_SCALAR);
+	}
+}
+
+/**
+ * Returns a pointer to the first \n or \r in [begin, end) or 'end' if there
+ * is none.
+ */
+char const *scan_newline(char const *begin, char const *end)
+{
+	ASSERT(begin <= end);
+	return newline_fn(begin, end);
+}
+
+/**
+ * Returns a pointer to the first CSV delimiter or null terminator in
+ * [begin, end) or 'end' if there is neither.
+ */
+char const *scan_delimiter(char const *begin, char const *end)
+{
+	ASSERT(begin <= end);
+	return delimiter_fn(begin, end);
+}
+
+#ifdef BUILD_TESTS
+/**
+ * Every supported kernel finds the same bytes as the scalar loop regardless of
+ * alignment and length, including the tail shorter than a vector.
+ */
+static void test_scan_kernels()
+{
+	enum { LEN = 200 };
+	char buf[LEN];
+	const ScanKernel_t saved = get_scan_kernel();
+
+	srand(7);
+	for(size_t round = 0; round < 200; round++)
+	{
+		// mostly plain characters with the occasional byte of interest.
+		for(size_t i = 0; i < LEN; i++)
+		{
+			const int r = rand() % 64;
+			buf[i] = r == 0 ? '\n' : r == 1 ? '\r' : r == 2 ? ',' :
+				r == 3 ? '\0' : 'a' + r % 26;
+		}
+
+		for(size_t begin = 0; begin < 40; begin++)
+		{
+			const size_t end = begin + rand() % (LEN - begin);
+			char const *nl = scalar_newline(buf + begin, buf + end);
+			char const *delim = scalar_delimiter(buf + begin, buf + end);
+
+			for(int k = SCAN_SCALAR; k <= SCAN_AVX2; k++)
+			{
+				if(!set_scan_kernel(k))
+				{
+					continue;
+				}
+				assert(scan_newline(buf + begin, buf + end) == nl);
+				assert(scan_delimiter(buf + begin, buf + end) == delim);
+			}
+		}
+	}
+
+	// nothing to find
+	memset(buf, 'x', LEN);
+	for(int k = SCAN_SCALAR; k <= SCAN_AVX2; k++)
+	{
+		if(set_scan_kernel(k))
+		{
+			assert(scan_newline(buf, buf + LEN) == buf + LEN);
+			assert(scan_delimiter(buf, buf + LEN) == buf + LEN);
+			assert(scan_newline(buf, buf) == buf);
+		}
+	}
+
+	assert(set_scan_kernel(saved));
+}
+
+static void test_init_scan()
+{
+	const ScanKernel_t saved = get_scan_kernel();
+	init_scan();
+#ifdef SCAN_X86
+	assert(get_scan_kernel() != SCAN_SCALAR);
+#endif
+	assert(set_scan_kernel(saved));
+}
+
+void test_scan()
+{
+	test_init_scan();
+	test_scan_kernels();
+}
+#endif
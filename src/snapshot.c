@@ -0,0 +1,645 @@
+/**
+ * snapshot.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// fileno() and access() are hidden by -std=c17 otherwise
+#define _POSIX_C_SOURCE 200809L
+#include "dedupdomains.h"
+#include "snapshot.h"
+#include "pfb_context.h"
+#include "contextdomain.h"
+#include "arraydomaininfo.h"
+#include "rw_pfb_csv.h"
+#include "pfb_prune.h"
+#include <unistd.h>
+
+static const char SNAPSHOT_MAGIC[8] = "PFBSNAP";
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const size_t HASH_BUFFER_SIZE = 1 << 20;
+
+// record header: line number, match strength and length of the text.
+#define RECORD_HEADER (sizeof(linenumber_t) + sizeof(int8_t) + sizeof(uint32_t))
+
+void init_Snapshot(Snapshot_t *snap)
+{
+	ASSERT(snap);
+	snap->files = NULL;
+	snap->len_files = 0;
+}
+
+static void free_SnapshotFile(SnapshotFile_t *sf)
+{
+	free(sf->in_fname);
+	free(sf->out_fname);
+	free(sf->records);
+	free_LineBitmap(&sf->kept);
+	memset(sf, 0, sizeof(SnapshotFile_t));
+}
+
+void free_Snapshot(Snapshot_t *snap)
+{
+	ASSERT(snap);
+
+	for(size_t i = 0; i < snap->len_files; i++)
+	{
+		free_SnapshotFile(&snap->files[i]);
+	}
+	free(snap->files);
+	init_Snapshot(snap);
+}
+
+static uint64_t mix_hash(uint64_t h, uint64_t v)
+{
+	h ^= v * 0x9e3779b97f4a7c15ULL;
+	h = (h << 31) | (h >> 33);
+	return h * 0xc2b2ae3d27d4eb4fULL;
+}
+
+/**
+ * Hash the content of the given file eight bytes at a time. Returns false if
+ * the file cannot be read.
+ */
+static bool hash_file(char const *fname, uint64_t *size, uint64_t *hash)
+{
+	FILE *f = fopen(fname, "rb");
+	if(!f)
+	{
+		return false;
+	}
+
+	uint64_t *buffer = malloc(HASH_BUFFER_SIZE);
+	if(!buffer)
+	{
+		ELOG_STDERR("ERROR: failed to allocate buffer to hash '%s'\n", fname);
+		exit(EXIT_FAILURE);
+	}
+
+	uint64_t h = 0x27d4eb2f165667c5ULL;
+	uint64_t total = 0;
+	size_t read_count;
+	// every read but the last fills the buffer, a multiple of eight bytes.
+	while((read_count = fread(buffer, 1, HASH_BUFFER_SIZE, f)) > 0)
+	{
+		const size_t words = read_count / sizeof(uint64_t);
+		for(size_t i = 0; i < words; i++)
+		{
+			h = mix_hash(h, buffer[i]);
+		}
+
+		const size_t tail = read_count % sizeof(uint64_t);
+		if(tail)
+		{
+			uint64_t last = 0;
+			memcpy(&last, buffer + words, tail);
+			h = mix_hash(h, last);
+		}
+		total += read_count;
+	}
+
+	const bool ok = !ferror(f);
+	fclose(f);
+	free(buffer);
+
+	*size = total;
+	*hash = mix_hash(h, total);
+	return ok;
+}
+
+// 'data' may be NULL when 'len' is zero, e.g., the records of an empty file.
+static bool read_exact(FILE *f, void *data, size_t len)
+{
+	return !len || fread(data, 1, len, f) == len;
+}
+
+static bool write_exact(FILE *f, void const *data, size_t len)
+{
+	return !len || fwrite(data, 1, len, f) == len;
+}
+
+static char *read_string(FILE *f)
+{
+	uint32_t len;
+	if(!read_exact(f, &len, sizeof(len)) || len > get_max_line_len())
+	{
+		return NULL;
+	}
+
+	char *s = malloc(len + 1);
+	if(!s)
+	{
+		ELOG_STDERR("ERROR: failed to allocate string of snapshot\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if(!read_exact(f, s, len))
+	{
+		free(s);
+		return NULL;
+	}
+	s[len] = '\0';
+	return s;
+}
+
+static bool write_string(FILE *f, char const *s)
+{
+	const uint32_t len = strlen(s);
+	return write_exact(f, &len, sizeof(len)) && write_exact(f, s, len);
+}
+
+static bool load_SnapshotFile(FILE *f, SnapshotFile_t *sf)
+{
+	uint64_t lines, len_words, len_records;
+
+	sf->in_fname = read_string(f);
+	sf->out_fname = read_string(f);
+	if(!sf->in_fname || !sf->out_fname ||
+			!read_exact(f, &sf->size, sizeof(sf->size)) ||
+			!read_exact(f, &sf->hash, sizeof(sf->hash)) ||
+			!read_exact(f, &lines, sizeof(lines)) ||
+			!read_exact(f, &len_words, sizeof(len_words)) ||
+			len_words > SIZE_MAX / sizeof(uint64_t))
+	{
+		return false;
+	}
+	sf->lines = lines;
+
+	if(len_words)
+	{
+		sf->kept.words = malloc(sizeof(uint64_t) * len_words);
+		if(!sf->kept.words)
+		{
+			ELOG_STDERR("ERROR: failed to allocate LineBitmap of snapshot\n");
+			exit(EXIT_FAILURE);
+		}
+		sf->kept.len_words = len_words;
+		if(!read_exact(f, sf->kept.words, sizeof(uint64_t) * len_words))
+		{
+			return false;
+		}
+		for(size_t i = 0; i < len_words; i++)
+		{
+			sf->kept.count += __builtin_popcountll(sf->kept.words[i]);
+		}
+	}
+
+	if(!read_exact(f, &len_records, sizeof(len_records)))
+	{
+		return false;
+	}
+
+	if(len_records)
+	{
+		sf->records = malloc(len_records);
+		if(!sf->records)
+		{
+			ELOG_STDERR("ERROR: failed to allocate records of snapshot\n");
+			exit(EXIT_FAILURE);
+		}
+		sf->len_records = sf->alloc_records = len_records;
+		if(!read_exact(f, sf->records, len_records))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Load the snapshot saved by a previous run. A missing file is an empty
+ * snapshot. Returns false and leaves the snapshot empty if the file is not a
+ * snapshot of this build.
+ */
+bool load_Snapshot(Snapshot_t *snap, char const *fname)
+{
+	ASSERT(snap);
+	ASSERT(fname);
+	ASSERT(!snap->files);
+
+	FILE *f = fopen(fname, "rb");
+	if(!f)
+	{
+		return true;
+	}
+
+	char magic[sizeof(SNAPSHOT_MAGIC)];
+	uint32_t version, size_linenumber;
+	uint64_t len_files;
+
+	bool ok = read_exact(f, magic, sizeof(magic)) &&
+		!memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) &&
+		read_exact(f, &version, sizeof(version)) &&
+		version == SNAPSHOT_VERSION &&
+		read_exact(f, &size_linenumber, sizeof(size_linenumber)) &&
+		size_linenumber == sizeof(linenumber_t) &&
+		read_exact(f, &len_files, sizeof(len_files)) &&
+		len_files <= (uint64_t)FILEINDEX_MAX + 1;
+
+	if(ok && len_files)
+	{
+		snap->files = calloc(len_files, sizeof(SnapshotFile_t));
+		if(!snap->files)
+		{
+			ELOG_STDERR("ERROR: failed to allocate snapshot\n");
+			exit(EXIT_FAILURE);
+		}
+		snap->len_files = len_files;
+
+		for(size_t i = 0; ok && i < len_files; i++)
+		{
+			ok = load_SnapshotFile(f, &snap->files[i]);
+		}
+	}
+	fclose(f);
+
+	if(!ok)
+	{
+		ELOG_STDERR("WARNING: ignoring snapshot '%s'; not a snapshot of this version.\n",
+				fname);
+		free_Snapshot(snap);
+	}
+
+	return ok;
+}
+
+/**
+ * Pair every context with what the snapshot holds of its input file. Inputs
+ * with the same name, size and hash are unchanged; all others start empty and
+ * are filled while reading. Entries of files no longer given are dropped.
+ */
+void attach_Snapshot(Snapshot_t *snap, pfb_contexts_t *cs)
+{
+	ASSERT(snap);
+	ASSERT(cs);
+
+	const size_t len_contexts = pfb_len_contexts(cs);
+	SnapshotFile_t *files = calloc(len_contexts ? len_contexts : 1,
+			sizeof(SnapshotFile_t));
+	if(!files)
+	{
+		ELOG_STDERR("ERROR: failed to allocate snapshot\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for(size_t i = 0; i < len_contexts; i++)
+	{
+		pfb_context_t *c = cs->begin_context + i;
+		SnapshotFile_t *sf = &files[i];
+
+		if(!hash_file(c->in_fname, &sf->size, &sf->hash))
+		{
+			// reading the file reports the error.
+			sf->size = sf->hash = 0;
+		}
+
+		for(size_t j = 0; j < snap->len_files; j++)
+		{
+			SnapshotFile_t *prev = &snap->files[j];
+			if(!prev->in_fname || strcmp(prev->in_fname, c->in_fname) != 0)
+			{
+				continue;
+			}
+
+			if(prev->size == sf->size && prev->hash == sf->hash)
+			{
+				sf->lines = prev->lines;
+				sf->records = prev->records;
+				sf->len_records = prev->len_records;
+				sf->alloc_records = prev->alloc_records;
+				prev->records = NULL;
+				sf->unchanged = true;
+
+				// the output of another name is always written.
+				if(!strcmp(prev->out_fname, c->out_fname))
+				{
+					sf->kept = prev->kept;
+					init_LineBitmap(&prev->kept);
+				}
+			}
+			free_SnapshotFile(prev);
+			break;
+		}
+
+		sf->in_fname = pfb_strdup(c->in_fname, strlen(c->in_fname));
+		sf->out_fname = pfb_strdup(c->out_fname, strlen(c->out_fname));
+		c->snap = sf;
+	}
+
+	free_Snapshot(snap);
+	snap->files = files;
+	snap->len_files = len_contexts;
+}
+
+/**
+ * Save the snapshot for the next run. The kept lines are those of the given
+ * ArrayDomainInfo_t. Written to a temporary file first so a failed run never
+ * leaves a partial snapshot behind.
+ */
+bool save_Snapshot(Snapshot_t const *snap, char const *fname,
+		pfb_contexts_t *cs, ArrayDomainInfo_t const *array_di)
+{
+	ASSERT(snap);
+	ASSERT(fname);
+	ASSERT(cs);
+	ASSERT(array_di);
+	ASSERT(snap->len_files == pfb_len_contexts(cs));
+	ASSERT(array_di->len_cd == snap->len_files);
+
+	const size_t len_tmp = strlen(fname) + 5;
+	char *tmp = malloc(len_tmp);
+	if(!tmp)
+	{
+		exit(EXIT_FAILURE);
+	}
+	snprintf(tmp, len_tmp, "%s.tmp", fname);
+
+	FILE *f = fopen(tmp, "wb");
+	if(!f)
+	{
+		ELOG_STDERR("ERROR: unable to open '%s' for writing.\n", tmp);
+		free(tmp);
+		return false;
+	}
+
+	const uint32_t size_linenumber = sizeof(linenumber_t);
+	const uint64_t len_files = snap->len_files;
+	bool ok = write_exact(f, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) &&
+		write_exact(f, &SNAPSHOT_VERSION, sizeof(SNAPSHOT_VERSION)) &&
+		write_exact(f, &size_linenumber, sizeof(size_linenumber)) &&
+		write_exact(f, &len_files, sizeof(len_files));
+
+	for(size_t i = 0; ok && i < snap->len_files; i++)
+	{
+		SnapshotFile_t const *sf = &snap->files[i];
+		LineBitmap_t const *kept = &array_di->cd[i].kept;
+		const uint64_t lines = cs->begin_context[i].stats.lines;
+		const uint64_t len_words = kept->len_words;
+		const uint64_t len_records = sf->len_records;
+
+		ok = write_string(f, sf->in_fname) &&
+			write_string(f, sf->out_fname) &&
+			write_exact(f, &sf->size, sizeof(sf->size)) &&
+			write_exact(f, &sf->hash, sizeof(sf->hash)) &&
+			write_exact(f, &lines, sizeof(lines)) &&
+			write_exact(f, &len_words, sizeof(len_words)) &&
+			write_exact(f, kept->words, sizeof(uint64_t) * len_words) &&
+			write_exact(f, &len_records, sizeof(len_records)) &&
+			write_exact(f, sf->records, sf->len_records);
+	}
+
+	ok = fclose(f) == 0 && ok;
+	if(ok && rename(tmp, fname) != 0)
+	{
+		ok = false;
+	}
+
+	if(!ok)
+	{
+		ELOG_STDERR("ERROR: failed to save snapshot '%s'\n", fname);
+		remove(tmp);
+	}
+	free(tmp);
+	return ok;
+}
+
+/**
+ * Append a domain or regex line of the input file to the snapshot.
+ */
+void record_SnapshotFile(SnapshotFile_t *sf, linenumber_t linenumber,
+		MatchStrength_t ms, char const *data, size_t len)
+{
+	ASSERT(sf);
+	ASSERT(!sf->unchanged);
+	ASSERT(len <= get_max_line_len());
+
+	const size_t need = sf->len_records + RECORD_HEADER + len;
+	if(need > sf->alloc_records)
+	{
+		size_t alloc = sf->alloc_records ? sf->alloc_records : 1 << 16;
+		while(alloc < need)
+		{
+			alloc *= 2;
+		}
+
+		char *tmp = realloc(sf->records, alloc);
+		if(!tmp)
+		{
+			ELOG_STDERR("ERROR: failed to realloc records of snapshot\n");
+			exit(EXIT_FAILURE);
+		}
+		sf->records = tmp;
+		sf->alloc_records = alloc;
+	}
+
+	const int8_t strength = ms;
+	const uint32_t len_text = len;
+	char *out = sf->records + sf->len_records;
+	memcpy(out, &linenumber, sizeof(linenumber_t));
+	out += sizeof(linenumber_t);
+	memcpy(out, &strength, sizeof(strength));
+	out += sizeof(strength);
+	memcpy(out, &len_text, sizeof(len_text));
+	out += sizeof(len_text);
+	memcpy(out, data, len);
+
+	sf->len_records = need;
+}
+
+/**
+ * When the input file of the given context is unchanged, hand every recorded
+ * line to 'do_stuff' as a line of CSV holding only the domain and the match
+ * strength; the input file is not read. Returns false if the file has to be
+ * read.
+ */
+bool replay_SnapshotFile(pfb_context_t *pfbc,
+		void(*do_stuff)(PortLineData_t const *const pld, pfb_context_t *, void *),
+		void *context)
+{
+	ASSERT(pfbc);
+	ASSERT(do_stuff);
+
+	SnapshotFile_t const *sf = pfbc->snap;
+	if(!sf || !sf->unchanged)
+	{
+		return false;
+	}
+
+	// ",<domain>,,,,,<match>"
+	char *line = malloc(get_max_line_len() + 16);
+	if(!line)
+	{
+		ELOG_STDERR("ERROR: failed to allocate line to replay snapshot\n");
+		exit(EXIT_FAILURE);
+	}
+
+	char const *pos = sf->records;
+	char const *const end = sf->records + sf->len_records;
+	while(pos + RECORD_HEADER <= end)
+	{
+		linenumber_t linenumber;
+		int8_t strength;
+		uint32_t len;
+		memcpy(&linenumber, pos, sizeof(linenumber_t));
+		pos += sizeof(linenumber_t);
+		memcpy(&strength, pos, sizeof(strength));
+		pos += sizeof(strength);
+		memcpy(&len, pos, sizeof(len));
+		pos += sizeof(len);
+
+		if(len > get_max_line_len() || pos + len > end)
+		{
+			ELOG_STDERR("ERROR: snapshot of '%s' is corrupt; replay stopped.\n",
+					pfbc->in_fname);
+			break;
+		}
+
+		line[0] = ',';
+		memcpy(line + 1, pos, len);
+		memcpy(line + 1 + len, ",,,,,", 5);
+		line[len + 6] = '0' + strength;
+		line[len + 7] = '\0';
+		pos += len;
+
+		PortLineData_t pld;
+		pld.data = line;
+		pld.len = len + 7;
+		pld.linenumber = linenumber;
+		pld.offset = 0;
+		do_stuff(&pld, pfbc, context);
+	}
+
+	free(line);
+
+	pfbc->stats.lines += sf->lines;
+	pfbc->stats.bytes += sf->size;
+	return true;
+}
+
+/**
+ * Returns true when the output of an unchanged input file would be the same as
+ * the one written by the previous run and that file still exists.
+ */
+bool skip_write_SnapshotFile(SnapshotFile_t const *sf, LineBitmap_t const *kept)
+{
+	ASSERT(sf);
+	ASSERT(kept);
+
+	return sf->unchanged && equal_LineBitmap(&sf->kept, kept) &&
+		access(sf->out_fname, F_OK) == 0;
+}
+
+#ifdef BUILD_TESTS
+static void test_cb_replay(PortLineData_t const *const pld, pfb_context_t *pfbc,
+		void *context)
+{
+	ASSERT(pfbc);
+	size_t *count = context;
+	(*count)++;
+
+	switch(pld->linenumber)
+	{
+		case 3:
+			assert(pld->len == strlen(",www.example.com,,,,,0"));
+			assert(!memcmp(pld->data, ",www.example.com,,,,,0", pld->len));
+			break;
+		case 70:
+			assert(pld->len == strlen(",(?:^|\\.)ads,,,,,2"));
+			assert(!memcmp(pld->data, ",(?:^|\\.)ads,,,,,2", pld->len));
+			break;
+		default:
+			assert(false && "unexpected line replayed");
+	}
+}
+
+void test_Snapshot()
+{
+	char const *fname = "./tests/unit_pfb_prune/test_snapshot.work";
+	char *argv[] = {"./tests/unit_pfb_prune/snapshot_in.work"};
+
+	FILE *in = fopen(argv[0], "w");
+	assert(in);
+	fputs(",www.example.com,,0,Blarg,DNSBL_Blarg,0\n", in);
+	fclose(in);
+
+	remove(fname);
+
+	pfb_contexts_t cs = pfb_init_contexts(1, ".txt", argv);
+	Snapshot_t snap;
+	init_Snapshot(&snap);
+	assert(load_Snapshot(&snap, fname));
+	assert(!snap.len_files);
+
+	attach_Snapshot(&snap, &cs);
+	assert(snap.len_files == 1);
+	assert(cs.begin_context->snap == &snap.files[0]);
+	assert(!snap.files[0].unchanged);
+	assert(snap.files[0].size == strlen(",www.example.com,,0,Blarg,DNSBL_Blarg,0\n"));
+
+	record_SnapshotFile(&snap.files[0], 3, MATCH_WEAK, "www.example.com", 15);
+	record_SnapshotFile(&snap.files[0], 70, MATCH_REGEX, "(?:^|\\.)ads", 11);
+	cs.begin_context->stats.lines = 71;
+
+	ArrayDomainInfo_t array_di;
+	init_ArrayDomainInfo(&array_di, 1);
+	set_LineBitmap(&array_di.cd[0].kept, 3);
+	set_LineBitmap(&array_di.cd[0].kept, 70);
+	assert(save_Snapshot(&snap, fname, &cs, &array_di));
+	free_Snapshot(&snap);
+	pfb_free_contexts(&cs);
+
+	// same input; replayed from the snapshot.
+	cs = pfb_init_contexts(1, ".txt", argv);
+	assert(load_Snapshot(&snap, fname));
+	assert(snap.len_files == 1);
+	assert(snap.files[0].kept.count == 2);
+	attach_Snapshot(&snap, &cs);
+	assert(snap.files[0].unchanged);
+
+	size_t count = 0;
+	assert(replay_SnapshotFile(cs.begin_context, test_cb_replay, &count));
+	assert(count == 2);
+	assert(cs.begin_context->stats.lines == 71);
+
+	// the output file does not exist.
+	remove(cs.begin_context->out_fname);
+	assert(!skip_write_SnapshotFile(cs.begin_context->snap, &array_di.cd[0].kept));
+	free_Snapshot(&snap);
+	pfb_free_contexts(&cs);
+
+	// changed input
+	in = fopen(argv[0], "a");
+	assert(in);
+	fputs(",ads.example.com,,0,Blarg,DNSBL_Blarg,0\n", in);
+	fclose(in);
+
+	cs = pfb_init_contexts(1, ".txt", argv);
+	assert(load_Snapshot(&snap, fname));
+	attach_Snapshot(&snap, &cs);
+	assert(!snap.files[0].unchanged);
+	assert(!snap.files[0].len_records);
+	assert(!replay_SnapshotFile(cs.begin_context, test_cb_replay, &count));
+	free_Snapshot(&snap);
+	pfb_free_contexts(&cs);
+
+	free_ArrayDomainInfo(&array_di);
+	remove(fname);
+	remove(argv[0]);
+	remove("./tests/unit_pfb_prune/snapshot_in.txt");
+}
+#endif
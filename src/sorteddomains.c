@@ -0,0 +1,665 @@
+/**
+ * sorteddomains.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "sorteddomains.h"
+#include "domain.h"
+#include "domaininfo.h"
+#include "linebitmap.h"
+#include <pthread.h>
+
+static const size_t INITIAL_SORTED_DOMAINS = 1 << 16;
+
+void init_SortedDomains(SortedDomains_t *sd)
+{
+	ASSERT(sd);
+	sd->domains = NULL;
+	sd->len = 0;
+	sd->alloc = 0;
+	sd->max_len_key = 0;
+	init_Arena(&sd->arena);
+}
+
+void free_SortedDomains(SortedDomains_t *sd)
+{
+	ASSERT(sd);
+	free(sd->domains);
+	free_Arena(&sd->arena);
+	init_SortedDomains(sd);
+}
+
+static void reserve_SortedDomains(SortedDomains_t *sd, size_t need)
+{
+	if(need <= sd->alloc)
+	{
+		return;
+	}
+
+	size_t alloc = sd->alloc ? sd->alloc : INITIAL_SORTED_DOMAINS;
+	while(alloc < need)
+	{
+		alloc *= 2;
+	}
+
+	SortedDomain_t *tmp = realloc(sd->domains, sizeof(SortedDomain_t) * alloc);
+	if(!tmp)
+	{
+		ELOG_STDERR("ERROR: failed to realloc SortedDomains\n");
+		exit(EXIT_FAILURE);
+	}
+	sd->domains = tmp;
+	sd->alloc = alloc;
+}
+
+static uint64_t key_prefix(char const *key, size_t len)
+{
+	uint64_t prefix = 0;
+	for(size_t i = 0; i < sizeof(uint64_t); i++)
+	{
+		prefix = (prefix << 8) | (i < len ? (uchar)key[i] : 0);
+	}
+	return prefix;
+}
+
+/**
+ * Copy the key of the domain of the given DomainView to the end of the array.
+ * Same as insert_DomainTree(), a DomainView without a valid match strength is
+ * skipped and false returned.
+ */
+bool append_SortedDomains(SortedDomains_t *sd, DomainView_t const *dv)
+{
+	ASSERT(sd);
+	ASSERT(dv);
+
+	if(dv->match_strength == MATCH_NOTSET)
+	{
+		ELOG_STDERR("ERROR: DomainView has uninitialized match_strength set; skip insertion.\n");
+		return false;
+	}
+
+	if(dv->match_strength == MATCH_BOGUS)
+	{
+		ELOG_STDERR("ALERT: DomainView has bogus match_strength set; skip insertion.\n");
+		return false;
+	}
+
+	ASSERT(dv->match_strength != MATCH_REGEX);
+
+	size_t len_key = dv->segs_used;
+	for(size_len_t seg = 0; seg < dv->segs_used; seg++)
+	{
+		len_key += dv->lengths[seg];
+	}
+
+	char *key = alloc_Arena(&sd->arena, len_key);
+	char *out = key;
+	for(size_len_t seg = 0; seg < dv->segs_used; seg++)
+	{
+		*out++ = dv->lengths[seg];
+		memcpy(out, dv->fqd + dv->label_indexes[seg], dv->lengths[seg]);
+		out += dv->lengths[seg];
+	}
+
+	reserve_SortedDomains(sd, sd->len + 1);
+	SortedDomain_t *d = &sd->domains[sd->len++];
+	d->key = key;
+	d->prefix = key_prefix(key, len_key);
+	d->len_key = len_key;
+	if(len_key > sd->max_len_key)
+	{
+		sd->max_len_key = len_key;
+	}
+	d->linenumber = dv->linenumber;
+	d->file_index = dv->file_index;
+	d->match_strength = dv->match_strength;
+
+	return true;
+}
+
+/**
+ * Move the domains and keys of 'src' to the end of 'dest'. 'src' is empty
+ * afterwards.
+ */
+void merge_SortedDomains(SortedDomains_t *dest, SortedDomains_t *src)
+{
+	ASSERT(dest);
+	ASSERT(src);
+
+	reserve_SortedDomains(dest, dest->len + src->len);
+	if(src->len)
+	{
+		memcpy(dest->domains + dest->len, src->domains,
+				sizeof(SortedDomain_t) * src->len);
+	}
+	dest->len += src->len;
+	if(src->max_len_key > dest->max_len_key)
+	{
+		dest->max_len_key = src->max_len_key;
+	}
+	merge_Arena(&dest->arena, &src->arena);
+
+	free(src->domains);
+	src->domains = NULL;
+	src->len = src->alloc = 0;
+	src->max_len_key = 0;
+}
+
+static int compare_keys(SortedDomain_t const *a, SortedDomain_t const *b)
+{
+	if(a->prefix != b->prefix)
+	{
+		return a->prefix < b->prefix ? -1 : 1;
+	}
+
+	const size_t len = a->len_key < b->len_key ? a->len_key : b->len_key;
+	const int cmp = memcmp(a->key, b->key, len);
+	if(cmp)
+	{
+		return cmp;
+	}
+
+	return (a->len_key > b->len_key) - (a->len_key < b->len_key);
+}
+
+/**
+ * Order by key and for equal keys by the order the lines are inserted into a
+ * DomainTree: by file then by line.
+ */
+static int compare_SortedDomain(void const *va, void const *vb)
+{
+	SortedDomain_t const *a = va;
+	SortedDomain_t const *b = vb;
+
+	const int cmp = compare_keys(a, b);
+	if(cmp)
+	{
+		return cmp;
+	}
+
+	if(a->file_index != b->file_index)
+	{
+		return a->file_index < b->file_index ? -1 : 1;
+	}
+
+	return (a->linenumber > b->linenumber) - (a->linenumber < b->linenumber);
+}
+
+typedef struct SortRun
+{
+	SortedDomain_t *src;
+	SortedDomain_t *dest;
+	size_t begin;
+	size_t middle;
+	size_t end;
+} SortRun_t;
+
+static void *sort_run(void *arg)
+{
+	SortRun_t *run = arg;
+	qsort(run->src + run->begin, run->end - run->begin, sizeof(SortedDomain_t),
+			compare_SortedDomain);
+	return NULL;
+}
+
+static void *merge_run(void *arg)
+{
+	SortRun_t *run = arg;
+	size_t a = run->begin, b = run->middle, out = run->begin;
+
+	while(a < run->middle && b < run->end)
+	{
+		if(compare_SortedDomain(&run->src[b], &run->src[a]) < 0)
+		{
+			run->dest[out++] = run->src[b++];
+		}
+		else
+		{
+			run->dest[out++] = run->src[a++];
+		}
+	}
+	memcpy(run->dest + out, run->src + a, sizeof(SortedDomain_t) * (run->middle - a));
+	out += run->middle - a;
+	memcpy(run->dest + out, run->src + b, sizeof(SortedDomain_t) * (run->end - b));
+
+	return NULL;
+}
+
+static void run_all(void *(*func)(void *), SortRun_t *runs, size_t len_runs,
+		pthread_t *threads)
+{
+	// the calling thread takes the first run.
+	for(size_t t = 1; t < len_runs; t++)
+	{
+		if(pthread_create(&threads[t], NULL, func, &runs[t]))
+		{
+			ELOG_STDERR("ERROR: failed to create sort thread.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	func(&runs[0]);
+
+	for(size_t t = 1; t < len_runs; t++)
+	{
+		pthread_join(threads[t], NULL);
+	}
+}
+
+/**
+ * Sort the domains by key and insertion order. The array is split into one
+ * run per thread, each run is sorted on its own thread, then the runs are
+ * merged pairwise until one is left.
+ */
+void sort_SortedDomains(SortedDomains_t *sd, size_t num_threads)
+{
+	ASSERT(sd);
+
+	size_t len_runs = num_threads ? num_threads : 1;
+	if(sd->len < len_runs * 1024)
+	{
+		len_runs = 1;
+	}
+
+	if(len_runs == 1)
+	{
+		if(sd->len)
+		{
+			qsort(sd->domains, sd->len, sizeof(SortedDomain_t),
+					compare_SortedDomain);
+		}
+		return;
+	}
+
+	SortedDomain_t *other = malloc(sizeof(SortedDomain_t) * sd->len);
+	SortRun_t *runs = calloc(len_runs, sizeof(SortRun_t));
+	pthread_t *threads = calloc(len_runs, sizeof(pthread_t));
+	size_t *bounds = calloc(len_runs + 1, sizeof(size_t));
+	if(!other || !runs || !threads || !bounds)
+	{
+		ELOG_STDERR("ERROR: failed to allocate sort runs\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for(size_t r = 0; r <= len_runs; r++)
+	{
+		bounds[r] = sd->len * r / len_runs;
+	}
+
+	for(size_t r = 0; r < len_runs; r++)
+	{
+		runs[r].src = sd->domains;
+		runs[r].begin = bounds[r];
+		runs[r].end = bounds[r + 1];
+	}
+	run_all(sort_run, runs, len_runs, threads);
+
+	SortedDomain_t *src = sd->domains, *dest = other;
+	for(size_t width = 1; width < len_runs; width *= 2)
+	{
+		size_t len_merges = 0;
+		for(size_t r = 0; r < len_runs; r += 2 * width)
+		{
+			SortRun_t *run = &runs[len_merges++];
+			run->src = src;
+			run->dest = dest;
+			run->begin = bounds[r];
+			run->middle = bounds[r + width < len_runs ? r + width : len_runs];
+			run->end = bounds[r + 2 * width < len_runs ? r + 2 * width : len_runs];
+		}
+		run_all(merge_run, runs, len_merges, threads);
+
+		SortedDomain_t *tmp = src;
+		src = dest;
+		dest = tmp;
+	}
+
+	if(src != sd->domains)
+	{
+		free(sd->domains);
+		sd->domains = src;
+	}
+	else
+	{
+		free(other);
+	}
+	// 'domains' and 'other' hold exactly 'len' items.
+	sd->alloc = sd->len;
+
+	free(bounds);
+	free(threads);
+	free(runs);
+}
+
+/**
+ * Returns true when 'd' is a subdomain of 'parent'.
+ */
+static bool covers(SortedDomain_t const *parent, SortedDomain_t const *d)
+{
+	return parent->len_key < d->len_key &&
+		!memcmp(parent->key, d->key, parent->len_key);
+}
+
+/**
+ * Rebuild the name of the domain from its key into the end of 'buf' of
+ * 'len_buf' bytes, leaving room for a terminating null. Returns the start of
+ * the name; the key must be at most 'len_buf' bytes.
+ */
+char *fqd_SortedDomain(SortedDomain_t const *d, char *buf, size_t len_buf,
+		size_t *len)
+{
+	ASSERT(d->len_key <= len_buf);
+
+	char *const last = buf + len_buf - 1;
+	char *fqd = last;
+	char const *pos = d->key;
+	char const *const end = d->key + d->len_key;
+
+	while(pos != end)
+	{
+		const uchar len_label = *pos++;
+		if(fqd != last)
+		{
+			*--fqd = '.';
+		}
+		fqd -= len_label;
+		memcpy(fqd, pos, len_label);
+		pos += len_label;
+	}
+
+	*len = last - fqd;
+	return fqd;
+}
+
+/**
+ * Resolve the sorted domains the same as inserting them into a DomainTree in
+ * order: of each domain the first line of the strongest match is kept unless
+ * a parent domain is a FULL match; all of its subdomains follow it and are
+ * dropped. 'visit' is given every line with what became of it and whether it
+ * is kept. A kept domain for which the optional 'drop' returns true is not
+ * kept. Returns the number of domains dropped.
+ */
+size_t sweep_SortedDomains(SortedDomains_t const *sd,
+		bool(*drop)(char const *fqd, size_t len, void *context),
+		void *drop_context,
+		void(*visit)(SortedDomain_t const *d, InsertOutcome_t outcome,
+			bool kept, void *context),
+		void *context)
+{
+	ASSERT(sd);
+	ASSERT(visit);
+
+	char *buf = NULL;
+	if(drop)
+	{
+		buf = malloc(SORTED_FQD_MAX + 1);
+		if(!buf)
+		{
+			ELOG_STDERR("ERROR: failed to allocate domain buffer\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	SortedDomain_t const *const domains = sd->domains;
+	SortedDomain_t const *cover = NULL;
+	size_t dropped = 0;
+
+	for(size_t begin = 0, end; begin < sd->len; begin = end)
+	{
+		end = begin + 1;
+		while(end < sd->len && !compare_keys(&domains[begin], &domains[end]))
+		{
+			end++;
+		}
+
+		if(cover && covers(cover, &domains[begin]))
+		{
+			for(size_t i = begin; i < end; i++)
+			{
+				visit(&domains[i], INSERT_UNDER_FULL, false, context);
+			}
+			continue;
+		}
+		cover = NULL;
+
+		size_t owner = begin;
+		for(size_t i = begin + 1; i < end; i++)
+		{
+			if(domains[i].match_strength > domains[owner].match_strength)
+			{
+				owner = i;
+			}
+		}
+
+		bool kept = true;
+		if(drop && domains[owner].len_key <= SORTED_FQD_MAX)
+		{
+			size_t len;
+			char *fqd = fqd_SortedDomain(&domains[owner], buf,
+					SORTED_FQD_MAX + 1, &len);
+			fqd[len] = '\0';
+			if((*drop)(fqd, len, drop_context))
+			{
+				kept = false;
+				dropped++;
+			}
+		}
+
+		signed char strongest = domains[begin].match_strength;
+		visit(&domains[begin], INSERT_NEW, kept && begin == owner, context);
+		for(size_t i = begin + 1; i < end; i++)
+		{
+			InsertOutcome_t outcome = INSERT_IDENTICAL;
+			if(domains[i].match_strength > strongest)
+			{
+				strongest = domains[i].match_strength;
+				outcome = INSERT_REPLACED;
+			}
+			visit(&domains[i], outcome, kept && i == owner, context);
+		}
+
+		if(domains[owner].match_strength == MATCH_FULL)
+		{
+			cover = &domains[owner];
+		}
+	}
+
+	free(buf);
+	return dropped;
+}
+
+#ifdef BUILD_TESTS
+typedef struct TestKept
+{
+	LineBitmap_t *kept;
+	size_t len_kept;
+} TestKept_t;
+
+static void test_collect_tree(DomainInfo_t const *di, void *context)
+{
+	TestKept_t *tk = context;
+	assert(di->file_index < tk->len_kept);
+	set_LineBitmap(&tk->kept[di->file_index], di->linenumber);
+}
+
+static void test_visit_sorted(SortedDomain_t const *d, InsertOutcome_t outcome,
+		bool kept, void *context)
+{
+	UNUSED(outcome);
+	TestKept_t *tk = context;
+	assert(d->file_index < tk->len_kept);
+	if(kept)
+	{
+		assert(!has_LineBitmap(&tk->kept[d->file_index], d->linenumber));
+		set_LineBitmap(&tk->kept[d->file_index], d->linenumber);
+	}
+}
+
+static bool test_drop_www(char const *fqd, size_t len, void *context)
+{
+	UNUSED(context);
+	assert(strlen(fqd) == len);
+	return len > 4 && !memcmp(fqd, "www.", 4);
+}
+
+/**
+ * Random domains over a small alphabet so there are plenty of duplicates and
+ * parents. The kept lines of the tree and of the sweep must be the same.
+ */
+static void test_compare_DomainTree(size_t num_threads, bool with_drop)
+{
+	enum { LEN_FILES = 3, LEN_LINES = 4000 };
+	static const char *TLDS[] = { "com", "net" };
+	static const char *LABELS[] = { "a", "b", "c", "d", "www", "ads", "x", "y",
+		"z", "cdn" };
+	const size_t len_labels = sizeof(LABELS) / sizeof(LABELS[0]);
+
+	DomainTree_t *root = NULL;
+	Arena_t arena;
+	init_Arena(&arena);
+	SortedDomains_t sd;
+	init_SortedDomains(&sd);
+	DomainView_t dv;
+	init_DomainView(&dv);
+
+	uint64_t state = 42;
+	char fqd[128];
+	for(size_t f = 0; f < LEN_FILES; f++)
+	{
+		for(size_t line = 1; line <= LEN_LINES; line++)
+		{
+			state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+			const size_t depth = (state >> 33) % 4;
+			size_t len = 0;
+			for(size_t i = 0; i < depth; i++)
+			{
+				state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+				len += sprintf(fqd + len, "%s.", LABELS[(state >> 33) % len_labels]);
+			}
+			state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+			len += sprintf(fqd + len, "s%u.%s", (uint)((state >> 33) % 200),
+					TLDS[(state >> 40) % 2]);
+
+			assert(update_DomainView(&dv, fqd, len));
+			dv.file_index = f;
+			dv.linenumber = line;
+			dv.match_strength = (state >> 44) % 16 == 0 ? MATCH_FULL : MATCH_WEAK;
+
+			insert_DomainTree(&root, &arena, &dv, NULL);
+			assert(append_SortedDomains(&sd, &dv));
+		}
+	}
+
+	LineBitmap_t tree_kept[LEN_FILES], sorted_kept[LEN_FILES];
+	for(size_t f = 0; f < LEN_FILES; f++)
+	{
+		init_LineBitmap(&tree_kept[f]);
+		init_LineBitmap(&sorted_kept[f]);
+	}
+
+	size_t tree_dropped = 0;
+	if(with_drop)
+	{
+		tree_dropped = prune_DomainTree(root, test_drop_www, NULL);
+	}
+	TestKept_t tk = { tree_kept, LEN_FILES };
+	transfer_DomainInfo(&root, test_collect_tree, &tk);
+
+	sort_SortedDomains(&sd, num_threads);
+	for(size_t i = 1; i < sd.len; i++)
+	{
+		assert(compare_SortedDomain(&sd.domains[i - 1], &sd.domains[i]) < 0);
+	}
+
+	tk.kept = sorted_kept;
+	const size_t sorted_dropped = sweep_SortedDomains(&sd,
+			with_drop ? test_drop_www : NULL, NULL, test_visit_sorted, &tk);
+	assert(sorted_dropped == tree_dropped);
+
+	size_t len_kept = 0;
+	for(size_t f = 0; f < LEN_FILES; f++)
+	{
+		len_kept += tree_kept[f].count;
+		assert(equal_LineBitmap(&tree_kept[f], &sorted_kept[f]));
+		free_LineBitmap(&tree_kept[f]);
+		free_LineBitmap(&sorted_kept[f]);
+	}
+	// enough survive to tell the engines apart.
+	assert(len_kept > 100);
+
+	free_DomainView(&dv);
+	free_SortedDomains(&sd);
+	free_DomainTree(&root, &arena);
+	free_Arena(&arena);
+}
+
+static void test_merge_SortedDomains()
+{
+	SortedDomains_t a, b;
+	init_SortedDomains(&a);
+	init_SortedDomains(&b);
+	DomainView_t dv;
+	init_DomainView(&dv);
+
+	assert(update_DomainView(&dv, "www.example.com", 15));
+	dv.match_strength = MATCH_BOGUS;
+	assert(!append_SortedDomains(&a, &dv));
+	assert(!a.len);
+
+	dv.match_strength = MATCH_WEAK;
+	dv.linenumber = 1;
+	assert(append_SortedDomains(&a, &dv));
+	assert(a.domains[0].len_key == 3 + 15 - 2);
+	assert(!memcmp(a.domains[0].key, "\3com\7example\3www", 16));
+
+	assert(update_DomainView(&dv, "example.com", 11));
+	dv.linenumber = 2;
+	assert(append_SortedDomains(&b, &dv));
+
+	merge_SortedDomains(&a, &b);
+	assert(a.len == 2);
+	assert(!b.len && !b.domains);
+	assert(a.domains[1].linenumber == 2);
+
+	// a buffer of the longest key fits every name.
+	assert(a.max_len_key == 16);
+	char buf[17];
+	size_t len;
+	char const *fqd = fqd_SortedDomain(&a.domains[0], buf, sizeof(buf), &len);
+	assert(len == 15);
+	assert(!memcmp(fqd, "www.example.com", len));
+
+	sort_SortedDomains(&a, 1);
+	assert(a.domains[0].linenumber == 2);
+	assert(covers(&a.domains[0], &a.domains[1]));
+	assert(!covers(&a.domains[1], &a.domains[0]));
+
+	free_DomainView(&dv);
+	free_SortedDomains(&a);
+	free_SortedDomains(&b);
+}
+
+void test_SortedDomains()
+{
+	test_merge_SortedDomains();
+	test_compare_DomainTree(1, false);
+	test_compare_DomainTree(3, false);
+	test_compare_DomainTree(4, true);
+}
+#endif
@@ -29,9 +29,11 @@
 #include "pfb_context.h"
 #include "rw_pfb_csv.h"
 #include "pfb_prune.h"
+#include "snapshot.h"
 #include "test.h"
 
-static void do_test_end2end(const int argc, char *const *argv_i);
+static void do_test_end2end(const int argc, char *const *argv_i,
+		size_t num_threads, char const *snapshot_fname);
 
 /**
  * Full end to end test with an empty output file b/c all of its inputs are
@@ -43,7 +45,7 @@ static void test_end2end()
 							"tests/unit_pfb_prune/E2ETestInput_2.txt",
 							"tests/unit_pfb_prune/E2ETestInput_3.txt"};
 
-	do_test_end2end(3, argv_i);
+	do_test_end2end(3, argv_i, 1, NULL);
 }
 
 /**
@@ -54,7 +56,7 @@ static void test_end2end_empty()
 	char *const argv_i[] = {"tests/unit_pfb_prune/E2ETestInput_1.txt",
 							"tests/unit_pfb_prune/E2ETest_Empty.txt"};
 
-	do_test_end2end(2, argv_i);
+	do_test_end2end(2, argv_i, 1, NULL);
 }
 
 /**
@@ -65,7 +67,7 @@ static void test_end2end_empty()
  * during the consolidation step.
  * -r is optional.
  */
-static void test_carry_over_end2end()
+static void test_carry_over_end2end(size_t num_threads)
 {
 							// exactly 10 lines in all
 	char *const argv_i[] = {"tests/unit_pfb_prune/E2ETestRegexInput_1.txt",
@@ -81,10 +83,118 @@ static void test_carry_over_end2end()
 							"tests/unit_pfb_prune/E2ETestRegexInput_5.txt"
 	};
 
-	do_test_end2end(6, argv_i);
+	do_test_end2end(6, argv_i, num_threads, NULL);
 }
 
-static void do_test_end2end(const int argc, char *const *argv_i)
+/**
+ * Domains of either file matched by a regex of the first file are removed. The
+ * regex lines are kept whether or not they are supported.
+ */
+static void test_regex_prune_end2end(size_t num_threads)
+{
+	char *const argv_i[] = {"tests/unit_pfb_prune/E2ETestRegexPrune_1.txt",
+							"tests/unit_pfb_prune/E2ETestRegexPrune_2.txt"};
+
+	set_prune_regex(true);
+	do_test_end2end(2, argv_i, num_threads, NULL);
+	set_prune_regex(false);
+
+	const char *expected[] = {
+		",(?:^|\\.)ads[^\"\\x2c\\s]*\\.example\\.com,,0,E2ETestRegexPrune_1,DNSBL_Test,2\n"
+		",example.com,,0,E2ETestRegexPrune_1,DNSBL_Test,0\n"
+		",ads.example.net,,0,E2ETestRegexPrune_1,DNSBL_Test,1\n"
+		",^\\d+\\.tracker\\.io$,,0,E2ETestRegexPrune_1,DNSBL_Test,2\n"
+		",x123.tracker.io,,0,E2ETestRegexPrune_1,DNSBL_Test,0\n"
+		",(?=lookahead)ahead\\.com,,0,E2ETestRegexPrune_1,DNSBL_Test,2\n"
+		",lookahead.com,,0,E2ETestRegexPrune_1,DNSBL_Test,0\n",
+		",safe.example.com,,0,E2ETestRegexPrune_2,DNSBL_Test,0\n"
+	};
+	const char *outputs[] = {"tests/unit_pfb_prune/E2ETestRegexPrune_1.fulle2e",
+							"tests/unit_pfb_prune/E2ETestRegexPrune_2.fulle2e"};
+
+	for(size_t i = 0; i < 2; i++)
+	{
+		char buf[1024];
+		FILE *f = fopen(outputs[i], "rb");
+		assert(f);
+		const size_t len = fread(buf, sizeof(char), sizeof(buf), f);
+		fclose(f);
+		assert(len == strlen(expected[i]));
+		assert(!memcmp(buf, expected[i], len));
+	}
+}
+
+/**
+ * Returns the contents of the given file; the caller frees it.
+ */
+static char *read_test_file(char const *fname, size_t *len)
+{
+	FILE *f = fopen(fname, "rb");
+	assert(f);
+	assert(!fseek(f, 0, SEEK_END));
+	const long size = ftell(f);
+	assert(size >= 0);
+	rewind(f);
+
+	char *data = malloc(size + 1);
+	assert(data);
+	*len = fread(data, sizeof(char), size, f);
+	assert(*len == (size_t)size);
+	fclose(f);
+	return data;
+}
+
+/**
+ * The same inputs run twice with the same snapshot. The second run replays
+ * every input from the snapshot and its outputs, written again since they are
+ * removed in between, are the same as those of the first run.
+ */
+static void test_snapshot_end2end(size_t num_threads)
+{
+	// the inputs of test_carry_over_end2end(); outputs are the same.
+	char *const argv_i[] = {"tests/unit_pfb_prune/E2ETestRegexInput_1.txt",
+							"tests/unit_pfb_prune/E2ETestRegexInput_2.txt",
+							"tests/unit_pfb_prune/E2ETestRegexInput_3.txt",
+							"tests/unit_pfb_prune/E2ETest_Empty.txt",
+							"tests/unit_pfb_prune/E2ETestRegexInput_4.txt",
+							"tests/unit_pfb_prune/E2ETestRegexInput_5.txt"};
+	char const *outputs[] = {"tests/unit_pfb_prune/E2ETestRegexInput_1.fulle2e",
+							"tests/unit_pfb_prune/E2ETestRegexInput_2.fulle2e",
+							"tests/unit_pfb_prune/E2ETestRegexInput_3.fulle2e",
+							"tests/unit_pfb_prune/E2ETest_Empty.fulle2e",
+							"tests/unit_pfb_prune/E2ETestRegexInput_4.fulle2e",
+							"tests/unit_pfb_prune/E2ETestRegexInput_5.fulle2e"};
+	char const *snapshot_fname = "tests/unit_pfb_prune/test_end2end_snapshot.work";
+	const size_t len_files = sizeof(outputs) / sizeof(outputs[0]);
+
+	remove(snapshot_fname);
+	do_test_end2end(len_files, argv_i, num_threads, snapshot_fname);
+
+	char *first[len_files];
+	size_t len_first[len_files];
+	for(size_t i = 0; i < len_files; i++)
+	{
+		first[i] = read_test_file(outputs[i], &len_first[i]);
+		assert(!remove(outputs[i]));
+	}
+
+	do_test_end2end(len_files, argv_i, num_threads, snapshot_fname);
+
+	for(size_t i = 0; i < len_files; i++)
+	{
+		size_t len;
+		char *second = read_test_file(outputs[i], &len);
+		assert(len == len_first[i]);
+		assert(!memcmp(second, first[i], len));
+		free(second);
+		free(first[i]);
+	}
+
+	remove(snapshot_fname);
+}
+
+static void do_test_end2end(const int argc, char *const *argv_i,
+		size_t num_threads, char const *snapshot_fname)
 {
 	bool use_shared_buffer = true;
 
@@ -112,7 +222,17 @@ static void do_test_end2end(const int argc, char *const *argv_i)
 	assert(contexts.begin_context->dt);
 	assert(contexts.begin_context->dt[0] == NULL);
 
-	pfb_read_csv(&contexts);
+	// inputs unchanged since the optional snapshot are replayed from it.
+	Snapshot_t snap;
+	init_Snapshot(&snap);
+	if(snapshot_fname)
+	{
+		assert(load_Snapshot(&snap, snapshot_fname));
+		attach_Snapshot(&snap, &contexts);
+	}
+
+	pfb_read_csv_parallel(&contexts, num_threads);
+	pfb_prune_regex(&contexts);
 
 	// confirm that reading didn't bork a pointer
 	assert(contexts.begin_context->dt);
@@ -128,20 +248,21 @@ static void do_test_end2end(const int argc, char *const *argv_i)
 	init_ArrayDomainInfo(&array_di, pfb_len_contexts(&contexts));
 	array_di.begin_pfb_context = contexts.begin_context;
 
-	for(int i = 0; i < argc; i++)
-	{
-		printf("alloc contextdomain=[%d]=%lu\n", i, (size_t)array_di.cd[i].alloc_linenumbers);
-	}
-
-
-	pfb_consolidate(contexts.begin_context->dt, &array_di);
+	pfb_consolidate(contexts.begin_context->dt, contexts.begin_context->arena,
+			&array_di);
 	assert(contexts.begin_context->dt);
 	assert(!contexts.begin_context->dt[0]);
 
-	pfb_write_csv(&contexts, &array_di, use_shared_buffer);
+	pfb_write_csv_parallel(&contexts, &array_di, use_shared_buffer,
+			num_threads);
+	if(snapshot_fname)
+	{
+		assert(save_Snapshot(&snap, snapshot_fname, &contexts, &array_di));
+	}
 
 	pfb_free_contexts(&contexts);
 	free_ArrayDomainInfo(&array_di);
+	free_Snapshot(&snap);
 
 	assert(!contexts.begin_context);
 	assert(!contexts.end_context);
@@ -160,7 +281,47 @@ void run_tests()
 	test_end2end_empty();
 	test_input_args();
 	test_carry_over();
-	test_carry_over_end2end();
+	test_carry_over_end2end(1);
+	// same outputs are expected when the files are parsed by reader threads.
+	test_carry_over_end2end(3);
+	// and when the files are memory mapped.
+	set_read_mmap(true);
+	test_carry_over_end2end(1);
+	test_carry_over_end2end(3);
+	set_read_mmap(false);
+	// and when the kept lines are copied by their recorded offsets.
+	set_write_spans(true);
+	test_carry_over_end2end(1);
+	test_carry_over_end2end(3);
+	set_read_mmap(true);
+	test_carry_over_end2end(3);
+	set_read_mmap(false);
+	set_write_spans(false);
+	// regexes that match none of the domains change nothing.
+	set_prune_regex(true);
+	test_carry_over_end2end(3);
+	set_prune_regex(false);
+	test_regex_prune_end2end(1);
+	test_regex_prune_end2end(3);
+	// a second run replays the inputs from the snapshot of the first.
+	test_snapshot_end2end(1);
+	test_snapshot_end2end(3);
+	test_ParsedBatch();
+	test_Arena();
+	test_LineSpans();
+	test_LineBitmap();
+	test_OutBuffer();
+	test_AsyncLog();
+	test_RunStats();
+	test_Snapshot();
+	test_SortedDomains();
+	test_UnboundConf();
+	test_ExactSet();
+	test_DomainChildren();
+	test_TldTable();
+	test_LabelHash();
+	test_scan();
+	test_RegexSet();
 	printf("OK.\n");
 
 	printf("Printing info of structs...\n");
@@ -0,0 +1,81 @@
+/**
+ * tldtable.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dedupdomains.h"
+#include "tldtable.h"
+#include "tldtable.nogit.h"
+
+/**
+ * Returns the slot of the label in the table of known TLDs or TLD_TABLE_NONE.
+ * Each known TLD has a slot of its own in [0, slots_TldTable()).
+ */
+size_t find_TldTable(char const *label, size_t len)
+{
+	uint32_t hashv;
+	TLD_HASH(label, len, TLD_TABLE_SEED, hashv);
+	const size_t slot = TLD_SLOT(hashv, TLD_DISPLACEMENTS,
+			TLD_TABLE_BUCKET_BITS, TLD_TABLE_SLOT_BITS);
+
+	// empty slots have a length of zero.
+	if(len && TLD_LENGTHS[slot] == len &&
+			!memcmp(TLD_LABELS[slot], label, len))
+	{
+		return slot;
+	}
+	return TLD_TABLE_NONE;
+}
+
+size_t slots_TldTable()
+{
+	return (size_t)1 << TLD_TABLE_SLOT_BITS;
+}
+
+#ifdef BUILD_TESTS
+void test_TldTable()
+{
+	// every known TLD is found in a slot of its own.
+	bool *taken = calloc(slots_TldTable(), sizeof(bool));
+	size_t found = 0;
+	for(size_t s = 0; s < slots_TldTable(); s++)
+	{
+		if(!TLD_LENGTHS[s])
+		{
+			continue;
+		}
+		const size_t slot = find_TldTable(TLD_LABELS[s], TLD_LENGTHS[s]);
+		assert(slot == s);
+		assert(!taken[slot]);
+		taken[slot] = true;
+		found++;
+	}
+	assert(found == TLD_TABLE_LEN);
+	free(taken);
+
+	assert(find_TldTable("com", 3) != TLD_TABLE_NONE);
+	assert(find_TldTable("org", 3) != TLD_TABLE_NONE);
+	assert(find_TldTable("com", 3) != find_TldTable("org", 3));
+
+	// labels that are not TLDs are not found.
+	assert(find_TldTable("comx", 4) == TLD_TABLE_NONE);
+	assert(find_TldTable("co", 2) != find_TldTable("com", 3));
+	assert(find_TldTable("localhost", 9) == TLD_TABLE_NONE);
+	assert(find_TldTable("", 0) == TLD_TABLE_NONE);
+}
+#endif
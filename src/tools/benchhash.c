@@ -0,0 +1,275 @@
+/**
+ * benchhash.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * Compares the label hashes of labelhash.c on the labels of real inputs:
+ *
+ *   benchhash.real [-r repeat] <file>...
+ *
+ * The domain is the second column of a pfBlockerNG CSV line or the whole line
+ * otherwise. Every label of every domain is hashed, then looked up in an open
+ * addressing table of the distinct labels built with the same hash. Reports
+ * hashes and lookups per second and the mean probes per lookup.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "labelhash.h"
+
+typedef struct Label
+{
+	char const *data;
+	uint32_t len;
+} Label_t;
+
+typedef struct Labels
+{
+	Label_t *labels;
+	size_t len;
+	size_t alloc;
+} Labels_t;
+
+typedef struct LabelHash
+{
+	char const *name;
+	uint32_t (*hash)(char const *label, size_t len);
+} LabelHash_t;
+
+static const LabelHash_t HASHES[] = {
+	{ "wy", hash_label_wy },
+	{ "fnv", hash_label_fnv },
+	{ "jen", hash_label_jen }
+};
+#define LEN_HASHES (sizeof(HASHES) / sizeof(HASHES[0]))
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append_label(Labels_t *ls, char const *data, size_t len)
+{
+	if(ls->len == ls->alloc)
+	{
+		ls->alloc = ls->alloc ? ls->alloc * 2 : 1 << 16;
+		Label_t *tmp = realloc(ls->labels, sizeof(Label_t) * ls->alloc);
+		if(!tmp)
+		{
+			exit(EXIT_FAILURE);
+		}
+		ls->labels = tmp;
+	}
+	ls->labels[ls->len].data = data;
+	ls->labels[ls->len].len = len;
+	ls->len++;
+}
+
+/**
+ * Adds the labels of every domain of the file. The lines are kept for as long
+ * as the labels point into them.
+ */
+static void read_labels(char const *fname, Labels_t *ls)
+{
+	FILE *f = fopen(fname, "r");
+	if(!f)
+	{
+		fprintf(stderr, "ERROR: failed to open %s\n", fname);
+		exit(EXIT_FAILURE);
+	}
+
+	char *line = NULL;
+	size_t alloc = 0;
+	ssize_t read;
+	while((read = getline(&line, &alloc, f)) > 0)
+	{
+		char *domain = line;
+		char *end = line + strcspn(line, "\r\n");
+		char *comma = memchr(line, ',', end - line);
+		if(comma)
+		{
+			domain = comma + 1;
+			char *next = memchr(domain, ',', end - domain);
+			end = next ? next : end;
+		}
+
+		char *start = domain;
+		for(char *p = domain; p <= end; p++)
+		{
+			if(p == end || *p == '.')
+			{
+				if(p > start)
+				{
+					append_label(ls, start, p - start);
+				}
+				start = p + 1;
+			}
+		}
+
+		// the labels point into this line.
+		line = NULL;
+		alloc = 0;
+	}
+	free(line);
+	fclose(f);
+}
+
+typedef struct Slot
+{
+	uint32_t hash;
+	// index of a label with the text of the slot plus one; zero when empty.
+	uint32_t label;
+} Slot_t;
+
+static Slot_t *find_slot(Slot_t *slots, size_t mask, Label_t const *labels,
+		uint32_t hash, Label_t const *label, size_t *probes)
+{
+	for(size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		(*probes)++;
+		Slot_t *slot = &slots[i];
+		if(!slot->label)
+		{
+			return slot;
+		}
+		Label_t const *held = &labels[slot->label - 1];
+		if(slot->hash == hash && held->len == label->len &&
+				!memcmp(held->data, label->data, label->len))
+		{
+			return slot;
+		}
+	}
+}
+
+static void bench_hash(LabelHash_t const *lh, Labels_t const *ls,
+		size_t repeat)
+{
+	// the sum keeps the hashing from being optimized away.
+	uint32_t sum = 0;
+	double begin = now();
+	for(size_t r = 0; r < repeat; r++)
+	{
+		for(size_t i = 0; i < ls->len; i++)
+		{
+			sum += lh->hash(ls->labels[i].data, ls->labels[i].len);
+		}
+	}
+	const double hash_s = now() - begin;
+
+	size_t alloc = 1024;
+	while(alloc < 2 * ls->len)
+	{
+		alloc *= 2;
+	}
+	Slot_t *slots = calloc(alloc, sizeof(Slot_t));
+	if(!slots)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	size_t distinct = 0, probes = 0;
+	for(size_t i = 0; i < ls->len; i++)
+	{
+		Label_t const *label = &ls->labels[i];
+		const uint32_t hash = lh->hash(label->data, label->len);
+		Slot_t *slot = find_slot(slots, alloc - 1, ls->labels, hash, label,
+				&probes);
+		if(!slot->label)
+		{
+			slot->hash = hash;
+			slot->label = i + 1;
+			distinct++;
+		}
+	}
+
+	probes = 0;
+	begin = now();
+	for(size_t r = 0; r < repeat; r++)
+	{
+		for(size_t i = 0; i < ls->len; i++)
+		{
+			Label_t const *label = &ls->labels[i];
+			const uint32_t hash = lh->hash(label->data, label->len);
+			sum += find_slot(slots, alloc - 1, ls->labels, hash, label,
+					&probes)->label;
+		}
+	}
+	const double lookup_s = now() - begin;
+	free(slots);
+
+	const double total = (double)ls->len * repeat;
+	printf("%-6s %10.1f %12.1f %10.3f %10lu %08x\n", lh->name,
+			total / hash_s / 1e6, total / lookup_s / 1e6, probes / total,
+			distinct, sum);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t repeat = 10;
+	int opt;
+	while((opt = getopt(argc, argv, "r:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'r':
+				repeat = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-r repeat] <file>...\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if(optind >= argc || !repeat)
+	{
+		fprintf(stderr, "usage: %s [-r repeat] <file>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Labels_t ls = { NULL, 0, 0 };
+	for(int i = optind; i < argc; i++)
+	{
+		read_labels(argv[i], &ls);
+	}
+
+	size_t bytes = 0;
+	for(size_t i = 0; i < ls.len; i++)
+	{
+		bytes += ls.labels[i].len;
+	}
+	printf("%lu labels, %.1f bytes on average, %lu repeats; built with %s\n",
+			ls.len, ls.len ? (double)bytes / ls.len : 0.0, repeat,
+			name_LabelHash());
+	printf("%-6s %10s %12s %10s %10s %8s\n", "hash", "Mhash/s", "Mlookups/s",
+			"probes", "distinct", "sum");
+
+	for(size_t h = 0; h < LEN_HASHES; h++)
+	{
+		bench_hash(&HASHES[h], &ls, repeat);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,378 @@
+/**
+ * gencorpus.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * Writes synthetic pfBlockerNG CSV files for scale testing. The output depends
+ * only on the options and the seed so runs are reproducible:
+ *
+ *   gencorpus.real -d <dir> [-f files] [-n lines] [-s seed] [-O overlap]
+ *       [-F full] [-R regex] [-D depth] [-k skew] [-S slds] [-p prefix]
+ *
+ * Every domain is derived from a 64 bit id. Ids drawn from the shared pool
+ * appear in several files; ids of a file's own range appear in no other file.
+ * The second level domain of a subdomain is picked with a Zipf distribution so
+ * a few popular domains collect most of the subdomains.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+// subdomain labels above the second level domain.
+#define MAX_DEPTH 8
+
+static const char *TLDS[] = { "com", "net", "org", "io", "de", "fr", "cn",
+	"ru", "info", "xyz", "co.uk", "com.br" };
+#define LEN_TLDS (sizeof(TLDS) / sizeof(TLDS[0]))
+
+static const char LABEL_CHARS[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+typedef struct GenOptions
+{
+	char const *directory;
+	char const *prefix;
+	size_t files;
+	size_t lines;
+	uint64_t seed;
+	// share of lines drawn from the pool common to all files.
+	double overlap;
+	// share of domain lines that are MATCH_FULL.
+	double full;
+	// share of all lines that are regex lines.
+	double regex;
+	// chance of one more subdomain label; geometric depth.
+	double depth;
+	// exponent of the Zipf distribution over the second level domains.
+	double skew;
+	size_t slds;
+} GenOptions_t;
+
+static uint64_t splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+static double uniform(uint64_t *state)
+{
+	return (splitmix64(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Cumulative distribution of the Zipf distribution over 'len' ranks.
+ */
+static double *zipf_cdf(size_t len, double skew)
+{
+	double *cdf = malloc(sizeof(double) * len);
+	if(!cdf)
+	{
+		fprintf(stderr, "ERROR: failed to allocate %zu ranks.\n", len);
+		exit(EXIT_FAILURE);
+	}
+
+	double sum = 0.0;
+	for(size_t i = 0; i < len; i++)
+	{
+		sum += 1.0 / pow((double)(i + 1), skew);
+		cdf[i] = sum;
+	}
+	for(size_t i = 0; i < len; i++)
+	{
+		cdf[i] /= sum;
+	}
+	return cdf;
+}
+
+static size_t sample_zipf(double const *cdf, size_t len, double u)
+{
+	size_t lo = 0, hi = len - 1;
+	while(lo < hi)
+	{
+		const size_t mid = lo + (hi - lo) / 2;
+		if(cdf[mid] < u)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static char *append_label(char *out, uint64_t *state, size_t min, size_t max)
+{
+	const size_t len = min + splitmix64(state) % (max - min + 1);
+	for(size_t i = 0; i < len; i++)
+	{
+		*out++ = LABEL_CHARS[splitmix64(state) % (sizeof(LABEL_CHARS) - 1)];
+	}
+	return out;
+}
+
+/**
+ * Second level domain and top level domain of the given rank; always the same
+ * for the same rank and seed.
+ */
+static char *append_sld(char *out, uint64_t seed, size_t rank)
+{
+	uint64_t state = seed ^ (0xd1b54a32d192ed03ULL * (rank + 1));
+	out = append_label(out, &state, 4, 14);
+	*out++ = '.';
+	char const *tld = TLDS[splitmix64(&state) % LEN_TLDS];
+	const size_t len = strlen(tld);
+	memcpy(out, tld, len);
+	return out + len;
+}
+
+/**
+ * Write the domain of the given id. Returns the end of the domain. A depth of
+ * zero is a second level domain of its own; subdomains are under one of the
+ * popular second level domains.
+ */
+static char *append_domain(char *out, GenOptions_t const *opts,
+		double const *cdf, uint64_t id)
+{
+	uint64_t state = opts->seed ^ (0xa0761d6478bd642fULL * (id + 1));
+
+	size_t depth = 0;
+	while(depth < MAX_DEPTH && uniform(&state) < opts->depth)
+	{
+		depth++;
+	}
+
+	if(depth == 0)
+	{
+		// ranks above the popular ones are unique to the id.
+		return append_sld(out, opts->seed, opts->slds + id);
+	}
+
+	const size_t rank = sample_zipf(cdf, opts->slds, uniform(&state));
+	for(size_t i = 0; i < depth; i++)
+	{
+		out = append_label(out, &state, 1, 12);
+		*out++ = '.';
+	}
+
+	return append_sld(out, opts->seed, rank);
+}
+
+static bool generate_file(GenOptions_t const *opts, double const *cdf,
+		size_t file)
+{
+	const size_t len_path = strlen(opts->directory) + strlen(opts->prefix) + 32;
+	char *path = malloc(len_path);
+	char *name = malloc(strlen(opts->prefix) + 32);
+	if(!path || !name)
+	{
+		exit(EXIT_FAILURE);
+	}
+	snprintf(name, strlen(opts->prefix) + 32, "%s_%zu", opts->prefix, file);
+	snprintf(path, len_path, "%s/%s.fat", opts->directory, name);
+
+	FILE *f = fopen(path, "w");
+	if(!f)
+	{
+		fprintf(stderr, "ERROR: unable to open %s for writing.\n", path);
+		free(name);
+		free(path);
+		return false;
+	}
+	setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+	uint64_t state = opts->seed ^ (0x8bb84b93962eacc9ULL * (file + 1));
+	// the shared pool holds as many ids as the shared lines of one file;
+	// private ids start above every shared id.
+	const uint64_t len_pool = (uint64_t)(opts->lines * opts->overlap) + 1;
+	const uint64_t private_base = len_pool + (uint64_t)file * opts->lines;
+
+	char domain[(MAX_DEPTH + 3) * 16];
+	for(size_t i = 0; i < opts->lines; i++)
+	{
+		const bool regex = uniform(&state) < opts->regex;
+		const bool shared = uniform(&state) < opts->overlap;
+		const uint64_t id = shared ? splitmix64(&state) % len_pool :
+			private_base + i;
+
+		char *end = append_domain(domain, opts, cdf, id);
+		if(regex)
+		{
+			// same shape as the regexes of EasyList: subdomains of the rest of
+			// the domain that begin with its first label.
+			char const *rest = memchr(domain, '.', end - domain);
+			fprintf(f, ",(?:^|\\.)%.*s[^\"\\x2c\\s]*", (int)(rest - domain),
+					domain);
+			for(char const *c = rest; c != end; c++)
+			{
+				if(*c == '.')
+				{
+					fputc('\\', f);
+				}
+				fputc(*c, f);
+			}
+			fprintf(f, ",,0,%s,DNSBL_Synthetic,2\n", name);
+			continue;
+		}
+
+		const int match = uniform(&state) < opts->full ? 1 : 0;
+		fprintf(f, ",%.*s,,0,%s,DNSBL_Synthetic,%d\n", (int)(end - domain),
+				domain, name, match);
+	}
+
+	const bool ok = fclose(f) == 0;
+	if(!ok)
+	{
+		fprintf(stderr, "ERROR: failed to write %s.\n", path);
+	}
+	free(name);
+	free(path);
+	return ok;
+}
+
+static bool parse_share(char const *arg, double *share)
+{
+	char *end;
+	*share = strtod(arg, &end);
+	return *end == '\0' && *share >= 0.0 && *share <= 1.0;
+}
+
+static void usage(char const *prog)
+{
+	fprintf(stderr, "Usage: %s -d <directory> "
+			"[-f <files>] "
+			"[-n <lines per file>] "
+			"[-s <seed>] "
+			"[-O <overlap 0..1>] "
+			"[-F <full 0..1>] "
+			"[-R <regex 0..1>] "
+			"[-D <depth 0..1>] "
+			"[-k <skew>] "
+			"[-S <second level domains>] "
+			"[-p <prefix>]\n", prog);
+}
+
+int main(int argc, char *const *argv)
+{
+	GenOptions_t opts = {
+		.directory = NULL,
+		.prefix = "synthetic",
+		.files = 3,
+		.lines = 1000000,
+		.seed = 1,
+		.overlap = 0.3,
+		.full = 0.05,
+		.regex = 0.001,
+		.depth = 0.5,
+		.skew = 1.1,
+		.slds = 0
+	};
+
+	int opt;
+	bool error = false;
+	while(!error && (opt = getopt(argc, argv, "d:f:n:s:O:F:R:D:k:S:p:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'd':
+				opts.directory = optarg;
+				break;
+			case 'f':
+				opts.files = strtoull(optarg, NULL, 10);
+				break;
+			case 'n':
+				opts.lines = strtoull(optarg, NULL, 10);
+				break;
+			case 's':
+				opts.seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'O':
+				error = !parse_share(optarg, &opts.overlap);
+				break;
+			case 'F':
+				error = !parse_share(optarg, &opts.full);
+				break;
+			case 'R':
+				error = !parse_share(optarg, &opts.regex);
+				break;
+			case 'D':
+				error = !parse_share(optarg, &opts.depth) || opts.depth >= 1.0;
+				break;
+			case 'k':
+				opts.skew = strtod(optarg, NULL);
+				error = opts.skew < 0.0;
+				break;
+			case 'S':
+				opts.slds = strtoull(optarg, NULL, 10);
+				break;
+			case 'p':
+				opts.prefix = optarg;
+				break;
+			default:
+				error = true;
+				break;
+		}
+	}
+
+	if(error || !opts.directory || !opts.files || !opts.lines || optind != argc)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// the directory is created when missing; not its parents.
+	if(mkdir(opts.directory, 0755) != 0 && errno != EEXIST)
+	{
+		fprintf(stderr, "ERROR: unable to create directory %s: %s\n",
+				opts.directory, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if(!opts.slds)
+	{
+		// on average a hundred subdomains per popular second level domain.
+		opts.slds = opts.lines / 100 + 1;
+	}
+
+	double *cdf = zipf_cdf(opts.slds, opts.skew);
+
+	int ret = EXIT_SUCCESS;
+	for(size_t file = 0; file < opts.files; file++)
+	{
+		if(!generate_file(&opts, cdf, file))
+		{
+			ret = EXIT_FAILURE;
+			break;
+		}
+	}
+
+	free(cdf);
+	return ret;
+}
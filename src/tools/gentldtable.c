@@ -0,0 +1,337 @@
+/**
+ * gentldtable.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * Writes the perfect hash table of known TLDs included by src/tldtable.c:
+ *
+ *   gentldtable.real <tlds.txt> <output.h>
+ *
+ * The input has one TLD per line as in IANA's tlds-alpha-by-domain.txt; lines
+ * starting with '#' are skipped. Every TLD hashes with TLD_HASH() to a bucket
+ * whose displacement moves it to a slot no other TLD takes, so a lookup is one
+ * hash, one index and one compare. The seed is searched from 1 so the same
+ * input always gives the same table.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "tldtable.h"
+
+#define MAX_LABEL 63
+#define MAX_SEEDS 100000
+
+typedef struct Tld
+{
+	char label[MAX_LABEL + 1];
+	size_t len;
+	uint32_t hash;
+} Tld_t;
+
+static int cmp_tld(void const *a, void const *b)
+{
+	return strcmp(((Tld_t const*)a)->label, ((Tld_t const*)b)->label);
+}
+
+static Tld_t *read_tlds(char const *fname, size_t *len)
+{
+	FILE *f = fopen(fname, "r");
+	if(!f)
+	{
+		fprintf(stderr, "ERROR: failed to open %s\n", fname);
+		exit(EXIT_FAILURE);
+	}
+
+	size_t alloc = 1024;
+	Tld_t *tlds = malloc(sizeof(Tld_t) * alloc);
+	if(!tlds)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	char line[256];
+	size_t linenumber = 0;
+	*len = 0;
+	while(fgets(line, sizeof(line), f))
+	{
+		linenumber++;
+		size_t n = strcspn(line, " \t\r\n");
+		if(line[0] == '#' || n == 0)
+		{
+			continue;
+		}
+
+		if(n > MAX_LABEL)
+		{
+			fprintf(stderr, "ERROR: %s:%lu: label too long\n", fname, linenumber);
+			exit(EXIT_FAILURE);
+		}
+
+		if(*len == alloc)
+		{
+			alloc *= 2;
+			Tld_t *tmp = realloc(tlds, sizeof(Tld_t) * alloc);
+			if(!tmp)
+			{
+				exit(EXIT_FAILURE);
+			}
+			tlds = tmp;
+		}
+
+		Tld_t *t = &tlds[*len];
+		for(size_t i = 0; i < n; i++)
+		{
+			const unsigned char c = tolower((unsigned char)line[i]);
+			if(!isalnum(c) && c != '-')
+			{
+				fprintf(stderr, "ERROR: %s:%lu: not a label\n", fname, linenumber);
+				exit(EXIT_FAILURE);
+			}
+			t->label[i] = c;
+		}
+		t->label[n] = '\0';
+		t->len = n;
+		(*len)++;
+	}
+	fclose(f);
+
+	// drop duplicates; the order of the input does not matter.
+	qsort(tlds, *len, sizeof(Tld_t), cmp_tld);
+	size_t unique = 0;
+	for(size_t i = 0; i < *len; i++)
+	{
+		if(!unique || strcmp(tlds[unique - 1].label, tlds[i].label))
+		{
+			tlds[unique++] = tlds[i];
+		}
+	}
+	*len = unique;
+
+	return tlds;
+}
+
+typedef struct Bucket
+{
+	size_t *members;
+	size_t len;
+} Bucket_t;
+
+static int cmp_bucket(void const *a, void const *b)
+{
+	size_t const la = ((Bucket_t const*)a)->len;
+	size_t const lb = ((Bucket_t const*)b)->len;
+	return la < lb ? 1 : la > lb ? -1 : 0;
+}
+
+/**
+ * Try to place every TLD hashed with the given seed. Returns false when some
+ * bucket finds no displacement.
+ */
+static bool place_tlds(Tld_t *tlds, size_t len, uint32_t seed,
+		unsigned bucket_bits, unsigned slot_bits, uint16_t *displacements,
+		long *slots)
+{
+	const size_t len_buckets = (size_t)1 << bucket_bits;
+	const size_t len_slots = (size_t)1 << slot_bits;
+
+	Bucket_t *buckets = calloc(len_buckets, sizeof(Bucket_t));
+	size_t *members = malloc(sizeof(size_t) * len);
+	size_t *fill = calloc(len_buckets, sizeof(size_t));
+	if(!buckets || !members || !fill)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	for(size_t i = 0; i < len; i++)
+	{
+		TLD_HASH(tlds[i].label, tlds[i].len, seed, tlds[i].hash);
+		buckets[tlds[i].hash >> (32 - bucket_bits)].len++;
+	}
+
+	size_t offset = 0;
+	for(size_t b = 0; b < len_buckets; b++)
+	{
+		buckets[b].members = members + offset;
+		offset += buckets[b].len;
+	}
+	for(size_t i = 0; i < len; i++)
+	{
+		const size_t b = tlds[i].hash >> (32 - bucket_bits);
+		buckets[b].members[fill[b]++] = i;
+	}
+
+	// the displacement of a bucket is stored by the bucket index; remember it
+	// before sorting the largest buckets first.
+	for(size_t s = 0; s < len_slots; s++)
+	{
+		slots[s] = -1;
+	}
+	memset(displacements, 0, sizeof(uint16_t) * len_buckets);
+	qsort(buckets, len_buckets, sizeof(Bucket_t), cmp_bucket);
+
+	bool placed = true;
+	for(size_t b = 0; placed && b < len_buckets && buckets[b].len; b++)
+	{
+		Bucket_t const *bucket = &buckets[b];
+		const uint32_t index = tlds[bucket->members[0]].hash >> (32 - bucket_bits);
+
+		placed = false;
+		for(uint32_t d = 0; d < len_slots; d++)
+		{
+			displacements[index] = d;
+			size_t m = 0;
+			for(; m < bucket->len; m++)
+			{
+				const uint32_t slot = TLD_SLOT(tlds[bucket->members[m]].hash,
+						displacements, bucket_bits, slot_bits);
+				if(slots[slot] != -1)
+				{
+					break;
+				}
+				slots[slot] = bucket->members[m];
+			}
+
+			if(m == bucket->len)
+			{
+				placed = true;
+				break;
+			}
+
+			// undo the members placed with this displacement.
+			while(m--)
+			{
+				slots[TLD_SLOT(tlds[bucket->members[m]].hash, displacements,
+						bucket_bits, slot_bits)] = -1;
+			}
+		}
+	}
+
+	free(buckets);
+	free(members);
+	free(fill);
+	return placed;
+}
+
+static void write_table(FILE *out, Tld_t const *tlds, size_t len,
+		uint32_t seed, unsigned bucket_bits, unsigned slot_bits,
+		uint16_t const *displacements, long const *slots)
+{
+	const size_t len_buckets = (size_t)1 << bucket_bits;
+	const size_t len_slots = (size_t)1 << slot_bits;
+
+	fprintf(out, "/* generated by gentldtable; do not edit. */\n");
+	fprintf(out, "#ifndef TLD_TABLE_NOGIT_H\n#define TLD_TABLE_NOGIT_H\n\n");
+	fprintf(out, "#define TLD_TABLE_LEN %lu\n", len);
+	fprintf(out, "#define TLD_TABLE_SEED 0x%08xu\n", seed);
+	fprintf(out, "#define TLD_TABLE_BUCKET_BITS %u\n", bucket_bits);
+	fprintf(out, "#define TLD_TABLE_SLOT_BITS %u\n\n", slot_bits);
+
+	fprintf(out, "static const uint16_t TLD_DISPLACEMENTS[%lu] = {", len_buckets);
+	for(size_t b = 0; b < len_buckets; b++)
+	{
+		fprintf(out, "%s%u,", b % 12 ? " " : "\n\t", displacements[b]);
+	}
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "static const unsigned char TLD_LENGTHS[%lu] = {", len_slots);
+	for(size_t s = 0; s < len_slots; s++)
+	{
+		fprintf(out, "%s%lu,", s % 16 ? " " : "\n\t",
+				slots[s] == -1 ? 0 : tlds[slots[s]].len);
+	}
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "static const char *const TLD_LABELS[%lu] = {", len_slots);
+	for(size_t s = 0; s < len_slots; s++)
+	{
+		fprintf(out, "%s\"%s\",", s % 8 ? " " : "\n\t",
+				slots[s] == -1 ? "" : tlds[slots[s]].label);
+	}
+	fprintf(out, "\n};\n\n#endif\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc != 3)
+	{
+		fprintf(stderr, "usage: %s <tlds.txt> <output.h>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	size_t len = 0;
+	Tld_t *tlds = read_tlds(argv[1], &len);
+	if(!len)
+	{
+		fprintf(stderr, "ERROR: no TLDs in %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	// at most three quarters of the slots are used; a bucket per four slots.
+	unsigned slot_bits = 2;
+	while(((size_t)3 << slot_bits) / 4 < len)
+	{
+		slot_bits++;
+	}
+	if(slot_bits > 16)
+	{
+		fprintf(stderr, "ERROR: too many TLDs: %lu\n", len);
+		return EXIT_FAILURE;
+	}
+	const unsigned bucket_bits = slot_bits - 2;
+
+	uint16_t *displacements = malloc(sizeof(uint16_t) << bucket_bits);
+	long *slots = malloc(sizeof(long) << slot_bits);
+	if(!displacements || !slots)
+	{
+		return EXIT_FAILURE;
+	}
+
+	uint32_t seed = 1;
+	while(!place_tlds(tlds, len, seed, bucket_bits, slot_bits, displacements,
+				slots))
+	{
+		if(++seed > MAX_SEEDS)
+		{
+			fprintf(stderr, "ERROR: found no perfect hash for %lu TLDs\n", len);
+			return EXIT_FAILURE;
+		}
+	}
+
+	FILE *out = fopen(argv[2], "w");
+	if(!out)
+	{
+		fprintf(stderr, "ERROR: failed to open %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	write_table(out, tlds, len, seed, bucket_bits, slot_bits, displacements,
+			slots);
+	if(fclose(out))
+	{
+		fprintf(stderr, "ERROR: failed to write %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	free(displacements);
+	free(slots);
+	free(tlds);
+	return EXIT_SUCCESS;
+}
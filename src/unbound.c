@@ -0,0 +1,265 @@
+/**
+ * unbound.c
+ *
+ * Part of pfb_dnsbl_prune
+ *
+ * Copyright (c) 2023 robert.babilon@gmail.com
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// fileno() and inet_pton() are hidden by -std=c17 otherwise
+#define _POSIX_C_SOURCE 200809L
+#include "dedupdomains.h"
+#include "unbound.h"
+#include <arpa/inet.h>
+
+// longest name written; same limit as prune_DomainTree().
+#define UNBOUND_NAME_MAX 4096
+// room for the name, the sinkhole and the directives around them.
+#define UNBOUND_LINE_MAX (UNBOUND_NAME_MAX + INET6_ADDRSTRLEN + 64)
+
+static const char DEFAULT_SINKHOLE[] = "0.0.0.0";
+// time to live of the records written.
+static const char RECORD_TTL[] = "60";
+
+/**
+ * Returns true when the given string is an IPv4 or IPv6 address.
+ */
+bool valid_sinkhole(char const *sinkhole)
+{
+	ASSERT(sinkhole);
+	unsigned char addr[sizeof(struct in6_addr)];
+	return inet_pton(AF_INET, sinkhole, addr) == 1 ||
+		inet_pton(AF_INET6, sinkhole, addr) == 1;
+}
+
+/**
+ * Initialize the given UnboundConf_t to write to the given file and write the
+ * 'server:' clause the entries belong to. Blocked names resolve to the
+ * optional sinkhole; NULL answers FULL matches with NXDOMAIN and the exact
+ * names with 0.0.0.0.
+ */
+void init_UnboundConf(UnboundConf_t *uc, FILE *file, char const *sinkhole)
+{
+	ASSERT(uc);
+	ASSERT(file);
+	ASSERT(!sinkhole || valid_sinkhole(sinkhole));
+
+	uc->file = file;
+	init_OutBuffer(&uc->out, fileno(file));
+	uc->tmp_fname = NULL;
+	uc->fname = NULL;
+
+	uc->redirect = sinkhole != NULL;
+	uc->sinkhole = sinkhole ? sinkhole : DEFAULT_SINKHOLE;
+	uc->rr_type = strchr(uc->sinkhole, ':') ? "AAAA" : "A";
+
+	uc->zones = 0;
+	uc->records = 0;
+	uc->err = 0;
+
+	static const char header[] = "server:";
+	uc->err |= append_OutBuffer(&uc->out, header, sizeof(header) - 1);
+}
+
+/**
+ * Same as init_UnboundConf() for a temporary file next to 'fname' that
+ * replaces it once closed, so Unbound never reads a partial configuration.
+ * Returns false if the file cannot be created.
+ */
+bool open_UnboundConf(UnboundConf_t *uc, char const *fname,
+		char const *sinkhole)
+{
+	ASSERT(uc);
+	ASSERT(fname);
+
+	const size_t len_tmp = strlen(fname) + sizeof(".tmp");
+	char *tmp = malloc(len_tmp);
+	if(!tmp)
+	{
+		ELOG_STDERR("ERROR: failed to allocate file name\n");
+		exit(EXIT_FAILURE);
+	}
+	snprintf(tmp, len_tmp, "%s.tmp", fname);
+
+	FILE *f = fopen(tmp, "wb");
+	if(!f)
+	{
+		ELOG_STDERR("ERROR: unable to open '%s' for writing.\n", tmp);
+		free(tmp);
+		return false;
+	}
+
+	init_UnboundConf(uc, f, sinkhole);
+	uc->tmp_fname = tmp;
+	uc->fname = fname;
+
+	return true;
+}
+
+static char *put(char *pos, char const *s, size_t len)
+{
+	memcpy(pos, s, len);
+	return pos + len;
+}
+
+#define PUT_LITERAL(pos, s) put(pos, s, sizeof(s) - 1)
+
+static void append_record(UnboundConf_t *uc, char const *fqd, size_t len)
+{
+	char line[UNBOUND_LINE_MAX];
+	char *pos = PUT_LITERAL(line, "local-data: \"");
+	pos = put(pos, fqd, len);
+	*pos++ = ' ';
+	pos = PUT_LITERAL(pos, RECORD_TTL);
+	pos = PUT_LITERAL(pos, " IN ");
+	pos = put(pos, uc->rr_type, strlen(uc->rr_type));
+	*pos++ = ' ';
+	pos = put(pos, uc->sinkhole, strlen(uc->sinkhole));
+	*pos++ = '"';
+
+	uc->err |= append_OutBuffer(&uc->out, line, pos - line);
+	uc->records++;
+}
+
+static void append_zone(UnboundConf_t *uc, char const *fqd, size_t len)
+{
+	char line[UNBOUND_LINE_MAX];
+	char *pos = PUT_LITERAL(line, "local-zone: \"");
+	pos = put(pos, fqd, len);
+	pos = uc->redirect ? PUT_LITERAL(pos, "\" redirect") :
+		PUT_LITERAL(pos, "\" always_nxdomain");
+
+	uc->err |= append_OutBuffer(&uc->out, line, pos - line);
+	uc->zones++;
+}
+
+/**
+ * Write the entries blocking the given domain. A FULL match blocks the domain
+ * and its subdomains, a redirect zone needs a record to answer with; a weak
+ * match blocks the exact name. Regexes cannot be expressed and are ignored.
+ */
+void append_UnboundConf(UnboundConf_t *uc, char const *fqd, size_t len,
+		MatchStrength_t ms)
+{
+	ASSERT(uc);
+	ASSERT(fqd);
+	ASSERT(len);
+
+	if(len > UNBOUND_NAME_MAX)
+	{
+		ELOG_STDERR("WARNING: domain too long for Unbound: %.*s...\n",
+				64, fqd);
+		return;
+	}
+
+	if(ms == MATCH_FULL)
+	{
+		append_zone(uc, fqd, len);
+		if(uc->redirect)
+		{
+			append_record(uc, fqd, len);
+		}
+	}
+	else if(ms == MATCH_WEAK)
+	{
+		append_record(uc, fqd, len);
+	}
+}
+
+/**
+ * Write out the buffered entries. A file opened by open_UnboundConf() is
+ * closed and replaces the requested file; otherwise the caller closes the
+ * file. Returns false if any entry failed to be written.
+ */
+bool close_UnboundConf(UnboundConf_t *uc)
+{
+	ASSERT(uc);
+	ASSERT(uc->file);
+
+	bool ok = !uc->err && !flush_OutBuffer(&uc->out);
+	free_OutBuffer(&uc->out);
+
+	if(uc->tmp_fname)
+	{
+		ok = fclose(uc->file) == 0 && ok;
+		if(ok && rename(uc->tmp_fname, uc->fname) != 0)
+		{
+			ok = false;
+		}
+
+		if(!ok)
+		{
+			ELOG_STDERR("ERROR: failed to write Unbound configuration '%s'\n",
+					uc->fname);
+			remove(uc->tmp_fname);
+		}
+		free(uc->tmp_fname);
+		uc->tmp_fname = NULL;
+	}
+	uc->file = NULL;
+
+	return ok;
+}
+
+#ifdef BUILD_TESTS
+static void check_UnboundConf(char const *sinkhole, char const *expect)
+{
+	FILE *f = tmpfile();
+	assert(f);
+
+	UnboundConf_t uc;
+	init_UnboundConf(&uc, f, sinkhole);
+	append_UnboundConf(&uc, "ads.example.com", 15, MATCH_FULL);
+	append_UnboundConf(&uc, "www.example.org", 15, MATCH_WEAK);
+	append_UnboundConf(&uc, "(?:^|\\.)ads\\.", 10, MATCH_REGEX);
+	assert(uc.zones == 1);
+	assert(uc.records == (sinkhole ? 2 : 1));
+	assert(close_UnboundConf(&uc));
+
+	const size_t len = strlen(expect);
+	char *check = malloc(len + 1);
+	rewind(f);
+	assert(fread(check, 1, len + 1, f) == len);
+	assert(!memcmp(check, expect, len));
+
+	free(check);
+	fclose(f);
+}
+
+void test_UnboundConf()
+{
+	assert(valid_sinkhole("10.10.10.1"));
+	assert(valid_sinkhole("::1"));
+	assert(!valid_sinkhole("10.10.10"));
+	assert(!valid_sinkhole("localhost"));
+
+	check_UnboundConf(NULL,
+			"server:\n"
+			"local-zone: \"ads.example.com\" always_nxdomain\n"
+			"local-data: \"www.example.org 60 IN A 0.0.0.0\"\n");
+
+	check_UnboundConf("10.10.10.1",
+			"server:\n"
+			"local-zone: \"ads.example.com\" redirect\n"
+			"local-data: \"ads.example.com 60 IN A 10.10.10.1\"\n"
+			"local-data: \"www.example.org 60 IN A 10.10.10.1\"\n");
+
+	check_UnboundConf("fd00::1",
+			"server:\n"
+			"local-zone: \"ads.example.com\" redirect\n"
+			"local-data: \"ads.example.com 60 IN AAAA fd00::1\"\n"
+			"local-data: \"www.example.org 60 IN AAAA fd00::1\"\n");
+}
+#endif